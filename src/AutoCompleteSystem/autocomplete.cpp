@@ -1 +1,536 @@
-//this is our auto completion system file?
\ No newline at end of file
+#include "autocomplete.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "../CacheSystem/response_cache.hpp"
+
+namespace termsage {
+
+    namespace {
+        constexpr char cache_magic[8] = {'T', 'S', 'H', 'I', 'S', 'T', '0', '1'};
+        constexpr size_t max_entry_bytes = 4096;
+
+        void put_u64(std::string& out, uint64_t value) {
+            for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+
+        void put_string(std::string& out, std::string_view value) {
+            uint32_t length = static_cast<uint32_t>(value.size());
+            for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((length >> (8 * i)) & 0xFF));
+            out.append(value.data(), value.size());
+        }
+
+        bool get_u64(std::string_view in, size_t& pos, uint64_t& value) {
+            if (in.size() - pos < 8) return false;
+            value = 0;
+            for (int i = 0; i < 8; i++) value |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos + i])) << (8 * i);
+            pos += 8;
+            return true;
+        }
+
+        bool get_string(std::string_view in, size_t& pos, std::string_view& value) {
+            if (in.size() - pos < 4) return false;
+            uint32_t length = 0;
+            for (int i = 0; i < 4; i++) length |= static_cast<uint32_t>(static_cast<unsigned char>(in[pos + i])) << (8 * i);
+            pos += 4;
+            if (in.size() - pos < length) return false;
+            value = in.substr(pos, length);
+            pos += length;
+            return true;
+        }
+
+        // Read-only mapping of a whole file, released on scope exit
+        struct mapped_file {
+            const char* data = nullptr;
+            size_t size = 0;
+
+            explicit mapped_file(const std::string& path) {
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1) return;
+                struct stat st {};
+                if (fstat(fd, &st) == 0 && st.st_size > 0) map(fd, static_cast<size_t>(st.st_size));
+                ::close(fd);
+            }
+
+            mapped_file(int fd, size_t length) { map(fd, length); }
+
+            ~mapped_file() {
+                if (data) munmap(const_cast<char*>(data), size);
+            }
+
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+        private:
+            void map(int fd, size_t length) {
+                void* base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (base == MAP_FAILED) return;
+                data = static_cast<const char*>(base);
+                size = length;
+                madvise(base, size, MADV_SEQUENTIAL);
+            }
+        };
+
+        // Reads up to length bytes at offset; fewer when the file ends sooner
+        size_t read_at(int fd, char* buffer, size_t length, size_t offset) {
+            size_t got = 0;
+            while (got < length) {
+                ssize_t n = pread(fd, buffer + got, length - got, static_cast<off_t>(offset + got));
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += static_cast<size_t>(n);
+            }
+            return got;
+        }
+
+        std::string_view trim(std::string_view text) {
+            while (!text.empty() && static_cast<unsigned char>(text.front()) <= ' ') text.remove_prefix(1);
+            while (!text.empty() && static_cast<unsigned char>(text.back()) <= ' ') text.remove_suffix(1);
+            return text;
+        }
+
+        std::string directory_of(const std::string& path) {
+            size_t slash = path.rfind('/');
+            return slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+        }
+    }
+
+    std::string default_prompt_history_path() {
+        std::string base;
+        if (const char* state = std::getenv("XDG_STATE_HOME")) {
+            base = state;
+        } else if (const char* home = std::getenv("HOME")) {
+            base = std::string(home) + "/.local";
+            mkdir(base.c_str(), 0755);
+            base += "/state";
+        } else {
+            return "termsage_history";
+        }
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        return base + "/history";
+    }
+
+    std::string default_history_cache_path() {
+        std::string base;
+        if (const char* cache = std::getenv("XDG_CACHE_HOME")) base = cache;
+        else if (const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+        else return "termsage_history.bin";
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        return base + "/history.bin";
+    }
+
+    std::vector<history_source> default_history_sources() {
+        std::vector<history_source> sources;
+        const char* home = std::getenv("HOME");
+        if (home) sources.push_back({std::string(home) + "/.bash_history", history_format::bash});
+        if (const char* zdot = std::getenv("ZDOTDIR")) sources.push_back({std::string(zdot) + "/.zsh_history", history_format::zsh});
+        else if (home) sources.push_back({std::string(home) + "/.zsh_history", history_format::zsh});
+        sources.push_back({default_prompt_history_path(), history_format::plain});
+        return sources;
+    }
+
+    history_completer::history_completer(std::vector<history_source> history_sources, std::string cache_path, size_t max_entries)
+        : cache_path(std::move(cache_path)), max_entries(max_entries) {
+        for (auto& source : history_sources) sources.push_back({std::move(source)});
+        if (pipe(stop_pipe) == 0) {
+            for (int fd : stop_pipe) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    history_completer::~history_completer() {
+        stopping = true;
+        if (stop_pipe[1] != -1) {
+            char byte = 1;
+            ssize_t ignored = write(stop_pipe[1], &byte, 1);
+            (void)ignored;
+        }
+        if (worker.joinable()) worker.join();
+        for (int fd : stop_pipe) if (fd != -1) ::close(fd);
+
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            changed = dirty;
+        }
+        if (changed) save();
+    }
+
+    void history_completer::load() {
+        load_cache();
+        for (auto& state : sources) {
+            if (stopping) return;
+            catch_up(state);
+        }
+
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            changed = dirty;
+        }
+        if (changed) save();
+    }
+
+    void history_completer::start() {
+        if (worker.joinable()) return;
+        worker = std::thread([this]() {
+            load();
+            watch_loop();
+        });
+    }
+
+    void history_completer::record(std::string_view prompt) {
+        std::string text(trim(prompt));
+        if (text.empty() || text.size() > max_entry_bytes) return;
+        std::replace(text.begin(), text.end(), '\n', ' ');
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            insert_locked(text);
+        }
+
+        // Other TermSage instances pick the prompt up from the file
+        for (const auto& state : sources) {
+            if (state.source.format != history_format::plain) continue;
+            int fd = ::open(state.source.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+            if (fd == -1) return;
+            text.push_back('\n');
+            ssize_t ignored = ::write(fd, text.data(), text.size());
+            (void)ignored;
+            ::close(fd);
+            return;
+        }
+    }
+
+    std::vector<std::string> history_completer::complete(std::string_view prefix, size_t limit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<const entry*> matches;
+        for (const auto& item : entries) {
+            if (item.text.size() > prefix.size() && item.text.compare(0, prefix.size(), prefix) == 0) matches.push_back(&item);
+        }
+
+        size_t count = std::min(limit, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(count), matches.end(),
+                          [](const entry* a, const entry* b) { return a->last_used > b->last_used; });
+        std::vector<std::string> completions;
+        completions.reserve(count);
+        for (size_t i = 0; i < count; i++) completions.push_back(matches[i]->text);
+        return completions;
+    }
+
+    size_t history_completer::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    // Layout: magic, u64 source count, per source its path, inode, offset and fingerprint, u64 entry
+    // count, entries oldest first, then an FNV-1a checksum of everything before it.
+    // Written to a temporary file and renamed so readers never see a partial cache.
+    bool history_completer::save() {
+        std::string data(cache_magic, sizeof(cache_magic));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            put_u64(data, sources.size());
+            for (const auto& state : sources) {
+                put_string(data, state.source.path);
+                put_u64(data, state.inode);
+                put_u64(data, state.offset);
+                put_u64(data, state.fingerprint);
+            }
+
+            std::vector<const entry*> order;
+            order.reserve(entries.size());
+            for (const auto& item : entries) order.push_back(&item);
+            std::sort(order.begin(), order.end(), [](const entry* a, const entry* b) { return a->last_used < b->last_used; });
+            put_u64(data, order.size());
+            for (const entry* item : order) put_string(data, item->text);
+            dirty = false;
+        }
+        put_u64(data, ollama::fnv1a_64(data.data(), data.size()));
+
+        std::string temporary = cache_path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size()))) return false;
+        }
+        return std::rename(temporary.c_str(), cache_path.c_str()) == 0;
+    }
+
+    bool history_completer::load_cache() {
+        mapped_file file(cache_path);
+        if (!file.data || file.size < sizeof(cache_magic) + 24 || memcmp(file.data, cache_magic, sizeof(cache_magic)) != 0) return false;
+
+        std::string_view data(file.data, file.size);
+        size_t end = data.size() - 8;
+        size_t pos = end;
+        uint64_t checksum = 0;
+        if (!get_u64(data, pos, checksum) || checksum != ollama::fnv1a_64(data.data(), end)) return false;
+        data = data.substr(0, end);
+
+        pos = sizeof(cache_magic);
+        uint64_t count = 0;
+        if (!get_u64(data, pos, count)) return false;
+        std::vector<source_state> saved(count);
+        for (auto& state : saved) {
+            std::string_view path;
+            if (!get_string(data, pos, path) || !get_u64(data, pos, state.inode) || !get_u64(data, pos, state.offset) ||
+                !get_u64(data, pos, state.fingerprint)) return false;
+            state.source.path = std::string(path);
+        }
+        if (!get_u64(data, pos, count)) return false;
+        size_t entries_start = pos;
+        for (uint64_t i = 0; i < count; i++) {
+            std::string_view text;
+            if (!get_string(data, pos, text)) return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& state : sources) {
+            for (const auto& known : saved) {
+                if (known.source.path != state.source.path) continue;
+                state.inode = known.inode;
+                state.offset = known.offset;
+                state.fingerprint = known.fingerprint;
+            }
+        }
+        pos = entries_start;
+        entries.reserve(count);
+        rebuild_slots_locked(2 * count);
+        for (uint64_t i = 0; i < count; i++) {
+            std::string_view text;
+            get_string(data, pos, text);
+            insert_locked(text);
+        }
+        dirty = false;
+        return true;
+    }
+
+    // Parses what was appended since the last visit, or the whole file if it was replaced,
+    // truncated or rewritten in place. Appended bytes are read with pread rather than mapped, so
+    // a shell cutting the file short meanwhile only shortens the read instead of raising SIGBUS.
+    void history_completer::catch_up(source_state& state) {
+        int fd = ::open(state.source.path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st {};
+        if (fd == -1 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+            if (fd != -1) ::close(fd);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (state.offset != 0) dirty = true;
+            state.inode = static_cast<uint64_t>(st.st_ino);
+            state.offset = 0;
+            state.fingerprint = ollama::fnv1a_64(nullptr, 0);
+            return;
+        }
+
+        uint64_t inode = static_cast<uint64_t>(st.st_ino);
+        size_t size = static_cast<size_t>(st.st_size);
+        size_t offset = static_cast<size_t>(state.offset);
+        bool appended = inode == state.inode && offset <= size && fingerprint_at(fd, offset) == state.fingerprint;
+        if (appended && offset == size) {
+            ::close(fd);
+            return;
+        }
+
+        size_t consumed = 0;
+        if (appended) {
+            std::string added(size - offset, '\0');
+            size_t got = read_at(fd, added.data(), added.size(), offset);
+            consumed = offset + parse(added.data(), 0, got, state.source.format);
+        } else {
+            mapped_file file(fd, size);
+            if (file.data) consumed = parse(file.data, 0, file.size, state.source.format);
+        }
+        uint64_t fingerprint = fingerprint_at(fd, consumed);
+        ::close(fd);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        state.inode = inode;
+        state.offset = consumed;
+        state.fingerprint = fingerprint;
+        dirty = true;
+    }
+
+    // Returns the offset after the last complete entry; a line still being written stays unread
+    size_t history_completer::parse(const char* data, size_t begin, size_t size, history_format format) {
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t line_start = begin, consumed = begin, taken = 0;
+        std::string continued;
+
+        for_each_newline(data + begin, size - begin, [&](size_t at) {
+            size_t end = begin + at;
+            std::string_view line(data + line_start, end - line_start);
+            line_start = end + 1;
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+            // zsh writes the newlines inside a multi-line command as "\\\n"
+            if (format == history_format::zsh && !line.empty() && line.back() == '\\') {
+                if (continued.size() < 2 * max_entry_bytes) continued.append(line.substr(0, line.size() - 1)).push_back(' ');
+                return;
+            }
+            if (continued.empty()) {
+                take_locked(line, format);
+            } else {
+                continued.append(line);
+                take_locked(continued, format);
+                continued.clear();
+            }
+            consumed = line_start;
+
+            // Let completion in while a large file is read
+            if (++taken % 4096 == 0) {
+                lock.unlock();
+                lock.lock();
+            }
+        });
+        return consumed;
+    }
+
+    void history_completer::take_locked(std::string_view line, history_format format) {
+        std::string unmetafied;
+        if (format == history_format::bash) {
+            // HISTTIMEFORMAT writes "#<epoch>" before each command
+            if (line.size() > 1 && line[0] == '#' && line.find_first_not_of("0123456789", 1) == std::string_view::npos) return;
+        } else if (format == history_format::zsh) {
+            // EXTENDED_HISTORY: ": <start>:<elapsed>;command"
+            if (line.size() > 2 && line[0] == ':' && line[1] == ' ') {
+                size_t colon = line.find_first_not_of("0123456789", 2);
+                if (colon != std::string_view::npos && colon > 2 && line[colon] == ':') {
+                    size_t semicolon = line.find_first_not_of("0123456789", colon + 1);
+                    if (semicolon != std::string_view::npos && line[semicolon] == ';') line.remove_prefix(semicolon + 1);
+                }
+            }
+            // Bytes zsh treats specially are stored as 0x83 followed by the byte xor 32
+            if (line.find('\x83') != std::string_view::npos) {
+                unmetafied.reserve(line.size());
+                for (size_t i = 0; i < line.size(); i++) {
+                    if (line[i] == '\x83' && i + 1 < line.size()) unmetafied.push_back(static_cast<char>(line[++i] ^ 32));
+                    else unmetafied.push_back(line[i]);
+                }
+                line = unmetafied;
+            }
+        }
+
+        line = trim(line);
+        if (line.empty() || line.size() > max_entry_bytes) return;
+        insert_locked(line);
+    }
+
+    // A repeated entry only moves to the front
+    void history_completer::insert_locked(std::string_view text) {
+        uint64_t hash = ollama::fnv1a_64(text.data(), text.size());
+        dirty = true;
+        if (2 * (entries.size() + 1) > slots.size()) rebuild_slots_locked(4 * (entries.size() + 1));
+
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            if (slots[i] == 0) {
+                entries.push_back({std::string(text), hash, ++use_clock});
+                slots[i] = static_cast<uint32_t>(entries.size());
+                break;
+            }
+            entry& existing = entries[slots[i] - 1];
+            if (existing.hash == hash && existing.text == text) {
+                existing.last_used = ++use_clock;
+                return;
+            }
+        }
+        if (entries.size() > 2 * max_entries) compact_locked();
+    }
+
+    // Keeps the max_entries most recently used entries, in their current order
+    void history_completer::compact_locked() {
+        if (entries.size() <= max_entries) return;
+        std::vector<uint64_t> stamps;
+        stamps.reserve(entries.size());
+        for (const auto& item : entries) stamps.push_back(item.last_used);
+        auto cut = stamps.begin() + static_cast<std::ptrdiff_t>(entries.size() - max_entries);
+        std::nth_element(stamps.begin(), cut, stamps.end());
+        uint64_t oldest_kept = *cut;
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const entry& item) { return item.last_used < oldest_kept; }),
+                      entries.end());
+        rebuild_slots_locked(slots.size());
+    }
+
+    void history_completer::rebuild_slots_locked(size_t capacity) {
+        size_t size = 1024;
+        while (size < capacity) size *= 2;
+        slots.assign(size, 0);
+        size_t mask = size - 1;
+        for (size_t index = 0; index < entries.size(); index++) {
+            size_t i = entries[index].hash & mask;
+            while (slots[i] != 0) i = (i + 1) & mask;
+            slots[i] = static_cast<uint32_t>(index + 1);
+        }
+    }
+
+    // Watches the directories holding the sources, since shells both append to history files
+    // and replace them with a renamed temporary
+    void history_completer::watch_loop() {
+#ifdef __linux__
+        int notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify_fd == -1) return;
+
+        std::unordered_map<int, std::string> directories;
+        for (const auto& state : sources) {
+            std::string directory = directory_of(state.source.path);
+            int descriptor = inotify_add_watch(notify_fd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (descriptor != -1) directories[descriptor] = directory;
+        }
+
+        alignas(struct inotify_event) char buffer[8192];
+        while (!stopping && !directories.empty()) {
+            struct pollfd fds[2] = {{notify_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) <= 0) continue;
+            if (fds[1].revents) break;
+
+            // Many writes to one file are handled by one pass over what was appended
+            std::vector<bool> changed(sources.size(), false);
+            ssize_t n;
+            while ((n = ::read(notify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* at = buffer; at < buffer + n;) {
+                    auto* event = reinterpret_cast<struct inotify_event*>(at);
+                    at += sizeof(struct inotify_event) + event->len;
+                    auto directory = directories.find(event->wd);
+                    if (!event->len || directory == directories.end()) continue;
+                    std::string path = directory->second + "/" + event->name;
+                    for (size_t i = 0; i < sources.size(); i++) {
+                        if (sources[i].source.path == path) changed[i] = true;
+                    }
+                }
+            }
+            for (size_t i = 0; i < sources.size(); i++) {
+                if (changed[i]) catch_up(sources[i]);
+            }
+        }
+        ::close(notify_fd);
+#endif
+    }
+
+    // The first and last 64 bytes read: appending keeps both, while trimming a history to its size
+    // limit or replacing it changes at least one. A file now shorter than offset gives 0.
+    uint64_t history_completer::fingerprint_at(int fd, size_t offset) {
+        char head[64], tail[64];
+        size_t head_size = std::min<size_t>(offset, 64);
+        size_t from = offset > 64 ? offset - 64 : 0;
+        if (read_at(fd, head, head_size, 0) != head_size || read_at(fd, tail, offset - from, from) != offset - from) return 0;
+        uint64_t hash = ollama::fnv1a_64(head, head_size);
+        return ollama::fnv1a_64(tail, offset - from, hash);
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef AUTOCOMPLETE_HPP
+#define AUTOCOMPLETE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace termsage {
+
+    // plain: one entry per line (TermSage's prompt history)
+    // bash: one command per line, "#<epoch>" lines from HISTTIMEFORMAT skipped
+    // zsh: ": <start>:<elapsed>;command" when EXTENDED_HISTORY is set, "\" continues a line, metafied bytes
+    enum class history_format { plain, bash, zsh };
+
+    struct history_source {
+        std::string path;
+        history_format format;
+    };
+
+    // $XDG_STATE_HOME/termsage/history, next to the session logs
+    std::string default_prompt_history_path();
+
+    // $XDG_CACHE_HOME/termsage/history.bin
+    std::string default_history_cache_path();
+
+    // ~/.bash_history, $ZDOTDIR/.zsh_history (or ~/.zsh_history) and TermSage's prompt history
+    std::vector<history_source> default_history_sources();
+
+    // Calls visit(offset) for every '\n' in data, sixteen bytes per compare where SSE2 or NEON exist
+    template <typename Visit>
+    void for_each_newline(const char* data, size_t size, Visit&& visit) {
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+            while (mask) {
+                visit(i + static_cast<size_t>(__builtin_ctz(mask)));
+                mask &= mask - 1;
+            }
+        }
+#elif defined(__ARM_NEON)
+        const uint8x16_t newline = vdupq_n_u8('\n');
+        for (; i + 16 <= size; i += 16) {
+            uint8x16_t equal = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i)), newline);
+            // Narrowing shift packs the compare into four bits per byte
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+            while (mask) {
+                visit(i + static_cast<size_t>(__builtin_ctzll(mask)) / 4);
+                mask &= ~(uint64_t(0xF) << (__builtin_ctzll(mask) & ~3));
+            }
+        }
+#endif
+        while (i < size) {
+            const void* found = memchr(data + i, '\n', size - i);
+            if (!found) break;
+            i = static_cast<size_t>(static_cast<const char*>(found) - data);
+            visit(i++);
+        }
+    }
+
+    // Prompt completion from shell and TermSage history. Entries are deduplicated in a hash set and
+    // ranked by recency. What was read is kept in a compact cache along with how far into each
+    // history file it got, so a start only parses bytes appended since the last run; a file that
+    // was rewritten rather than appended to is read again. While running, inotify on the
+    // history directories feeds appended bytes in as shells write them.
+    class history_completer {
+    public:
+        explicit history_completer(std::vector<history_source> sources = default_history_sources(),
+                                   std::string cache_path = default_history_cache_path(),
+                                   size_t max_entries = 100000);
+        ~history_completer();
+
+        history_completer(const history_completer&) = delete;
+        history_completer& operator=(const history_completer&) = delete;
+
+        // Loads the cache and catches up on every source; saves the cache if anything changed
+        void load();
+
+        // Runs load() on a worker thread that then keeps following the sources
+        void start();
+
+        // Adds a prompt typed in TermSage and appends it to the prompt history file
+        void record(std::string_view prompt);
+
+        // Entries starting with prefix, most recently used first
+        std::vector<std::string> complete(std::string_view prefix, size_t limit = 10) const;
+
+        size_t size() const;
+
+        bool save();
+
+    private:
+        struct source_state {
+            history_source source;
+            uint64_t inode = 0;
+            uint64_t offset = 0;        // Bytes consumed; a partial last entry is left for later
+            uint64_t fingerprint = 0;   // Hash of the bytes read, sampled, to spot rewrites
+        };
+
+        struct entry {
+            std::string text;
+            uint64_t hash;
+            uint64_t last_used;
+        };
+
+        bool load_cache();
+        void catch_up(source_state& state);
+        size_t parse(const char* data, size_t begin, size_t size, history_format format);
+        void take_locked(std::string_view line, history_format format);
+        void insert_locked(std::string_view text);
+        void compact_locked();
+        void rebuild_slots_locked(size_t capacity);
+        void watch_loop();
+
+        static uint64_t fingerprint_at(int fd, size_t offset);
+
+        std::vector<source_state> sources;
+        std::string cache_path;
+        size_t max_entries;
+
+        mutable std::mutex mutex;
+        std::vector<entry> entries;
+        std::vector<uint32_t> slots;     // Open addressing on entry hashes: index + 1, or 0 when free
+        uint64_t use_clock = 0;
+        bool dirty = false;
+
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        int stop_pipe[2] = {-1, -1};
+    };
+}
+
+#endif // AUTOCOMPLETE_HPP
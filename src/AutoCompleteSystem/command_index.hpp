@@ -0,0 +1,894 @@
+#ifndef COMMAND_INDEX_HPP
+#define COMMAND_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <csignal>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+
+#include "../CacheSystem/response_cache.hpp"
+
+namespace termsage {
+
+    constexpr size_t max_flags = 160;
+
+    // What the index knows about one executable
+    struct command_info {
+        std::string name;
+        std::string path;
+        std::string summary;                                      // "list directory contents"
+        std::string synopsis;                                     // "ls [OPTION]... [FILE]..."
+        std::vector<std::pair<std::string, std::string>> flags;   // ("-a, --all", "do not ignore entries starting with .")
+        uint64_t inode = 0;                                       // Of path when indexed
+    };
+
+    // $XDG_CACHE_HOME/termsage/commands.bin, falling back to ~/.cache
+    inline std::string default_command_index_path() {
+        std::string base;
+        if (const char* cache = std::getenv("XDG_CACHE_HOME")) base = cache;
+        else if (const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+        else return "termsage_commands.bin";
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        return base + "/commands.bin";
+    }
+
+    // Reads a man page, gzip-compressed or not, up to limit bytes
+    inline std::string read_man_file(const std::string& path, size_t limit = 256 * 1024) {
+        std::string text;
+        if (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            gzFile file = gzopen(path.c_str(), "rb");
+            if (!file) return text;
+            char buffer[16384];
+            int n;
+            while (text.size() < limit && (n = gzread(file, buffer, sizeof(buffer))) > 0) text.append(buffer, static_cast<size_t>(n));
+            gzclose(file);
+#endif
+            return text;
+        }
+        std::ifstream in(path, std::ios::binary);
+        char buffer[16384];
+        while (text.size() < limit && in.read(buffer, sizeof(buffer)).gcount() > 0) text.append(buffer, static_cast<size_t>(in.gcount()));
+        return text;
+    }
+
+    // Plain text of one roff line: font changes, escapes and comments removed
+    inline std::string roff_plain(std::string_view line) {
+        std::string out;
+        out.reserve(line.size());
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (c != '\\') {
+                out.push_back(c);
+                continue;
+            }
+            if (i + 1 == line.size()) break;  // Continuation onto the next line
+            char e = line[++i];
+            switch (e) {
+            case '-': out.push_back('-'); break;
+            case 'e': case '\\': out.push_back('\\'); break;
+            case ' ': case '~': out.push_back(' '); break;
+            case '"': return out; // Comment
+            case 'f':             // \fB, \f(CW, \f[B]
+                if (i + 1 < line.size() && line[i + 1] == '(') i += 3;
+                else if (i + 1 < line.size() && line[i + 1] == '[') i = std::min(line.find(']', i), line.size() - 1);
+                else i++;
+                break;
+            case '(': {           // \(em and other two-letter glyphs
+                std::string_view glyph = line.substr(i + 1, 2);
+                if (glyph == "em" || glyph == "en" || glyph == "mi" || glyph == "hy") out.push_back('-');
+                else if (glyph == "aq" || glyph == "oq" || glyph == "cq") out.push_back('\'');
+                else if (glyph == "dq" || glyph == "lq" || glyph == "rq") out.push_back('"');
+                else if (glyph == "bu") out.push_back('*');
+                i += 2;
+                break;
+            }
+            case '[': {
+                size_t close = line.find(']', i);
+                std::string_view glyph = line.substr(i + 1, close == std::string_view::npos ? 0 : close - i - 1);
+                if (glyph == "em" || glyph == "en" || glyph == "minus") out.push_back('-');
+                else if (glyph == "aq") out.push_back('\'');
+                i = close == std::string_view::npos ? line.size() : close;
+                break;
+            }
+            case '*':             // String registers
+                if (i + 1 < line.size() && line[i + 1] == '(') i += 3;
+                else if (i + 1 < line.size() && line[i + 1] == '[') i = std::min(line.find(']', i), line.size() - 1);
+                else i++;
+                break;
+            case 's':             // \s-1, \s0
+                if (i + 1 < line.size() && (line[i + 1] == '-' || line[i + 1] == '+')) i++;
+                while (i + 1 < line.size() && std::isdigit(static_cast<unsigned char>(line[i + 1]))) i++;
+                break;
+            default: break;       // \& \| \^ \c and the rest produce nothing
+            }
+        }
+        return out;
+    }
+
+    // Summary, synopsis and option list from man(7) or mdoc(7) source
+    inline void parse_man_page(const std::string& source, command_info& info) {
+        enum class section { other, name, synopsis, options } current = section::other;
+        std::string name_text;
+        bool expect_tag = false;
+        bool description_closed = false;   // A paragraph break ends an option's description
+        std::string tag;
+
+        // Appends with runs of whitespace collapsed, up to limit bytes
+        auto append = [](std::string& to, const std::string& text, size_t limit) {
+            for (char c : text) {
+                if (to.size() >= limit) return;
+                bool space = c == ' ' || c == '\t';
+                if (space && (to.empty() || to.back() == ' ')) continue;
+                to.push_back(space ? ' ' : c);
+            }
+            if (!to.empty() && to.back() != ' ' && to.size() < limit) to.push_back(' ');
+        };
+        auto join_arguments = [](std::string_view args, bool spaced) {
+            std::string out;
+            size_t i = 0;
+            while (i < args.size()) {
+                while (i < args.size() && args[i] == ' ') i++;
+                if (i == args.size()) break;
+                size_t end;
+                if (args[i] == '"') {
+                    end = args.find('"', i + 1);
+                    if (end == std::string_view::npos) end = args.size();
+                    out += roff_plain(args.substr(i + 1, end - i - 1));
+                    i = end + 1;
+                } else {
+                    end = args.find(' ', i);
+                    if (end == std::string_view::npos) end = args.size();
+                    out += roff_plain(args.substr(i, end - i));
+                    i = end;
+                }
+                if (spaced) out.push_back(' ');
+            }
+            while (!out.empty() && out.back() == ' ') out.pop_back();
+            return out;
+        };
+        // mdoc: Fl adds a dash, Op brackets, the rest are words
+        auto mdoc_text = [](std::string_view args) {
+            std::string out;
+            size_t i = 0;
+            int brackets = 0;
+            bool dash = false;
+            while (i < args.size()) {
+                while (i < args.size() && args[i] == ' ') i++;
+                size_t end = args.find(' ', i);
+                if (end == std::string_view::npos) end = args.size();
+                std::string_view word = args.substr(i, end - i);
+                i = end;
+                if (word.empty()) break;
+                if (word == "Fl") { dash = true; continue; }
+                if (word == "Op" || word == "Oo") { out += out.empty() || out.back() == '[' ? "[" : " ["; brackets++; continue; }
+                if (word == "Oc") { if (brackets) { out += "]"; brackets--; } continue; }
+                if (word == "Nm" || word == "Ar" || word == "Ns" || word == "Pa" || word == "Cm" || word == "Ic" || word == "Li" || word == "Xo" || word == "Xc") continue;
+                if (!out.empty() && out.back() != '[') out.push_back(' ');
+                if (dash) out.push_back('-');
+                dash = false;
+                out += roff_plain(word);
+            }
+            if (dash) out += out.empty() ? "-" : " -";
+            while (brackets--) out += "]";
+            return out;
+        };
+
+        size_t start = 0;
+        while (start < source.size() && info.flags.size() < max_flags) {
+            size_t end = source.find('\n', start);
+            if (end == std::string::npos) end = source.size();
+            std::string_view line(source.data() + start, end - start);
+            start = end + 1;
+
+            std::string text;
+            bool is_macro = !line.empty() && (line[0] == '.' || line[0] == '\'');
+            std::string_view macro, args;
+            if (is_macro) {
+                size_t name_end = line.find(' ', 1);
+                macro = line.substr(1, name_end == std::string_view::npos ? std::string_view::npos : name_end - 1);
+                args = name_end == std::string_view::npos ? std::string_view() : line.substr(name_end + 1);
+            }
+
+            if (is_macro && (macro == "SH" || macro == "Sh")) {
+                std::string title = join_arguments(args, true);
+                std::transform(title.begin(), title.end(), title.begin(), [](unsigned char c) { return std::toupper(c); });
+                if (title == "NAME") current = section::name;
+                else if (title == "SYNOPSIS") current = section::synopsis;
+                else if (title.find("OPTION") != std::string::npos || title == "DESCRIPTION") current = section::options;
+                else current = section::other;
+                expect_tag = false;
+                continue;
+            }
+
+            if (is_macro) {
+                if (macro == "Nd") {
+                    info.summary = join_arguments(args, true);
+                    continue;
+                }
+                if (macro == "TP") {
+                    expect_tag = true;
+                    tag.clear();
+                    continue;
+                }
+                if (macro == "IP" || macro == "It") {
+                    // .IP "tag" indent / .It Fl a Ar file
+                    if (macro == "It") tag = mdoc_text(args);
+                    else if (!args.empty() && args[0] == '"') tag = roff_plain(args.substr(1, args.find('"', 1) - 1));
+                    else tag = roff_plain(args.substr(0, args.find(' ')));
+                    expect_tag = false;
+                    if (current == section::options && !tag.empty() && tag[0] == '-') {
+                        info.flags.push_back({tag, ""});
+                        description_closed = false;
+                    }
+                    tag.clear();
+                    continue;
+                }
+                if (macro == "B" || macro == "I" || macro == "SM") text = join_arguments(args, true);
+                else if (macro.size() == 2 && std::strchr("BIR", macro[0]) && std::strchr("BIR", macro[1])) text = join_arguments(args, false);
+                else if (macro == "Nm" || macro == "Fl" || macro == "Op" || macro == "Ar" || macro == "Oo" || macro == "Oc")
+                    text = mdoc_text(std::string(macro) + " " + std::string(args));
+                else {
+                    // Layout requests (PP, br, sp, RS, nf...) carry no text
+                    if (macro == "PP" || macro == "LP" || macro == "P" || macro == "Pp") {
+                        expect_tag = false;
+                        if (!info.flags.empty()) description_closed = true;
+                    }
+                    continue;
+                }
+            } else {
+                text = roff_plain(line);
+            }
+
+            switch (current) {
+            case section::name:
+                append(name_text, text, 400);
+                break;
+            case section::synopsis:
+                if (info.synopsis.size() < 240) append(info.synopsis, text, 240);
+                break;
+            case section::options:
+                if (expect_tag) {
+                    expect_tag = false;
+                    size_t first = text.find_first_not_of(' ');
+                    if (first != std::string::npos && text[first] == '-') {
+                        info.flags.push_back({text.substr(first), ""});
+                        description_closed = false;
+                    }
+                } else if (!info.flags.empty() && !description_closed) {
+                    append(info.flags.back().second, text, 100);
+                }
+                break;
+            case section::other:
+                break;
+            }
+        }
+
+        auto trim_end = [](std::string& text) {
+            while (!text.empty() && text.back() == ' ') text.pop_back();
+        };
+
+        // "ls \- list directory contents"
+        if (info.summary.empty()) {
+            size_t dash = name_text.find(" - ");
+            if (dash != std::string::npos) info.summary = name_text.substr(dash + 3);
+        }
+        trim_end(info.summary);
+        trim_end(info.synopsis);
+        for (auto& flag : info.flags) {
+            auto& description = flag.second;
+            trim_end(description);
+            size_t stop = description.find(". ");
+            if (stop != std::string::npos) description.resize(stop + 1);
+        }
+    }
+
+    // Usage line and option list from `--help` output
+    inline void parse_help_output(const std::string& output, command_info& info) {
+        size_t start = 0;
+        while (start < output.size() && info.flags.size() < max_flags) {
+            size_t end = output.find('\n', start);
+            if (end == std::string::npos) end = output.size();
+            std::string line = output.substr(start, end - start);
+            start = end + 1;
+
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos) continue;
+            std::string lower = line.substr(first, 6);
+            std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+            if (info.synopsis.empty() && lower == "usage:") {
+                info.synopsis = line.substr(line.find_first_not_of(" \t", first + 6) == std::string::npos ? line.size() : line.find_first_not_of(" \t", first + 6));
+                info.synopsis.resize(std::min<size_t>(info.synopsis.size(), 240));
+            } else if (first > 0 && line[first] == '-') {
+                // "  -a, --all      do not ignore entries starting with ."
+                size_t gap = line.find("  ", first);
+                std::string tag = line.substr(first, gap == std::string::npos ? std::string::npos : gap - first);
+                std::string description;
+                if (gap != std::string::npos) {
+                    size_t text = line.find_first_not_of(" \t", gap);
+                    if (text != std::string::npos) description = line.substr(text, 100);
+                }
+                info.flags.push_back({tag, description});
+            } else if (info.summary.empty() && first == 0 && lower != "usage:" && line.size() < 120) {
+                info.summary = line;
+            }
+        }
+    }
+
+    // Index of the executables on $PATH with their man-page summary, synopsis and options,
+    // so prompts can carry a few relevant lines about a command instead of whole man pages.
+    // Built in parallel and kept in one mmap'd file: a 64-byte header, 40-byte records
+    // sorted by name, then a string table; lookups binary-search the mapping in place.
+    // The header records a signature of $PATH and its directories' mtimes; when that no
+    // longer matches, refresh_in_background() rebuilds while the old index keeps serving;
+    // refresh_if_due() repeats that check now and then for a long session.
+    class command_index {
+    public:
+        explicit command_index(std::string path = default_command_index_path()) : path(std::move(path)) {
+            map_file();
+        }
+
+        ~command_index() {
+            stopping = true;
+            wait();
+            std::lock_guard<std::mutex> lock(mutex);
+            // Keep `--help` results for the next run
+            if (data && !helped.empty()) {
+                std::vector<command_info> commands;
+                commands.reserve(count);
+                for (const record* it = records(); it != records() + count; ++it) {
+                    auto overlay = helped.find(std::string(name_of(*it)));
+                    commands.push_back(overlay != helped.end() ? overlay->second : info_of(*it));
+                }
+                save(commands, signature);
+            }
+            unmap();
+        }
+
+        command_index(const command_index&) = delete;
+        command_index& operator=(const command_index&) = delete;
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return count;
+        }
+
+        // False when $PATH or one of its directories changed since the index was built
+        bool is_current() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return data && signature == path_signature();
+        }
+
+        std::optional<command_info> find(std::string_view name) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto overlay = helped.find(std::string(name));
+            if (overlay != helped.end()) return overlay->second;
+            const record* found = lower_bound(name);
+            if (found == records() + count || name_of(*found) != name) return std::nullopt;
+            return info_of(*found);
+        }
+
+        // Command names starting with prefix, in order
+        std::vector<std::string> complete(std::string_view prefix, size_t limit = 10) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<std::string> names;
+            for (const record* it = lower_bound(prefix); it != records() + count && names.size() < limit; ++it) {
+                std::string_view name = name_of(*it);
+                if (name.compare(0, prefix.size(), prefix) != 0) break;
+                names.emplace_back(name);
+            }
+            return names;
+        }
+
+        // Like find(), but a command without a man page is asked for `--help` (at most two
+        // seconds, no stdin); only done for commands the user looks up explicitly, and only
+        // while the path still names the file that was indexed
+        std::optional<command_info> describe(std::string_view name) {
+            auto info = find(name);
+            if (!info || !info->summary.empty() || !info->synopsis.empty() || !info->flags.empty()) return info;
+            struct stat st;
+            if (stat(info->path.c_str(), &st) != 0 || static_cast<uint64_t>(st.st_ino) != info->inode ||
+                !S_ISREG(st.st_mode) || !(st.st_mode & 0111)) return info;
+            parse_help_output(run_help(info->path), *info);
+            std::lock_guard<std::mutex> lock(mutex);
+            helped[info->name] = *info;
+            return info;
+        }
+
+        // A few lines about each command the message mentions, for the system prompt: summary,
+        // synopsis and only the options that appear in the message. Empty when none match.
+        // So much English is also a command name ("as", "ip", "make") that a word only counts
+        // where a command would be written: quoted as code, followed by an option, first on a
+        // command line or after |, ; or && on one. Names like ssh-keygen or python3 always count.
+        std::string prompt_notes(std::string_view message, size_t max_commands = 3) const {
+            auto word_char = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.' || c == '+'; };
+
+            // Options count for the command they follow: in "tar -z ... grep -r", -r is grep's
+            struct mention {
+                command_info info;
+                std::vector<std::string_view> options;
+            };
+            std::vector<mention> mentions;
+            std::set<std::string, std::less<>> seen;
+
+            // Command lines: inside a ``` fence, after a "$ " prompt, or containing a pipe
+            bool in_fence = false, command_line = false, command_position = false;
+            size_t i = 0;
+            while (i < message.size()) {
+                if (i == 0 || message[i - 1] == '\n') {
+                    std::string_view line = message.substr(i, message.find('\n', i) - i);
+                    size_t lead = line.find_first_not_of(" \t");
+                    line = lead == std::string_view::npos ? std::string_view() : line.substr(lead);
+                    if (line.substr(0, 3) == "```") {
+                        in_fence = !in_fence;
+                        command_line = false;
+                    } else {
+                        command_line = in_fence || line.substr(0, 2) == "$ " || line.find('|') != std::string_view::npos;
+                    }
+                    command_position = command_line;
+                }
+                if (!word_char(message[i])) {
+                    char c = message[i++];
+                    if (command_line && (c == '|' || c == ';' || c == '&' || c == '(')) command_position = true;
+                    continue;
+                }
+
+                bool at_command = command_position;
+                command_position = false;
+                size_t begin = i;
+                while (i < message.size() && word_char(message[i])) i++;
+                std::string_view word = message.substr(begin, i - begin);
+                if (word.size() > 1 && word[0] == '-') {
+                    if (!mentions.empty()) mentions.back().options.push_back(word);
+                    continue;
+                }
+                while (!word.empty() && (word.back() == '.' || word.back() == '-')) word.remove_suffix(1);
+                if (word.empty() || seen.count(word) || mentions.size() >= max_commands) continue;
+
+                bool code = begin > 0 && message[begin - 1] == '`' && !(begin >= 3 && message.substr(begin - 3, 3) == "```");
+                size_t next = message.find_first_not_of(' ', i);
+                bool followed_by_option = next != std::string_view::npos && next + 1 < message.size() &&
+                                          message[next] == '-' && word_char(message[next + 1]);
+                bool unlike_english = word.find_first_of("0123456789-_.+") != std::string_view::npos;
+                if (!code && !followed_by_option && !at_command && !unlike_english) continue;
+
+                auto info = find(word);
+                if (!info || (info->summary.empty() && info->synopsis.empty())) continue;
+                seen.insert(std::string(word));
+                mentions.push_back({std::move(*info), {}});
+            }
+
+            std::string notes;
+            for (const auto& [info, options] : mentions) {
+                notes += "- " + info.name;
+                if (!info.summary.empty()) notes += ": " + info.summary;
+                if (!info.synopsis.empty()) notes += "\n  Synopsis: " + info.synopsis;
+                for (const auto& flag : info.flags) {
+                    bool mentioned = std::any_of(options.begin(), options.end(), [&](std::string_view option) {
+                        // "-z" matches "-z, --gzip" but not "-zz"
+                        for (size_t at = flag.first.find(option); at != std::string::npos; at = flag.first.find(option, at + 1)) {
+                            size_t after = at + option.size();
+                            bool starts = at == 0 || !word_char(flag.first[at - 1]);
+                            bool ends = after == flag.first.size() || !word_char(flag.first[after]);
+                            if (starts && ends) return true;
+                        }
+                        return false;
+                    });
+                    if (mentioned) notes += "\n  " + flag.first + (flag.second.empty() ? "" : ": " + flag.second);
+                }
+                notes += "\n";
+            }
+            return notes;
+        }
+
+        // Scans $PATH and the man pages, writes the index and maps it; returns the command count
+        size_t rebuild() {
+            std::vector<command_info> commands = scan_path();
+            std::map<std::string, std::string> pages = scan_man_pages();
+
+            // Man pages are read and parsed on all cores; each worker takes the next command
+            std::atomic<size_t> next{0};
+            unsigned threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < commands.size() && !stopping; i = next++) {
+                        auto page = pages.find(commands[i].name);
+                        if (page == pages.end()) continue;
+                        std::string source = read_man_file(page->second);
+                        // ".so man1/other.1" points at another page
+                        if (source.compare(0, 4, ".so ") == 0) {
+                            std::string target = source.substr(4, source.find_first_of("\r\n") - 4);
+                            std::string root = page->second.substr(0, page->second.rfind('/'));
+                            root = root.substr(0, root.rfind('/'));
+                            source = read_man_file(root + "/" + target);
+                            if (source.empty()) source = read_man_file(root + "/" + target + ".gz");
+                        }
+                        parse_man_page(source, commands[i]);
+                    }
+                });
+            }
+            for (auto& worker : workers) worker.join();
+            if (stopping) return 0;
+
+            // `--help` results gathered earlier survive as long as the command does
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& command : commands) {
+                    if (!command.summary.empty() || !command.synopsis.empty()) continue;
+                    auto overlay = helped.find(command.name);
+                    if (overlay != helped.end() && overlay->second.path == command.path &&
+                        overlay->second.inode == command.inode) command = overlay->second;
+                }
+            }
+
+            save(commands, path_signature());
+            std::lock_guard<std::mutex> lock(mutex);
+            unmap();
+            map_file();
+            helped.clear();
+            return commands.size();
+        }
+
+        // Rebuilds on a worker thread if the index is missing or $PATH changed. Never blocks:
+        // while a rebuild runs the old index keeps serving and the check is skipped.
+        void refresh_in_background() {
+            last_check = std::chrono::steady_clock::now();
+            if (rebuilding) return;
+            wait();
+            if (is_current()) return;
+            rebuilding = true;
+            worker = std::thread([this]() {
+                rebuild();
+                rebuilding = false;
+            });
+        }
+
+        // refresh_in_background() at most once per interval; cheap enough to call on every prompt
+        void refresh_if_due(std::chrono::seconds interval = std::chrono::seconds(30)) {
+            if (std::chrono::steady_clock::now() - last_check >= interval) refresh_in_background();
+        }
+
+        void wait() {
+            if (worker.joinable()) worker.join();
+        }
+
+    private:
+        struct header {
+            char magic[8];
+            uint64_t count;
+            uint64_t signature;
+            uint64_t strings_offset;
+            uint64_t strings_size;
+            uint64_t checksum;
+            uint64_t reserved[2];
+        };
+
+        // Offsets and lengths into the string table; flags are "tag\tdescription\n" lines
+        struct record {
+            uint64_t inode;
+            uint32_t name_offset;
+            uint16_t name_length;
+            uint16_t path_length;
+            uint32_t path_offset;
+            uint32_t summary_offset;
+            uint16_t summary_length;
+            uint16_t synopsis_length;
+            uint32_t synopsis_offset;
+            uint32_t flags_offset;
+            uint32_t flags_length;
+        };
+        static_assert(sizeof(header) == 64 && sizeof(record) == 40, "index layout");
+
+        static constexpr char magic[8] = {'T', 'S', 'C', 'M', 'D', 'X', '0', '2'};
+
+        static std::vector<std::string> path_directories() {
+            std::vector<std::string> dirs;
+            const char* value = std::getenv("PATH");
+            std::string_view list = value ? value : "/usr/local/bin:/usr/bin:/bin";
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = std::min(list.find(':', start), list.size());
+                std::string dir(list.substr(start, end - start));
+                if (!dir.empty() && std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) dirs.push_back(dir);
+                start = end + 1;
+            }
+            return dirs;
+        }
+
+        // $PATH and the mtime of each of its directories; installing or removing a program changes it
+        static uint64_t path_signature() {
+            uint64_t hash = ollama::fnv1a_64(nullptr, 0);
+            for (const auto& dir : path_directories()) {
+                struct stat st;
+                int64_t stamp[2] = {0, 0};
+                if (stat(dir.c_str(), &st) == 0) {
+                    stamp[0] = static_cast<int64_t>(st.st_mtim.tv_sec);
+                    stamp[1] = static_cast<int64_t>(st.st_mtim.tv_nsec);
+                }
+                hash = ollama::fnv1a_64(dir.data(), dir.size() + 1, hash);
+                hash = ollama::fnv1a_64(reinterpret_cast<const char*>(stamp), sizeof(stamp), hash);
+            }
+            return hash;
+        }
+
+        // First executable of each name along $PATH, as the shell would find it
+        static std::vector<command_info> scan_path() {
+            std::vector<command_info> commands;
+            std::set<std::string> seen;
+            for (const auto& dir : path_directories()) {
+                DIR* handle = opendir(dir.c_str());
+                if (!handle) continue;
+                while (struct dirent* entry = readdir(handle)) {
+                    std::string name = entry->d_name;
+                    if (name.empty() || name[0] == '.' || name.size() > UINT16_MAX || seen.count(name)) continue;
+                    std::string full = dir + "/" + name;
+                    struct stat st;
+                    if (stat(full.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || !(st.st_mode & 0111)) continue;
+                    seen.insert(name);
+                    command_info info;
+                    info.name = std::move(name);
+                    info.path = std::move(full);
+                    info.inode = static_cast<uint64_t>(st.st_ino);
+                    commands.push_back(std::move(info));
+                }
+                closedir(handle);
+            }
+            std::sort(commands.begin(), commands.end(), [](const command_info& a, const command_info& b) { return a.name < b.name; });
+            return commands;
+        }
+
+        // Section 1, 8 and 6 pages by command name, from $MANPATH or the share/man next to each $PATH entry
+        static std::map<std::string, std::string> scan_man_pages() {
+            std::vector<std::string> roots;
+            if (const char* manpath = std::getenv("MANPATH"); manpath && *manpath) {
+                std::string_view list = manpath;
+                size_t start = 0;
+                while (start <= list.size()) {
+                    size_t end = std::min(list.find(':', start), list.size());
+                    if (end > start) roots.emplace_back(list.substr(start, end - start));
+                    start = end + 1;
+                }
+            }
+            for (const auto& dir : path_directories()) {
+                std::string parent = dir.substr(0, dir.rfind('/'));
+                roots.push_back(parent + "/share/man");
+                roots.push_back(parent + "/man");
+            }
+            roots.push_back("/usr/share/man");
+            roots.push_back("/usr/local/share/man");
+
+            std::map<std::string, std::string> pages;
+            std::set<std::string> visited;
+            for (const auto& root : roots) {
+                char resolved[PATH_MAX];
+                if (!realpath(root.c_str(), resolved) || !visited.insert(resolved).second) continue;
+                for (const char* section : {"man1", "man8", "man6"}) {
+                    std::string dir = std::string(resolved) + "/" + section;
+                    DIR* handle = opendir(dir.c_str());
+                    if (!handle) continue;
+                    while (struct dirent* entry = readdir(handle)) {
+                        // "ls.1.gz", "openssl-req.1ssl.gz" -> name before ".<section digit>"
+                        std::string file = entry->d_name;
+                        std::string marker = std::string(".") + section[3];
+                        size_t dot = file.rfind(marker);
+                        if (dot == std::string::npos || dot == 0) continue;
+                        pages.emplace(file.substr(0, dot), dir + "/" + file);
+                    }
+                    closedir(handle);
+                }
+            }
+            return pages;
+        }
+
+        // Output of `path --help` (stdout and stderr), capped at 64 KB and two seconds
+        static std::string run_help(const std::string& program) {
+            int out[2];
+            if (pipe(out) != 0) return std::string();
+            pid_t pid = fork();
+            if (pid == -1) {
+                ::close(out[0]);
+                ::close(out[1]);
+                return std::string();
+            }
+            if (pid == 0) {
+                int null = ::open("/dev/null", O_RDONLY);
+                if (null != -1) dup2(null, STDIN_FILENO);
+                dup2(out[1], STDOUT_FILENO);
+                dup2(out[1], STDERR_FILENO);
+                ::close(out[0]);
+                setsid(); // No controlling terminal to prompt on
+                execl(program.c_str(), program.c_str(), "--help", static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            ::close(out[1]);
+
+            std::string output;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (output.size() < 64 * 1024) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0) break;
+                struct pollfd pfd = {out[0], POLLIN, 0};
+                if (poll(&pfd, 1, static_cast<int>(left)) <= 0) break;
+                char buffer[4096];
+                ssize_t n = ::read(out[0], buffer, sizeof(buffer));
+                if (n <= 0) break;
+                output.append(buffer, static_cast<size_t>(n));
+            }
+            ::close(out[0]);
+            // The child leads its own session, so this also reaches anything it started; the
+            // plain kill covers a child stopped before it got to setsid()
+            if (kill(-pid, SIGKILL) != 0) kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            return output;
+        }
+
+        // Layout: header, records sorted by name, string table. Written to a temporary file and
+        // renamed so a reader's mapping is never half written.
+        bool save(const std::vector<command_info>& commands, uint64_t path_state) const {
+            std::vector<record> table;
+            table.reserve(commands.size());
+            std::string strings;
+            auto put = [&strings](std::string_view text, size_t limit, uint32_t& offset) {
+                offset = static_cast<uint32_t>(strings.size());
+                text = text.substr(0, limit);
+                strings.append(text.data(), text.size());
+                return text.size();
+            };
+            for (const auto& command : commands) {
+                record entry{};
+                entry.inode = command.inode;
+                entry.name_length = static_cast<uint16_t>(put(command.name, UINT16_MAX, entry.name_offset));
+                entry.path_length = static_cast<uint16_t>(put(command.path, UINT16_MAX, entry.path_offset));
+                entry.summary_length = static_cast<uint16_t>(put(command.summary, 400, entry.summary_offset));
+                entry.synopsis_length = static_cast<uint16_t>(put(command.synopsis, 400, entry.synopsis_offset));
+                std::string flags;
+                for (const auto& flag : command.flags) flags += flag.first + "\t" + flag.second + "\n";
+                entry.flags_length = static_cast<uint32_t>(put(flags, flags.size(), entry.flags_offset));
+                table.push_back(entry);
+            }
+
+            header head{};
+            memcpy(head.magic, magic, sizeof(magic));
+            head.count = table.size();
+            head.signature = path_state;
+            head.strings_offset = sizeof(header) + table.size() * sizeof(record);
+            head.strings_size = strings.size();
+            uint64_t checksum = ollama::fnv1a_64(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(record));
+            head.checksum = ollama::fnv1a_64(strings.data(), strings.size(), checksum);
+
+            std::string temporary = path + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                if (!out) return false;
+                out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+                out.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(record)));
+                out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+                if (!out) return false;
+            }
+            return std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+
+        // Maps the index if it is intact. The whole file is checksummed on every open, which
+        // happens once per process and after each rebuild
+        bool map_file() {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(header)) {
+                ::close(fd);
+                return false;
+            }
+            size_t size = static_cast<size_t>(st.st_size);
+            void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED) return false;
+
+            header head;
+            memcpy(&head, base, sizeof(head));
+            const char* bytes = static_cast<const char*>(base);
+            bool valid = memcmp(head.magic, magic, sizeof(magic)) == 0 &&
+                         head.strings_offset == sizeof(header) + head.count * sizeof(record) &&
+                         head.strings_offset + head.strings_size == size;
+            if (valid) {
+                uint64_t checksum = ollama::fnv1a_64(bytes + sizeof(header), head.count * sizeof(record));
+                valid = ollama::fnv1a_64(bytes + head.strings_offset, head.strings_size, checksum) == head.checksum;
+            }
+            if (!valid) {
+                munmap(base, size);
+                return false;
+            }
+            data = bytes;
+            mapped_size = size;
+            count = head.count;
+            signature = head.signature;
+            strings = bytes + head.strings_offset;
+            return true;
+        }
+
+        void unmap() {
+            if (data) munmap(const_cast<char*>(data), mapped_size);
+            data = nullptr;
+            mapped_size = 0;
+            count = 0;
+            signature = 0;
+            strings = nullptr;
+        }
+
+        const record* records() const {
+            return data ? reinterpret_cast<const record*>(data + sizeof(header)) : nullptr;
+        }
+
+        std::string_view name_of(const record& entry) const { return std::string_view(strings + entry.name_offset, entry.name_length); }
+
+        const record* lower_bound(std::string_view name) const {
+            return std::lower_bound(records(), records() + count, name,
+                                    [this](const record& entry, std::string_view key) { return name_of(entry) < key; });
+        }
+
+        command_info info_of(const record& entry) const {
+            command_info info;
+            info.name = std::string(name_of(entry));
+            info.inode = entry.inode;
+            info.path.assign(strings + entry.path_offset, entry.path_length);
+            info.summary.assign(strings + entry.summary_offset, entry.summary_length);
+            info.synopsis.assign(strings + entry.synopsis_offset, entry.synopsis_length);
+            std::string_view flags(strings + entry.flags_offset, entry.flags_length);
+            size_t start = 0, end;
+            while ((end = flags.find('\n', start)) != std::string_view::npos) {
+                std::string_view line = flags.substr(start, end - start);
+                size_t tab = line.find('\t');
+                info.flags.emplace_back(std::string(line.substr(0, tab)), tab == std::string_view::npos ? std::string() : std::string(line.substr(tab + 1)));
+                start = end + 1;
+            }
+            return info;
+        }
+
+        std::string path;
+        mutable std::mutex mutex;
+        const char* data = nullptr;
+        size_t mapped_size = 0;
+        size_t count = 0;
+        uint64_t signature = 0;
+        const char* strings = nullptr;
+        std::map<std::string, command_info> helped;   // `--help` results not yet in the file
+
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        std::atomic<bool> rebuilding{false};
+        std::chrono::steady_clock::time_point last_check;   // Only touched by the thread that calls refresh
+    };
+}
+
+#endif // COMMAND_INDEX_HPP
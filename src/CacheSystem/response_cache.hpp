@@ -0,0 +1,317 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../ExternalDependencies/nlohmann/json.hpp"
+
+namespace ollama {
+    using json = nlohmann::json;
+
+    // 128-bit request fingerprint made of two independently seeded FNV-1a hashes
+    struct cache_key {
+        uint64_t hi = 0;
+        uint64_t lo = 0;
+
+        bool operator==(const cache_key& other) const {
+            return hi == other.hi && lo == other.lo;
+        }
+    };
+
+    struct cache_key_hash {
+        size_t operator()(const cache_key& key) const {
+            return static_cast<size_t>(key.hi ^ (key.lo * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    inline uint64_t fnv1a_64(const char* data, size_t len, uint64_t seed = 0xcbf29ce484222325ULL) {
+        uint64_t hash = seed;
+        for (size_t i = 0; i < len; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // $XDG_CACHE_HOME/termsage/responses.bin, falling back to ~/.cache
+    inline std::string default_response_cache_path() {
+        std::string base;
+        if (const char* cache = std::getenv("XDG_CACHE_HOME")) base = cache;
+        else if (const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+        else return "termsage_responses.bin";
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        return base + "/responses.bin";
+    }
+
+    inline cache_key make_cache_key(const std::string& canonical) {
+        cache_key key;
+        key.hi = fnv1a_64(canonical.data(), canonical.size());
+        key.lo = fnv1a_64(canonical.data(), canonical.size(), 0x84222325cbf29ce4ULL);
+        return key;
+    }
+
+    // Exact-match cache for deterministic chat requests.
+    // Entries are raw /api/chat response bodies held in an in-memory LRU and,
+    // when a path is given, in an append-only file that is mmap'd on open.
+    // Several processes share the file: appends and the open-time scan hold an
+    // flock, and every record read from disk is checked against its key and checksum.
+    class response_cache {
+    public:
+        explicit response_cache(size_t capacity = 256, const std::string& path = "")
+            : capacity(capacity) {
+            if (!path.empty()) open_store(path);
+        }
+
+        ~response_cache() {
+            if (mapped) munmap(mapped, mapped_size);
+            if (fd != -1) close(fd);
+        }
+
+        response_cache(const response_cache&) = delete;
+        response_cache& operator=(const response_cache&) = delete;
+
+        // Output only reproduces when sampling is greedy and the seed is pinned
+        static bool is_deterministic(const json& options) {
+            if (!options.is_object()) return false;
+            const json& params = options.contains("options") && options["options"].is_object()
+                ? options["options"] : options;
+            return params.contains("temperature") && params["temperature"].is_number() &&
+                   params["temperature"].get<double>() == 0.0 && params.contains("seed");
+        }
+
+        // nlohmann::json keeps object keys sorted, so dump() is already canonical
+        static cache_key key_for(const std::string& model_digest, const json& messages, const json& options) {
+            json canonical;
+            canonical["model"] = model_digest;
+            canonical["messages"] = messages;
+            canonical["options"] = options;
+            if (canonical["options"].is_object()) canonical["options"].erase("stream");
+            return make_cache_key(canonical.dump());
+        }
+
+        // Same key as key_for, hashed from a history's cached per-message JSON (for_each_serialized)
+        // so the history is never copied or dumped again
+        template <typename History>
+        static cache_key key_for_history(const std::string& model_digest, const History& history, const json& options) {
+            json fields;
+            fields["model"] = model_digest;
+            fields["options"] = options;
+            if (fields["options"].is_object()) fields["options"].erase("stream");
+            std::string rest = fields.dump();
+
+            // "messages" sorts before "model" and "options", so it leads the canonical object
+            cache_key key = make_cache_key("");
+            auto append = [&key](const std::string& text) {
+                key.hi = fnv1a_64(text.data(), text.size(), key.hi);
+                key.lo = fnv1a_64(text.data(), text.size(), key.lo);
+            };
+            append("{\"messages\":[");
+            bool first = true;
+            history.for_each_serialized([&](const std::string& message) {
+                if (!first) append(",");
+                first = false;
+                append(message);
+            });
+            append("]," + rest.substr(1));
+            return key;
+        }
+
+        std::optional<std::string> get(const cache_key& key) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                lru.splice(lru.begin(), lru, it->second);
+                hits++;
+                return it->second->second;
+            }
+
+            auto disk = index.find(key);
+            if (disk != index.end()) {
+                if (auto body = read_record(key, disk->second)) {
+                    insert(key, *body);
+                    hits++;
+                    return body;
+                }
+                index.erase(disk);
+            }
+
+            misses++;
+            return std::nullopt;
+        }
+
+        void put(const cache_key& key, const std::string& body) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (entries.count(key)) return;
+            insert(key, body);
+            if (fd != -1 && !index.count(key)) append_record(key, body);
+        }
+
+        size_t hit_count() const { return hits; }
+        size_t miss_count() const { return misses; }
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries.size();
+        }
+
+    private:
+        // On-disk record: hi, lo, length, checksum, payload
+        struct record_header {
+            uint64_t hi;
+            uint64_t lo;
+            uint32_t length;
+            uint32_t checksum;
+        };
+
+        static constexpr char magic[8] = {'T', 'S', 'R', 'C', 'A', 'C', 'H', '1'};
+
+        void insert(const cache_key& key, const std::string& body) {
+            lru.emplace_front(key, body);
+            entries[key] = lru.begin();
+            while (entries.size() > capacity) {
+                entries.erase(lru.back().first);
+                lru.pop_back();
+            }
+        }
+
+        void open_store(const std::string& path) {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd == -1) return;
+
+            // Exclusive while scanning: appends also hold it, so a torn tail can only be a crash leftover
+            if (flock(fd, LOCK_EX) != 0) {
+                close(fd);
+                fd = -1;
+                return;
+            }
+            scan_store();
+            if (fd != -1) flock(fd, LOCK_UN);
+        }
+
+        void scan_store() {
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                fd = -1;
+                return;
+            }
+
+            if (st.st_size == 0) {
+                if (::write(fd, magic, sizeof(magic)) != static_cast<ssize_t>(sizeof(magic))) {
+                    close(fd);
+                    fd = -1;
+                }
+                return;
+            }
+
+            size_t file_size = static_cast<size_t>(st.st_size);
+            void* base = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                close(fd);
+                fd = -1;
+                return;
+            }
+            mapped = static_cast<char*>(base);
+            mapped_size = file_size;
+
+            if (file_size < sizeof(magic) || memcmp(mapped, magic, sizeof(magic)) != 0) {
+                // Not ours; leave it alone and run memory-only
+                munmap(mapped, mapped_size);
+                mapped = nullptr;
+                close(fd);
+                fd = -1;
+                return;
+            }
+
+            // Index every intact record; a torn tail from a crash is cut off
+            size_t offset = sizeof(magic);
+            while (offset + sizeof(record_header) <= mapped_size) {
+                record_header header;
+                memcpy(&header, mapped + offset, sizeof(header));
+                size_t payload = offset + sizeof(header);
+                if (header.length > mapped_size - payload) break;
+                if (fnv1a_32(mapped + payload, header.length) != header.checksum) break;
+                index[cache_key{header.hi, header.lo}] = offset;
+                offset = payload + header.length;
+            }
+            if (offset != file_size && ftruncate(fd, static_cast<off_t>(offset)) == 0) mapped_size = offset;
+        }
+
+        // The record at offset, only if it is intact and really belongs to key
+        std::optional<std::string> read_record(const cache_key& key, size_t offset) {
+            record_header header;
+            if (mapped && offset + sizeof(header) <= mapped_size) {
+                memcpy(&header, mapped + offset, sizeof(header));
+            } else if (fd == -1 || pread(fd, &header, sizeof(header), static_cast<off_t>(offset)) != static_cast<ssize_t>(sizeof(header))) {
+                return std::nullopt;
+            }
+            if (header.hi != key.hi || header.lo != key.lo) return std::nullopt;
+
+            size_t payload = offset + sizeof(header);
+            std::string body;
+            if (mapped && header.length <= mapped_size && payload <= mapped_size - header.length) {
+                body.assign(mapped + payload, header.length);
+            } else {
+                body.assign(header.length, '\0');
+                if (fd == -1 || pread(fd, body.data(), header.length, static_cast<off_t>(payload)) != static_cast<ssize_t>(header.length))
+                    return std::nullopt;
+            }
+            if (fnv1a_32(body.data(), body.size()) != header.checksum) return std::nullopt;
+            return body;
+        }
+
+        // Other processes append too, so the record's offset is only known under the lock
+        void append_record(const cache_key& key, const std::string& body) {
+            record_header header{key.hi, key.lo, static_cast<uint32_t>(body.size()), fnv1a_32(body.data(), body.size())};
+            std::string record(reinterpret_cast<const char*>(&header), sizeof(header));
+            record += body;
+
+            if (flock(fd, LOCK_EX) != 0) return;
+            off_t offset = lseek(fd, 0, SEEK_END);
+            bool written = offset != -1 && ::write(fd, record.data(), record.size()) == static_cast<ssize_t>(record.size());
+            flock(fd, LOCK_UN);
+            if (written) index[key] = static_cast<size_t>(offset);
+        }
+
+        static uint32_t fnv1a_32(const char* data, size_t len) {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < len; i++) {
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        size_t capacity;
+        std::list<std::pair<cache_key, std::string>> lru;
+        std::unordered_map<cache_key, std::list<std::pair<cache_key, std::string>>::iterator, cache_key_hash> entries;
+        std::unordered_map<cache_key, size_t, cache_key_hash> index;   // Record offsets in the file
+
+        int fd = -1;
+        char* mapped = nullptr;
+        size_t mapped_size = 0;
+
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+        mutable std::mutex mutex;
+    };
+}
+
+#endif // RESPONSE_CACHE_HPP
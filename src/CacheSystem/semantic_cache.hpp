@@ -0,0 +1,259 @@
+#ifndef SEMANTIC_CACHE_HPP
+#define SEMANTIC_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+
+#include "./response_cache.hpp"
+
+namespace ollama {
+
+    struct semantic_cache_options {
+        std::string embedding_model = "nomic-embed-text";
+        float similarity_threshold = 0.92f;      // Cosine similarity needed for a hit
+        size_t max_entries_per_model = 1024;
+        std::chrono::seconds max_age = std::chrono::hours(24);
+        bool match_context = true;               // Earlier turns must be identical
+        bool match_numbers = true;               // "2+2" and "2+3" embed alike but must not share answers
+        double max_length_ratio = 2.0;           // Reject candidates of very different length
+    };
+
+    struct semantic_cache_stats {
+        size_t lookups = 0;
+        size_t hits = 0;
+        size_t rejected = 0;     // Above threshold but refused by a false-hit guard
+        size_t false_hits = 0;   // Reported by the caller after a hit
+        size_t stale = 0;        // Dropped for age or a changed model digest
+
+        double hit_rate() const {
+            return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+        }
+    };
+
+    inline void to_json(json& j, const semantic_cache_stats& s) {
+        j = {{"lookups", s.lookups}, {"hits", s.hits}, {"rejected", s.rejected}, {"false_hits", s.false_hits}, {"stale", s.stale}};
+    }
+
+    inline void from_json(const json& j, semantic_cache_stats& s) {
+        s.lookups = j.value("lookups", size_t(0));
+        s.hits = j.value("hits", size_t(0));
+        s.rejected = j.value("rejected", size_t(0));
+        s.false_hits = j.value("false_hits", size_t(0));
+        s.stale = j.value("stale", size_t(0));
+    }
+
+    // Opt-in cache that answers paraphrases of earlier prompts.
+    // Prompts are embedded via /api/embed; each model keeps a flat index of
+    // unit vectors scanned with a dot product, which stays well under a
+    // millisecond at the default entry limit.
+    class semantic_cache {
+    public:
+        explicit semantic_cache(semantic_cache_options options = semantic_cache_options())
+            : options(std::move(options)) {}
+
+        const semantic_cache_options& config() const { return options; }
+
+        std::optional<std::string> lookup(const std::string& model, const std::string& digest, uint64_t context,
+                                          const std::string& prompt, std::vector<float> embedding) {
+            std::lock_guard<std::mutex> lock(mutex);
+            model_index& index = models[model];
+            index.stats.lookups++;
+            if (!normalize(embedding)) return std::nullopt;
+
+            expire(index, digest);
+            if (index.dimensions != 0 && index.dimensions != embedding.size()) return std::nullopt;
+
+            size_t best = npos;
+            float best_score = options.similarity_threshold;
+            for (size_t i = 0; i < index.entries.size(); i++) {
+                const float* vec = index.vectors.data() + i * index.dimensions;
+                float score = 0.0f;
+                for (size_t d = 0; d < index.dimensions; d++) score += vec[d] * embedding[d];
+                if (score < best_score) continue;
+
+                if (!passes_guards(index.entries[i], context, prompt)) {
+                    index.stats.rejected++;
+                    continue;
+                }
+                best = i;
+                best_score = score;
+            }
+
+            if (best == npos) return std::nullopt;
+            index.stats.hits++;
+            index.served.emplace_back(prompt_hash(prompt), index.entries[best].id);
+            if (index.served.size() > max_served) index.served.pop_front();
+            return index.entries[best].body;
+        }
+
+        void insert(const std::string& model, const std::string& digest, uint64_t context,
+                    const std::string& prompt, std::vector<float> embedding, const std::string& body) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!normalize(embedding)) return;
+
+            model_index& index = models[model];
+            expire(index, digest);
+            if (index.entries.empty()) index.dimensions = embedding.size();
+            if (index.dimensions != embedding.size()) return;
+
+            if (index.entries.size() >= options.max_entries_per_model) remove(index, 0);
+
+            entry e;
+            e.id = next_id++;
+            e.context = context;
+            e.prompt_length = prompt.size();
+            e.numbers = extract_numbers(prompt);
+            e.digest = digest;
+            e.created = std::chrono::steady_clock::now();
+            e.body = body;
+            index.entries.push_back(std::move(e));
+            index.vectors.insert(index.vectors.end(), embedding.begin(), embedding.end());
+        }
+
+        // Drops the entry that was served for this prompt so it cannot hit again; false when
+        // the prompt was not answered from the cache among the last max_served hits
+        bool report_false_hit(const std::string& model, const std::string& prompt) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = models.find(model);
+            if (found == models.end()) return false;
+
+            model_index& index = found->second;
+            uint64_t hash = prompt_hash(prompt);
+            auto served = std::find_if(index.served.rbegin(), index.served.rend(),
+                                       [&](const std::pair<uint64_t, uint64_t>& hit) { return hit.first == hash; });
+            if (served == index.served.rend()) return false;
+
+            uint64_t id = served->second;
+            for (size_t i = 0; i < index.entries.size(); i++) {
+                if (index.entries[i].id == id) {
+                    remove(index, i);
+                    break;
+                }
+            }
+            index.served.erase(std::next(served).base());
+            index.stats.false_hits++;
+            return true;
+        }
+
+        semantic_cache_stats stats(const std::string& model) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = models.find(model);
+            return found == models.end() ? semantic_cache_stats() : found->second.stats;
+        }
+
+        // Hash of every message but the last, so a paraphrase only hits in the same conversation state
+        static uint64_t context_hash(const std::vector<json>& messages) {
+            if (messages.size() <= 1) return 0;
+            std::string prefix = json(std::vector<json>(messages.begin(), messages.end() - 1)).dump();
+            return fnv1a_64(prefix.data(), prefix.size());
+        }
+
+        // Same hash for a history exposing size() and its cached per-message JSON through for_each_serialized
+        template <typename History>
+        static uint64_t context_hash(const History& history) {
+            size_t count = history.size();
+            if (count <= 1) return 0;
+            uint64_t hash = fnv1a_64("[", 1);
+            size_t seen = 0;
+            history.for_each_serialized([&](const std::string& message) {
+                if (++seen == count) return;
+                if (seen > 1) hash = fnv1a_64(",", 1, hash);
+                hash = fnv1a_64(message.data(), message.size(), hash);
+            });
+            return fnv1a_64("]", 1, hash);
+        }
+
+    private:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        static constexpr size_t max_served = 256;   // Recent hits that can still be reported as false
+
+        struct entry {
+            uint64_t id = 0;
+            uint64_t context = 0;
+            size_t prompt_length = 0;
+            std::string numbers;
+            std::string digest;
+            std::chrono::steady_clock::time_point created;
+            std::string body;
+        };
+
+        struct model_index {
+            size_t dimensions = 0;
+            std::vector<entry> entries;
+            std::vector<float> vectors;                    // entries.size() * dimensions, row-major
+            std::deque<std::pair<uint64_t, uint64_t>> served; // (prompt hash, entry id) of recent hits, oldest first
+            semantic_cache_stats stats;
+        };
+
+        bool passes_guards(const entry& e, uint64_t context, const std::string& prompt) const {
+            if (options.match_context && e.context != context) return false;
+
+            double shorter = static_cast<double>(std::min(e.prompt_length, prompt.size()));
+            double longer = static_cast<double>(std::max(e.prompt_length, prompt.size()));
+            if (shorter == 0 || longer / shorter > options.max_length_ratio) return false;
+
+            if (options.match_numbers && e.numbers != extract_numbers(prompt)) return false;
+            return true;
+        }
+
+        // Entries from an older digest of the model, or past max_age, are dropped
+        void expire(model_index& index, const std::string& digest) {
+            auto now = std::chrono::steady_clock::now();
+            for (size_t i = index.entries.size(); i-- > 0;) {
+                const entry& e = index.entries[i];
+                if (e.digest != digest || now - e.created > options.max_age) {
+                    remove(index, i);
+                    index.stats.stale++;
+                }
+            }
+        }
+
+        static void remove(model_index& index, size_t i) {
+            index.entries.erase(index.entries.begin() + static_cast<std::ptrdiff_t>(i));
+            auto first = index.vectors.begin() + static_cast<std::ptrdiff_t>(i * index.dimensions);
+            index.vectors.erase(first, first + static_cast<std::ptrdiff_t>(index.dimensions));
+        }
+
+        static bool normalize(std::vector<float>& v) {
+            double norm = 0.0;
+            for (float x : v) norm += static_cast<double>(x) * x;
+            if (norm == 0.0) return false;
+            float scale = static_cast<float>(1.0 / std::sqrt(norm));
+            for (float& x : v) x *= scale;
+            return true;
+        }
+
+        static std::string extract_numbers(const std::string& text) {
+            std::string numbers;
+            for (size_t i = 0; i < text.size(); i++) {
+                if (std::isdigit(static_cast<unsigned char>(text[i]))) {
+                    numbers += text[i];
+                } else if (!numbers.empty() && numbers.back() != ' ') {
+                    numbers += ' ';
+                }
+            }
+            return numbers;
+        }
+
+        static uint64_t prompt_hash(const std::string& prompt) {
+            return fnv1a_64(prompt.data(), prompt.size());
+        }
+
+        semantic_cache_options options;
+        std::map<std::string, model_index> models;
+        uint64_t next_id = 1;
+        mutable std::mutex mutex;
+    };
+}
+
+#endif // SEMANTIC_CACHE_HPP
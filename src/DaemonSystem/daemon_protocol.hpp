@@ -0,0 +1,234 @@
+#ifndef DAEMON_PROTOCOL_HPP
+#define DAEMON_PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+#include "../NetworkSystem/request_scheduler.hpp"
+
+// termsaged speaks newline-delimited JSON over a Unix domain socket.
+//
+//   request:  {"id": 1, "op": "chat", "model": "...", "messages": [...], "options": {...}, "priority": "interactive"}
+//             {"id": 2, "op": "embed", "model": "...", "input": ...}
+//             {"id": 3, "op": "list_models"}
+//             {"id": 4, "op": "false_hit", "model": "...", "prompt": "..."}   drops a bad semantic-cache answer
+//             {"id": 5, "op": "cache_stats", "model": "..."}
+//             {"id": 1, "op": "cancel"}   stops request 1
+//   replies:  {"id": 1, "data": {...}}   zero or more, one per streamed Ollama response
+//             {"id": 1, "done": true}    or {"id": 1, "error": "..."}
+namespace termsage {
+    using json = nlohmann::json;
+
+    inline std::string default_daemon_socket_path() {
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR")) return std::string(runtime) + "/termsaged.sock";
+        return "/tmp/termsaged-" + std::to_string(getuid()) + ".sock";
+    }
+
+    inline bool write_line(int fd, const std::string& line) {
+        std::string framed = line + "\n";
+        size_t sent = 0;
+        while (sent < framed.size()) {
+            ssize_t n = ::send(fd, framed.data() + sent, framed.size() - sent, MSG_NOSIGNAL);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Splits a byte stream into lines
+    class line_reader {
+    public:
+        explicit line_reader(int fd) : fd(fd) {}
+
+        bool next(std::string& line) {
+            while (true) {
+                size_t end = buffer.find('\n', scanned);
+                if (end != std::string::npos) {
+                    line = buffer.substr(0, end);
+                    buffer.erase(0, end + 1);
+                    scanned = 0;
+                    return true;
+                }
+                scanned = buffer.size();
+
+                char chunk[4096];
+                ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                buffer.append(chunk, static_cast<size_t>(n));
+            }
+        }
+
+        // True once a line is buffered or the socket has data, EOF or an error; false on timeout
+        bool wait(int timeout_ms) {
+            if (buffer.find('\n', scanned) != std::string::npos) return true;
+            struct pollfd pfd = {fd, POLLIN, 0};
+            return poll(&pfd, 1, timeout_ms) != 0;
+        }
+
+    private:
+        int fd;
+        std::string buffer;
+        size_t scanned = 0;
+    };
+
+    // Thin client used by TermSage when a daemon is running; one request at a time
+    class daemon_client {
+    public:
+        explicit daemon_client(std::string path = default_daemon_socket_path()) : path(std::move(path)) {}
+        ~daemon_client() { disconnect(); }
+
+        daemon_client(const daemon_client&) = delete;
+        daemon_client& operator=(const daemon_client&) = delete;
+
+        bool connect() {
+            disconnect();
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path)) return false;
+            memcpy(addr.sun_path, path.c_str(), path.size());
+
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd == -1) return false;
+            if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+                disconnect();
+                return false;
+            }
+            reader = std::make_unique<line_reader>(fd);
+            return true;
+        }
+
+        bool connected() const { return fd != -1; }
+
+        // Scheduling class the daemon should use for this client's chat and embedding requests
+        void set_priority(ollama::priority_class cls) { priority = ollama::to_string(cls); }
+
+        bool chat(const std::string& model, const ollama::messages& messages,
+                  std::function<bool(const ollama::response&)> on_receive_token, json options = nullptr) {
+            json request = {{"op", "chat"}, {"model", model}, {"messages", messages.get_messages()}};
+            if (options != nullptr) request["options"] = options;
+
+            bool keep_going = true;
+            return call(request, [&](uint64_t id, const json& data) {
+                if (!keep_going) return;
+                keep_going = on_receive_token(ollama::response(data.dump(), ollama::message_type::chat));
+                if (!keep_going) write_line(fd, json({{"id", id}, {"op", "cancel"}}).dump());
+            });
+        }
+
+        ollama::response chat(const std::string& model, const ollama::messages& messages, json options = nullptr) {
+            std::string content;
+            json last;
+            chat(model, messages, [&](const ollama::response& response) {
+                content += response.as_simple_string();
+                last = response.as_json();
+                return true;
+            }, options);
+
+            if (last.is_null()) return ollama::response();
+            last["message"] = {{"role", "assistant"}, {"content", content}};
+            return ollama::response(last.dump(), ollama::message_type::chat);
+        }
+
+        ollama::response generate_embeddings(const std::string& model, const json& input, json options = nullptr) {
+            json request = {{"op", "embed"}, {"model", model}, {"input", input}};
+            if (options != nullptr) request["options"] = options;
+
+            ollama::response response;
+            call(request, [&](uint64_t, const json& data) { response = ollama::response(data.dump(), ollama::message_type::embedding); });
+            return response;
+        }
+
+        std::vector<std::string> list_models() {
+            std::vector<std::string> models;
+            call({{"op", "list_models"}}, [&](uint64_t, const json& data) { models = data.get<std::vector<std::string>>(); });
+            return models;
+        }
+
+        // Reports a semantic-cache answer to prompt as wrong; false when it did not come from the cache
+        bool report_false_hit(const std::string& model, const std::string& prompt) {
+            bool dropped = false;
+            call({{"op", "false_hit"}, {"model", model}, {"prompt", prompt}},
+                 [&](uint64_t, const json& data) { dropped = data.value("dropped", false); });
+            return dropped;
+        }
+
+        // Semantic cache counters for model, plus "response_hits"/"response_misses" for the exact cache
+        json cache_stats(const std::string& model) {
+            json stats;
+            call({{"op", "cache_stats"}, {"model", model}}, [&](uint64_t, const json& data) { stats = data; });
+            return stats;
+        }
+
+    private:
+        // Sends one request and feeds every "data" reply to on_data until done or error
+        bool call(json request, const std::function<void(uint64_t, const json&)>& on_data) {
+            if (fd == -1 && !connect()) {
+                if (ollama::use_exceptions) throw ollama::exception("Unable to connect to termsaged at " + path);
+                return false;
+            }
+
+            uint64_t id = next_id++;
+            request["id"] = id;
+            if (!priority.empty()) request["priority"] = priority;
+            if (!write_line(fd, request.dump())) {
+                disconnect();
+                if (ollama::use_exceptions) throw ollama::exception("Lost connection to termsaged");
+                return false;
+            }
+
+            // Under an httplib::CancelScope (Ctrl-C in the REPL) the wait is sliced so a cancel is sent
+            // at once, even while the server is still reading the prompt; late replies are skipped
+            const std::atomic<bool>* canceled = httplib::detail::request_cancel_flag();
+            std::string line;
+            while (true) {
+                if (canceled) {
+                    while (!reader->wait(100) && !*canceled) {}
+                    if (*canceled) {
+                        write_line(fd, json({{"id", id}, {"op", "cancel"}}).dump());
+                        return false;
+                    }
+                }
+                if (!reader->next(line)) break;
+                json reply = json::parse(line, nullptr, false);
+                if (reply.is_discarded() || reply.value("id", uint64_t(0)) != id) continue;
+                if (reply.contains("data")) on_data(id, reply["data"]);
+                if (reply.contains("error")) {
+                    if (ollama::use_exceptions) throw ollama::exception(reply["error"].get<std::string>());
+                    return false;
+                }
+                if (reply.value("done", false)) return true;
+            }
+
+            disconnect();
+            if (ollama::use_exceptions) throw ollama::exception("Lost connection to termsaged");
+            return false;
+        }
+
+        void disconnect() {
+            if (fd != -1) close(fd);
+            fd = -1;
+            reader.reset();
+        }
+
+        std::string path;
+        int fd = -1;
+        std::unique_ptr<line_reader> reader;
+        uint64_t next_id = 1;
+        std::string priority;
+    };
+}
+
+#endif // DAEMON_PROTOCOL_HPP
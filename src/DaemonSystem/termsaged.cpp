@@ -0,0 +1,313 @@
+// termsaged: lets many TermSage processes share one set of Ollama connections and caches
+#include "DaemonSystem/daemon_protocol.hpp"
+#include "NetworkSystem/request_scheduler.hpp"
+#include "NetworkSystem/single_flight.hpp"
+#include "NetworkSystem/resilience.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+namespace {
+    using json = nlohmann::json;
+
+    // One connected TermSage process
+    struct client_connection {
+        int fd = -1;
+        uint64_t id = 0;
+        std::mutex write_mutex;
+        std::mutex cancel_mutex;
+        std::set<uint64_t> queued;      // Accepted and not yet answered; only these can be canceled
+        std::set<uint64_t> canceled;
+        std::atomic<bool> open{true};
+        std::atomic<bool> finished{false};   // Reader has exited; the thread can be joined
+
+        bool send(const json& reply) {
+            std::lock_guard<std::mutex> lock(write_mutex);
+            if (!open) return false;
+            if (!termsage::write_line(fd, reply.dump())) open = false;
+            return open;
+        }
+
+        bool is_canceled(uint64_t request_id) {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            return canceled.count(request_id) > 0;
+        }
+
+        void begin(uint64_t request_id) {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            queued.insert(request_id);
+        }
+
+        void cancel(uint64_t request_id) {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            if (queued.count(request_id)) canceled.insert(request_id);
+        }
+
+        void finish(uint64_t request_id) {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            queued.erase(request_id);
+            canceled.erase(request_id);
+        }
+    };
+
+    class daemon_state {
+    public:
+        daemon_state(const std::string& server_url, const std::string& cache_path, bool compress,
+                     std::shared_ptr<ollama::semantic_cache> semantic)
+            : ollama(server_url),
+              chat_cache(std::make_shared<ollama::response_cache>(1024, cache_path)),
+              semantic(std::move(semantic)),
+              embedding_cache(4096) {
+            ollama.setKeepAlive(true);
+            ollama.setCompression(compress);
+            ollama.set_response_cache(chat_cache);
+            if (this->semantic) ollama.set_semantic_cache(this->semantic);
+        }
+
+        void handle(client_connection& client, const json& request) {
+            serve(client, request);
+            client.finish(request.value("id", uint64_t(0)));
+        }
+
+    private:
+        void serve(client_connection& client, const json& request) {
+            uint64_t id = request.value("id", uint64_t(0));
+            if (!client.open) return;
+            if (client.is_canceled(id)) {
+                client.send({{"id", id}, {"done", true}}); // Canceled while still queued
+                return;
+            }
+
+            try {
+                std::string op = request.value("op", "");
+                if (op == "chat") {
+                    ollama::messages messages;
+                    for (const auto& message : request.value("messages", json::array()))
+                        messages.add_message(message.value("role", "user"), message.value("content", ""));
+
+                    json options = request.contains("options") ? request["options"] : json(nullptr);
+                    // Identical deterministic requests from several clients share one generation
+                    flights.chat(ollama, request.value("model", ""), messages, [&](const ollama::response& response) {
+                        if (client.is_canceled(id)) return false;
+                        return client.send({{"id", id}, {"data", response.as_json()}});
+                    }, options);
+                } else if (op == "embed") {
+                    client.send({{"id", id}, {"data", embed(request)}});
+                } else if (op == "list_models") {
+                    client.send({{"id", id}, {"data", list_models()}});
+                } else if (op == "false_hit") {
+                    bool dropped = semantic && semantic->report_false_hit(request.value("model", ""), request.value("prompt", ""));
+                    client.send({{"id", id}, {"data", {{"dropped", dropped}}}});
+                } else if (op == "cache_stats") {
+                    json stats = semantic ? json(semantic->stats(request.value("model", ""))) : json::object();
+                    stats["response_hits"] = chat_cache->hit_count();
+                    stats["response_misses"] = chat_cache->miss_count();
+                    client.send({{"id", id}, {"data", stats}});
+                } else {
+                    client.send({{"id", id}, {"error", "Unknown op: " + op}});
+                    return;
+                }
+                client.send({{"id", id}, {"done", true}});
+            } catch (const std::exception& e) {
+                client.send({{"id", id}, {"error", e.what()}});
+            }
+        }
+
+        // Embeddings are deterministic, so every client shares one cache of them
+        json embed(const json& request) {
+            std::string model = request.value("model", "");
+            json input = request.contains("input") ? request["input"] : json("");
+            auto key = ollama::make_cache_key("embed\n" + model + "\n" + input.dump());
+            if (auto cached = embedding_cache.get(key)) return json::parse(*cached);
+
+            json options = request.contains("options") ? request["options"] : json(nullptr);
+            json result = resilient.generate_embeddings(model, input, options).as_json();
+            embedding_cache.put(key, result.dump());
+            return result;
+        }
+
+        // The model list rarely changes; refresh it at most every 30 seconds
+        json list_models() {
+            std::lock_guard<std::mutex> lock(models_mutex);
+            auto now = std::chrono::steady_clock::now();
+            if (models_fetched == std::chrono::steady_clock::time_point{} || now - models_fetched > std::chrono::seconds(30)) {
+                models = resilient.list_models();
+                models_fetched = now;
+            }
+            return models;
+        }
+
+        Ollama ollama;
+        ollama::resilient_ollama resilient{ollama};         // Embeddings and listings: retried, hedged, breaker-guarded
+        std::shared_ptr<ollama::response_cache> chat_cache;
+        std::shared_ptr<ollama::semantic_cache> semantic;   // Only with --semantic-cache
+        ollama::response_cache embedding_cache;
+        ollama::single_flight flights;
+
+        std::mutex models_mutex;
+        std::vector<std::string> models;
+        std::chrono::steady_clock::time_point models_fetched;
+    };
+
+    std::atomic<bool> shutting_down{false};
+    int listen_fd = -1;
+
+    void on_signal(int) {
+        shutting_down = true;
+        if (listen_fd != -1) shutdown(listen_fd, SHUT_RDWR);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = termsage::default_daemon_socket_path();
+    std::string server_url = "http://localhost:11434";
+    std::string cache_path;
+    ollama::scheduler_options scheduling;
+    bool compress = false;
+    bool use_semantic_cache = false;
+    ollama::semantic_cache_options semantic_options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--server" && has_value) {
+            server_url = argv[++i];
+        } else if (arg == "--cache" && has_value) {
+            cache_path = argv[++i];
+        } else if (arg == "--compress") {
+            compress = true;
+        } else if (arg == "--semantic-cache") {
+            // Opt-in: answers paraphrases of earlier prompts, at the cost of one embedding per chat
+            use_semantic_cache = true;
+            if (has_value && argv[i + 1][0] != '-') semantic_options.similarity_threshold = std::stof(argv[++i]);
+        } else if (arg == "--embed-model" && has_value) {
+            semantic_options.embedding_model = argv[++i];
+        } else if (arg == "--parallel" && has_value) {
+            scheduling.server_parallelism = std::max<size_t>(1, std::stoul(argv[++i]));
+            scheduling.reserved_interactive = std::min<size_t>(1, scheduling.server_parallelism - 1);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--socket path] [--server url] [--cache file] [--parallel n] [--compress]"
+                      << " [--semantic-cache [threshold]] [--embed-model name]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << socket_path << std::endl;
+        return 1;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(listen_fd, 64) == -1) {
+        std::cerr << "Unable to listen on " << socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    chmod(socket_path.c_str(), 0600);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::shared_ptr<ollama::semantic_cache> semantic;
+    if (use_semantic_cache) semantic = std::make_shared<ollama::semantic_cache>(semantic_options);
+    daemon_state state(server_url, cache_path, compress, semantic);
+
+    // Requests are admitted by priority class and per-client fairness, never more than the server runs in parallel
+    ollama::request_scheduler scheduler(scheduling);
+
+    std::cout << "termsaged listening on " << socket_path << " (Ollama at " << server_url << ")" << std::endl;
+
+    // Readers reference state and scheduler, so every one is joined before those go away
+    std::vector<std::pair<std::shared_ptr<client_connection>, std::thread>> clients;
+    auto reap = [&clients](bool all) {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (!all && !it->first->finished) {
+                ++it;
+                continue;
+            }
+            if (all) shutdown(it->first->fd, SHUT_RDWR);
+            it->second.join();
+            close(it->first->fd);
+            it = clients.erase(it);
+        }
+    };
+
+    uint64_t next_client = 1;
+    while (!shutting_down) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        reap(false);
+        auto client = std::make_shared<client_connection>();
+        client->fd = fd;
+        client->id = next_client++;
+
+        // One reader per client turns request lines into queued jobs
+        std::thread reader_thread([client, &scheduler, &state]() {
+            termsage::line_reader reader(client->fd);
+            std::string line;
+            while (reader.next(line)) {
+                json request = json::parse(line, nullptr, false);
+                if (request.is_discarded()) continue;
+
+                if (request.value("op", "") == "cancel") {
+                    client->cancel(request.value("id", uint64_t(0)));
+                    continue;
+                }
+                std::string op = request.value("op", "");
+                if (op == "list_models" || op == "false_hit" || op == "cache_stats") {
+                    state.handle(*client, request); // Cached and cheap; no slot needed
+                    continue;
+                }
+
+                // Chat defaults to interactive, embeddings to batch; clients may say otherwise
+                bool is_chat = request.value("op", "") == "chat";
+                auto cls = ollama::priority_from_string(request.value("priority", is_chat ? "interactive" : "batch"));
+                size_t cost = is_chat ? scheduler.estimate_cost(request.value("options", json(nullptr))) : 16;
+                client->begin(request.value("id", uint64_t(0)));
+                bool admitted = scheduler.submit(cls, cost, client->id, [client, request, &state]() {
+                    state.handle(*client, request);
+                });
+                if (!admitted) {
+                    client->finish(request.value("id", uint64_t(0)));
+                    client->send({{"id", request.value("id", uint64_t(0))},
+                                  {"error", std::string("termsaged queue full for ") + ollama::to_string(cls) + " requests"}});
+                }
+            }
+            scheduler.forget_flow(client->id);
+
+            // Queued jobs stop writing once open is false; the fd is closed when the thread is joined
+            std::lock_guard<std::mutex> lock(client->write_mutex);
+            client->open = false;
+            client->finished = true;
+        });
+        clients.emplace_back(std::move(client), std::move(reader_thread));
+    }
+
+    reap(true);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return 0;
+}
@@ -13,19 +13,36 @@
 #include <algorithm>
 #include <memory>
 #include <functional>
+#include <mutex>
 #include <cstring>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <chrono>
+#include <atomic>
+#include <cstddef>
 
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <errno.h>
 
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
 namespace httplib {
 
 // Error codes
@@ -75,6 +92,334 @@ using Headers = std::multimap<std::string, std::string>;
 // Request/Response body
 using Body = std::string;
 
+// Receives response body bytes as they arrive; return false to cancel
+using ContentReceiver = std::function<bool(const char* data, size_t data_length)>;
+
+namespace detail {
+
+inline bool iequals(const std::string& a, const std::string& b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+inline const std::string* find_header(const Headers& headers, const std::string& key) {
+  for (const auto& kv : headers) {
+    if (iequals(kv.first, key)) return &kv.second;
+  }
+  return nullptr;
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Deadline applied to every request made on the current thread; unset by default
+inline Deadline& request_deadline() {
+  thread_local Deadline deadline{};
+  return deadline;
+}
+
+// Flag that aborts requests made on the current thread when set; none by default
+inline const std::atomic<bool>*& request_cancel_flag() {
+  thread_local const std::atomic<bool>* flag = nullptr;
+  return flag;
+}
+
+inline bool request_canceled() {
+  auto flag = request_cancel_flag();
+  return flag && flag->load();
+}
+
+struct ResolvedAddress {
+  struct sockaddr_storage addr;
+  socklen_t len;
+};
+
+// Process-wide getaddrinfo cache. getaddrinfo does not report record TTLs, so
+// answers live for a fixed time; failures are remembered briefly so a dead
+// hostname does not stall every request on the resolver.
+class ResolverCache {
+public:
+  static ResolverCache& instance() {
+    static ResolverCache cache;
+    return cache;
+  }
+
+  void set_ttl(std::chrono::seconds positive, std::chrono::seconds negative) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    positive_ttl_ = positive;
+    negative_ttl_ = negative;
+  }
+
+  bool resolve(const std::string& host, int port, std::vector<ResolvedAddress>& addresses) {
+    std::string key = host + "|" + std::to_string(port);
+    auto now = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(key);
+      if (it != entries_.end() && now < it->second.expires) {
+        addresses = it->second.addresses;
+        return !addresses.empty();
+      }
+    }
+
+    // Resolve outside the lock; AF_UNSPEC so IPv6-only and dual-stack hosts work
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addresses.clear();
+    struct addrinfo* result;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) == 0) {
+      for (auto rp = result; rp != nullptr; rp = rp->ai_next) {
+        ResolvedAddress address;
+        memcpy(&address.addr, rp->ai_addr, rp->ai_addrlen);
+        address.len = rp->ai_addrlen;
+        addresses.push_back(address);
+      }
+      freeaddrinfo(result);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[key];
+    entry.addresses = addresses;
+    entry.expires = now + (addresses.empty() ? negative_ttl_ : positive_ttl_);
+    return !addresses.empty();
+  }
+
+  // Forgets an answer whose addresses all refused connections
+  void invalidate(const std::string& host, int port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(host + "|" + std::to_string(port));
+  }
+
+private:
+  struct Entry {
+    std::vector<ResolvedAddress> addresses;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+  std::chrono::seconds positive_ttl_{60};
+  std::chrono::seconds negative_ttl_{5};
+};
+
+// Streaming codecs for Content-Encoding. Each call consumes one piece of input and
+// hands output to `out` in bounded blocks, so memory does not grow with body size.
+using CodecSink = std::function<bool(const char* data, size_t data_length)>;
+
+class compressor {
+public:
+  virtual ~compressor() = default;
+  virtual bool compress(const char* data, size_t data_length, bool last, const CodecSink& out) = 0;
+};
+
+class decompressor {
+public:
+  virtual ~decompressor() = default;
+  virtual bool is_valid() const = 0;
+  virtual bool decompress(const char* data, size_t data_length, const CodecSink& out) = 0;
+};
+
+constexpr size_t codec_block_size = 16384;
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+class gzip_compressor : public compressor {
+public:
+  gzip_compressor() {
+    memset(&strm_, 0, sizeof(strm_));
+    valid_ = deflateInit2(&strm_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+  ~gzip_compressor() override { deflateEnd(&strm_); }
+
+  bool compress(const char* data, size_t data_length, bool last, const CodecSink& out) override {
+    if (!valid_) return false;
+    char buffer[codec_block_size];
+    do {
+      // zlib counts in uInt; feed very large inputs in slices
+      uInt slice = static_cast<uInt>(std::min<size_t>(data_length, 1u << 30));
+      bool final_slice = last && slice == data_length;
+      strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      strm_.avail_in = slice;
+      data += slice;
+      data_length -= slice;
+
+      int ret;
+      do {
+        strm_.next_out = reinterpret_cast<Bytef*>(buffer);
+        strm_.avail_out = sizeof(buffer);
+        ret = deflate(&strm_, final_slice ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR) return false;
+        size_t produced = sizeof(buffer) - strm_.avail_out;
+        if (produced > 0 && !out(buffer, produced)) return false;
+      } while (strm_.avail_out == 0);
+      if (final_slice && ret != Z_STREAM_END) return false;
+    } while (data_length > 0);
+    return true;
+  }
+
+private:
+  z_stream strm_;
+  bool valid_ = false;
+};
+
+// Accepts gzip and zlib-wrapped deflate streams
+class gzip_decompressor : public decompressor {
+public:
+  gzip_decompressor() {
+    memset(&strm_, 0, sizeof(strm_));
+    valid_ = inflateInit2(&strm_, 32 + 15) == Z_OK;
+  }
+  ~gzip_decompressor() override { inflateEnd(&strm_); }
+
+  bool is_valid() const override { return valid_; }
+
+  bool decompress(const char* data, size_t data_length, const CodecSink& out) override {
+    char buffer[codec_block_size];
+    strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    strm_.avail_in = static_cast<uInt>(data_length);
+    while (strm_.avail_in > 0) {
+      strm_.next_out = reinterpret_cast<Bytef*>(buffer);
+      strm_.avail_out = sizeof(buffer);
+      int ret = inflate(&strm_, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return false;
+      size_t produced = sizeof(buffer) - strm_.avail_out;
+      if (produced > 0 && !out(buffer, produced)) return false;
+      if (ret == Z_STREAM_END) {
+        // Concatenated gzip members are legal; start on the next one
+        if (inflateReset(&strm_) != Z_OK) return false;
+      } else if (produced == 0 && ret == Z_BUF_ERROR) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  z_stream strm_;
+  bool valid_ = false;
+};
+#endif
+
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+class zstd_compressor : public compressor {
+public:
+  zstd_compressor() : ctx_(ZSTD_createCCtx()) {}
+  ~zstd_compressor() override { ZSTD_freeCCtx(ctx_); }
+
+  bool compress(const char* data, size_t data_length, bool last, const CodecSink& out) override {
+    if (!ctx_) return false;
+    char buffer[codec_block_size];
+    ZSTD_inBuffer input = {data, data_length, 0};
+    bool finished;
+    do {
+      ZSTD_outBuffer output = {buffer, sizeof(buffer), 0};
+      size_t remaining = ZSTD_compressStream2(ctx_, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(remaining)) return false;
+      if (output.pos > 0 && !out(buffer, output.pos)) return false;
+      finished = last ? remaining == 0 : input.pos == input.size;
+    } while (!finished);
+    return true;
+  }
+
+private:
+  ZSTD_CCtx* ctx_;
+};
+
+class zstd_decompressor : public decompressor {
+public:
+  zstd_decompressor() : ctx_(ZSTD_createDCtx()) {}
+  ~zstd_decompressor() override { ZSTD_freeDCtx(ctx_); }
+
+  bool is_valid() const override { return ctx_ != nullptr; }
+
+  bool decompress(const char* data, size_t data_length, const CodecSink& out) override {
+    char buffer[codec_block_size];
+    ZSTD_inBuffer input = {data, data_length, 0};
+    while (input.pos < input.size) {
+      ZSTD_outBuffer output = {buffer, sizeof(buffer), 0};
+      size_t ret = ZSTD_decompressStream(ctx_, &output, &input);
+      if (ZSTD_isError(ret)) return false;
+      if (output.pos > 0 && !out(buffer, output.pos)) return false;
+    }
+    return true;
+  }
+
+private:
+  ZSTD_DCtx* ctx_;
+};
+#endif
+
+inline std::unique_ptr<compressor> make_compressor(const std::string& encoding) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  if (encoding == "gzip") return std::unique_ptr<compressor>(new gzip_compressor());
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+  if (encoding == "zstd") return std::unique_ptr<compressor>(new zstd_compressor());
+#endif
+  (void)encoding;
+  return nullptr;
+}
+
+inline std::unique_ptr<decompressor> make_decompressor(const std::string& encoding) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  if (iequals(encoding, "gzip") || iequals(encoding, "deflate")) return std::unique_ptr<decompressor>(new gzip_decompressor());
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+  if (iequals(encoding, "zstd")) return std::unique_ptr<decompressor>(new zstd_decompressor());
+#endif
+  (void)encoding;
+  return nullptr;
+}
+
+// Accept-Encoding value listing every codec compiled in; empty when there are none
+inline std::string accepted_encodings() {
+  std::string accepted;
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+  accepted += "zstd";
+#endif
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  accepted += accepted.empty() ? "gzip, deflate" : ", gzip, deflate";
+#endif
+  return accepted;
+}
+
+} // namespace detail
+
+// Bounds all requests made on this thread while in scope; nested scopes can only tighten it
+class DeadlineScope {
+public:
+  explicit DeadlineScope(detail::Deadline deadline) : previous_(detail::request_deadline()) {
+    auto& current = detail::request_deadline();
+    if (current == detail::Deadline{} || deadline < current) current = deadline;
+  }
+  ~DeadlineScope() { detail::request_deadline() = previous_; }
+
+  DeadlineScope(const DeadlineScope&) = delete;
+  DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+private:
+  detail::Deadline previous_;
+};
+
+// Lets another thread abort requests made on this thread while in scope, e.g. on Ctrl-C.
+// Blocking waits are sliced so a set flag is noticed within about 100 ms.
+class CancelScope {
+public:
+  explicit CancelScope(const std::atomic<bool>& flag) : previous_(detail::request_cancel_flag()) {
+    detail::request_cancel_flag() = &flag;
+  }
+  ~CancelScope() { detail::request_cancel_flag() = previous_; }
+
+  CancelScope(const CancelScope&) = delete;
+  CancelScope& operator=(const CancelScope&) = delete;
+
+private:
+  const std::atomic<bool>* previous_;
+};
+
 // Request class
 class Request {
 public:
@@ -90,30 +435,107 @@ public:
   int status = -1;
   Headers headers;
   Body body;
+  Error error = Error::Success;
+
+  bool has_header(const std::string& key) const {
+    return detail::find_header(headers, key) != nullptr;
+  }
+
+  std::string get_header_value(const std::string& key) const {
+    auto value = detail::find_header(headers, key);
+    return value ? *value : std::string();
+  }
 };
 
 // Client class - Simplified version with just what we need for the Ollama API
 class Client {
 public:
+  // Accepts "host", "host:port", "[v6addr]:port", any of those behind "http://",
+  // and "unix:///path/to.sock" or "unix://@name" (Linux abstract namespace)
   Client(const std::string& host, int port = -1) : host_(host), port_(port) {
-    if (port_ == -1) {
-      // Check if host includes port (e.g., "localhost:11434")
+    // Strip the scheme (e.g., "http://localhost:11434")
+    auto scheme_end = host_.find("://");
+    if (scheme_end != std::string::npos) {
+      bool unix_socket = host_.compare(0, scheme_end, "unix") == 0;
+      host_ = host_.substr(scheme_end + 3);
+      if (unix_socket) {
+        socket_path_ = host_;
+        host_ = "localhost";
+        host_header_ = host_;
+        return;
+      }
+    }
+    if (!host_.empty() && host_.back() == '/') {
+      host_.pop_back();
+    }
+
+    // Port after the last colon, unless the colons belong to a bare IPv6 address
+    std::string port_str;
+    if (!host_.empty() && host_.front() == '[') {
+      auto close_bracket = host_.find(']');
+      if (close_bracket != std::string::npos) {
+        if (host_.size() > close_bracket + 1 && host_[close_bracket + 1] == ':') port_str = host_.substr(close_bracket + 2);
+        host_ = host_.substr(1, close_bracket - 1);
+      }
+    } else if (std::count(host_.begin(), host_.end(), ':') == 1) {
       auto pos = host_.find(':');
-      if (pos != std::string::npos) {
-        try {
-          port_ = std::stoi(host_.substr(pos + 1));
-          host_ = host_.substr(0, pos);
-        } catch (const std::exception&) {
-          // If port parsing fails, use default
-          port_ = 80;
-        }
-      } else {
-        port_ = 80; // Default HTTP port
+      port_str = host_.substr(pos + 1);
+      host_ = host_.substr(0, pos);
+    }
+
+    if (port_ == -1) {
+      try {
+        port_ = port_str.empty() ? 80 : std::stoi(port_str);
+      } catch (const std::exception&) {
+        // If port parsing fails, use default
+        port_ = 80;
       }
     }
+
+    host_header_ = host_.find(':') != std::string::npos ? "[" + host_ + "]" : host_;
+    if (port_ != 80) host_header_ += ":" + std::to_string(port_);
+  }
+
+  virtual ~Client() {
+    for (int sock : idle_connections_) close(sock);
   }
 
-  virtual ~Client() {}
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  // Reuse connections across requests instead of sending "Connection: close"
+  void set_keep_alive(bool on) {
+    keep_alive_ = on;
+  }
+
+  void set_max_idle_connections(size_t count) {
+    max_idle_connections_ = count;
+  }
+
+  // Bounds the TCP handshake separately from reads; the thread's deadline still applies
+  void set_connect_timeout(time_t sec, time_t usec = 0) {
+    connect_timeout_sec_ = sec;
+    connect_timeout_usec_ = usec;
+  }
+
+  // Fixed SO_RCVBUF/SO_SNDBUF sizes; setting them disables the kernel's buffer autotuning
+  void set_socket_buffer_sizes(int receive_bytes, int send_bytes) {
+    receive_buffer_size_ = receive_bytes;
+    send_buffer_size_ = send_bytes;
+  }
+
+  // Compresses request bodies of at least compress_min_size bytes with the given Content-Encoding.
+  // Ollama itself does not decode compressed requests; this is for proxies in front of it.
+  // Ignored when the encoding was not compiled in (CPPHTTPLIB_ZLIB_SUPPORT, CPPHTTPLIB_ZSTD_SUPPORT).
+  void set_compress(bool on, const std::string& encoding = "gzip") {
+    compress_ = on;
+    compress_encoding_ = encoding;
+  }
+
+  // Advertises Accept-Encoding and decodes compressed responses as they stream in; on by default
+  void set_decompress(bool on) {
+    decompress_ = on;
+  }
 
   void set_read_timeout(time_t sec, time_t usec = 0) {
     read_timeout_sec_ = sec;
@@ -125,123 +547,496 @@ public:
     return send_request("GET", path, "", "");
   }
 
+  // GET request whose response body is streamed to content_receiver instead of res->body
+  std::shared_ptr<Response> Get(const std::string& path, ContentReceiver content_receiver) {
+    return send_request("GET", path, "", "", std::move(content_receiver));
+  }
+
   // Simple POST request with JSON body
   std::shared_ptr<Response> Post(const std::string& path, const std::string& body, const std::string& content_type) {
     return send_request("POST", path, body, content_type);
   }
 
+  // POST request whose response body is streamed to content_receiver instead of res->body
+  std::shared_ptr<Response> Post(const std::string& path, const std::string& body, const std::string& content_type,
+                                 ContentReceiver content_receiver) {
+    return send_request("POST", path, body, content_type, std::move(content_receiver));
+  }
+
 private:
   std::string host_;
   int port_;
+  std::string host_header_;
+  std::string socket_path_;   // Set for unix:// URLs; host_ and port_ are then unused
+
+  time_t connect_timeout_sec_ = 10;
+  time_t connect_timeout_usec_ = 0;
+  int receive_buffer_size_ = 0;   // 0 leaves the kernel's autotuning alone
+  int send_buffer_size_ = 0;
+
+  std::mutex address_mutex_;
+  detail::ResolvedAddress preferred_address_;
+  bool has_preferred_address_ = false;
   time_t read_timeout_sec_ = 300;
   time_t read_timeout_usec_ = 0;
 
-  // Simplified request sending function
-  std::shared_ptr<Response> send_request(const std::string& method, const std::string& path, 
-                                         const std::string& body, const std::string& content_type) {
-    auto res = std::make_shared<Response>();
-    int sock = -1;
+  bool compress_ = false;
+  std::string compress_encoding_ = "gzip";
+  size_t compress_min_size_ = 1024;
+  bool decompress_ = true;
 
-    // Resolve hostname
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+  bool keep_alive_ = false;
+  size_t max_idle_connections_ = 4;
+  std::mutex idle_mutex_;
+  std::vector<int> idle_connections_;
 
-    struct addrinfo* result;
-    if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &result) != 0) {
-      return res; // Failed to resolve hostname
+  // Closes the socket on every exit path, including exceptions thrown by the receiver
+  struct SocketGuard {
+    int fd;
+    ~SocketGuard() {
+      if (fd != -1) close(fd);
     }
+  };
 
-    // Create socket
-    for (auto rp = result; rp != nullptr; rp = rp->ai_next) {
-      sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-      if (sock == -1) continue;
-
-      if (connect(sock, rp->ai_addr, rp->ai_addrlen) != -1) break;
+  int take_idle_connection() {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    if (idle_connections_.empty()) return -1;
+    int sock = idle_connections_.back();
+    idle_connections_.pop_back();
+    return sock;
+  }
 
+  void return_idle_connection(int sock) {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    if (idle_connections_.size() < max_idle_connections_) {
+      idle_connections_.push_back(sock);
+    } else {
       close(sock);
-      sock = -1;
+    }
+  }
+
+  // Connects to the address that worked last time first, then to each resolved address
+  int open_connection(Error& error) {
+    if (!socket_path_.empty()) return open_unix_connection(error);
+
+    detail::ResolvedAddress preferred;
+    bool has_preferred;
+    {
+      std::lock_guard<std::mutex> lock(address_mutex_);
+      preferred = preferred_address_;
+      has_preferred = has_preferred_address_;
+    }
+    if (has_preferred) {
+      int sock = connect_to(reinterpret_cast<const struct sockaddr*>(&preferred.addr), preferred.len, error);
+      if (sock != -1) return sock;
+      if (error == Error::Timeout || error == Error::Canceled) return -1;
+      std::lock_guard<std::mutex> lock(address_mutex_);
+      has_preferred_address_ = false;
+    }
+
+    std::vector<detail::ResolvedAddress> addresses;
+    if (!detail::ResolverCache::instance().resolve(host_, port_, addresses)) {
+      error = Error::Connection;
+      return -1; // Failed to resolve hostname
+    }
+
+    for (const auto& address : addresses) {
+      int sock = connect_to(reinterpret_cast<const struct sockaddr*>(&address.addr), address.len, error);
+      if (sock == -1) {
+        if (error == Error::Timeout || error == Error::Canceled) return -1;
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(address_mutex_);
+      preferred_address_ = address;
+      has_preferred_address_ = true;
+      return sock;
+    }
+
+    // Every address refused; the answer may be stale
+    detail::ResolverCache::instance().invalidate(host_, port_);
+    error = Error::Connection;
+    return -1;
+  }
+
+  int open_unix_connection(Error& error) const {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path_.empty() || socket_path_.size() >= sizeof(addr.sun_path)) {
+      error = Error::Connection;
+      return -1;
+    }
+    memcpy(addr.sun_path, socket_path_.data(), socket_path_.size());
+
+    // A leading '@' names a socket in the abstract namespace, whose address is not NUL-terminated
+    socklen_t len = sizeof(addr);
+    if (socket_path_.front() == '@') {
+      addr.sun_path[0] = '\0';
+      len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + socket_path_.size());
     }
 
-    freeaddrinfo(result);
+    return connect_to(reinterpret_cast<const struct sockaddr*>(&addr), len, error);
+  }
 
+  // Non-blocking connect bounded by the connect timeout and the thread's deadline.
+  // A connect that times out reports Timeout; refusals and unreachable hosts report Connection.
+  int connect_to(const struct sockaddr* addr, socklen_t len, Error& error) const {
+    int sock = socket(addr->sa_family, SOCK_STREAM, 0);
     if (sock == -1) {
-      return res; // Failed to connect
+      error = Error::Connection;
+      return -1;
     }
+    SocketGuard guard{sock};
 
-    // Set socket timeout
-    struct timeval tv;
-    tv.tv_sec = read_timeout_sec_;
-    tv.tv_usec = read_timeout_usec_;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    if (connect(sock, addr, len) == -1) {
+      if (errno != EINPROGRESS) {
+        error = Error::Connection;
+        return -1;
+      }
 
-    // Prepare request
-    std::stringstream request_stream;
-    request_stream << method << " " << path << " HTTP/1.1\r\n";
-    request_stream << "Host: " << host_ << "\r\n";
-    request_stream << "Connection: close\r\n";
+      int ready = wait_ready(sock, POLLOUT, connect_timeout_sec_, connect_timeout_usec_);
+      if (ready == 0 || (ready == -1 && errno == ECANCELED)) {
+        error = ready == 0 ? Error::Timeout : Error::Canceled;
+        return -1;
+      }
+
+      int so_error = 0;
+      socklen_t so_len = sizeof(so_error);
+      if (ready == -1 || getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_error, &so_len) == -1 || so_error != 0) {
+        error = Error::Connection;
+        return -1;
+      }
+    }
+
+    fcntl(sock, F_SETFL, flags);
+    tune_socket(sock, addr->sa_family);
+    guard.fd = -1;
+    return sock;
+  }
+
+  void tune_socket(int sock, int family) const {
+    if (receive_buffer_size_ > 0)
+      setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size_, sizeof(receive_buffer_size_));
+    if (send_buffer_size_ > 0)
+      setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buffer_size_, sizeof(send_buffer_size_));
+    if (family != AF_INET && family != AF_INET6) return;
+
+    // Requests are small and written once; don't let Nagle hold them back
+    int on = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    quick_ack(sock);
+  }
+
+  // Acknowledge streamed tokens immediately instead of waiting on delayed ACK.
+  // Linux clears this after a while, so it is re-armed whenever a response is awaited.
+  static void quick_ack(int sock) {
+#ifdef TCP_QUICKACK
+    int on = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+#else
+    (void)sock;
+#endif
+  }
+
+  // Simplified request sending function
+  std::shared_ptr<Response> send_request(const std::string& method, const std::string& path, 
+                                         const std::string& body, const std::string& content_type,
+                                         ContentReceiver content_receiver = nullptr) {
+    auto res = std::make_shared<Response>();
+
+    const auto& deadline = detail::request_deadline();
+    if (deadline != detail::Deadline{} && std::chrono::steady_clock::now() >= deadline) {
+      res->error = Error::Timeout;
+      return res;
+    }
+    if (detail::request_canceled()) {
+      res->error = Error::Canceled;
+      return res;
+    }
+
+    // Large bodies may be compressed; otherwise the caller's string is sent as is
+    const std::string* payload = &body;
+    std::string compressed;
+    std::string content_encoding;
+    if (compress_ && body.size() >= compress_min_size_) {
+      if (auto codec = detail::make_compressor(compress_encoding_)) {
+        compressed.reserve(body.size() / 4);
+        if (!codec->compress(body.data(), body.size(), true, [&](const char* data, size_t len) {
+              compressed.append(data, len);
+              return true;
+            })) {
+          res->error = Error::Compression;
+          return res;
+        }
+        payload = &compressed;
+        content_encoding = compress_encoding_;
+      }
+    }
+
+    // Headers go in one small buffer
+    std::string head;
+    head.reserve(160 + path.size() + host_header_.size() + content_type.size());
+    head.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+    head.append("Host: ").append(host_header_).append("\r\n");
+    if (!keep_alive_) {
+      head.append("Connection: close\r\n");
+    }
+    if (decompress_) {
+      static const std::string accepted = detail::accepted_encodings();
+      if (!accepted.empty()) head.append("Accept-Encoding: ").append(accepted).append("\r\n");
+    }
 
     if (!content_type.empty() && !body.empty()) {
-      request_stream << "Content-Type: " << content_type << "\r\n";
-      request_stream << "Content-Length: " << body.size() << "\r\n";
+      head.append("Content-Type: ").append(content_type).append("\r\n");
+      if (!content_encoding.empty()) head.append("Content-Encoding: ").append(content_encoding).append("\r\n");
+      head.append("Content-Length: ").append(std::to_string(payload->size())).append("\r\n");
     }
 
-    request_stream << "\r\n";
-    
-    if (!body.empty()) {
-      request_stream << body;
+    head.append("\r\n");
+
+    // A pooled connection may have been closed by the server while idle; retry those once on a fresh one
+    for (int attempt = 0; attempt < 2; attempt++) {
+      res->error = Error::Success;
+      int sock = keep_alive_ ? take_idle_connection() : -1;
+      bool reused = sock != -1;
+      if (!reused) sock = open_connection(res->error);
+      if (sock == -1) return res;
+      SocketGuard guard{sock};
+
+      // Send request
+      size_t sent = send_all(sock, head, *payload, res->error);
+      if (res->error != Error::Success) {
+        if (reused && sent == 0 && res->error == Error::Write) continue;
+        return res; // Failed to send request
+      }
+      if (socket_path_.empty()) quick_ack(sock);
+
+      // Read up to the end of the response headers
+      std::string pending;
+      size_t header_end;
+      while ((header_end = pending.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(sock, pending, res->error)) break;
+      }
+      if (header_end == std::string::npos) {
+        if (reused && pending.empty() && res->error != Error::Timeout && res->error != Error::Canceled) continue;
+        return res; // Empty or invalid response
+      }
+
+      if (!parse_header(pending.substr(0, header_end), *res)) {
+        res->error = Error::Read;
+        return res; // Invalid status line
+      }
+      pending.erase(0, header_end + 4);
+
+      // Compressed responses are decoded piece by piece as they arrive
+      std::unique_ptr<detail::decompressor> decoder;
+      std::string encoding = res->get_header_value("Content-Encoding");
+      if (decompress_ && !encoding.empty() && !detail::iequals(encoding, "identity")) {
+        decoder = detail::make_decompressor(encoding);
+        if (!decoder || !decoder->is_valid()) {
+          res->error = Error::Compression;
+          return res; // Encoding we cannot decode
+        }
+      }
+
+      // Body bytes go to the caller's receiver when streaming, otherwise into res->body
+      auto deliver = [&](const char* data, size_t len) {
+        if (content_receiver) return content_receiver(data, len);
+        res->body.append(data, len);
+        return true;
+      };
+      bool decode_failed = false;
+      auto sink = [&](const char* data, size_t len) {
+        if (!decoder) return deliver(data, len);
+        bool delivered = true;
+        bool decoded = decoder->decompress(data, len, [&](const char* out, size_t out_len) {
+          delivered = deliver(out, out_len);
+          return delivered;
+        });
+        if (!decoded && delivered) decode_failed = true;
+        return decoded;
+      };
+
+      bool delimited = true;
+      if (detail::iequals(res->get_header_value("Transfer-Encoding"), "chunked")) {
+        read_chunked_body(sock, pending, sink, res->error);
+      } else if (res->has_header("Content-Length")) {
+        size_t remaining = std::strtoull(res->get_header_value("Content-Length").c_str(), nullptr, 10);
+        read_fixed_body(sock, pending, remaining, sink, res->error);
+      } else {
+        read_fixed_body(sock, pending, std::string::npos, sink, res->error);
+        delimited = false;
+      }
+      if (decode_failed) res->error = Error::Compression;
+
+      // Hand a cleanly finished connection back to the pool
+      if (keep_alive_ && delimited && res->error == Error::Success && pending.empty() &&
+          !detail::iequals(res->get_header_value("Connection"), "close")) {
+        return_idle_connection(sock);
+        guard.fd = -1;
+      }
+      return res;
     }
+    return res;
+  }
 
-    std::string request_str = request_stream.str();
+  // Polls for events up to the given timeout, clamped to the thread's deadline; 0 on timeout.
+  // Returns -1 with errno set to ECANCELED when the thread's cancel flag is raised.
+  static int wait_ready(int sock, short events, time_t sec, time_t usec) {
+    auto timeout = std::chrono::milliseconds(sec * 1000 + usec / 1000);
+    const auto& deadline = detail::request_deadline();
+    if (deadline != detail::Deadline{}) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      timeout = std::max(std::chrono::milliseconds(0), std::min(timeout, remaining));
+    }
 
-    // Send request
-    if (::send(sock, request_str.c_str(), request_str.size(), 0) == -1) {
-      close(sock);
-      return res; // Failed to send request
+    bool cancelable = detail::request_cancel_flag() != nullptr;
+    auto until = std::chrono::steady_clock::now() + timeout;
+    struct pollfd pfd = {sock, events, 0};
+    while (true) {
+      if (detail::request_canceled()) {
+        errno = ECANCELED;
+        return -1;
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now());
+      left = std::max(std::chrono::milliseconds(0), left);
+      auto slice = cancelable ? std::min(left, std::chrono::milliseconds(100)) : left;
+
+      int ready = poll(&pfd, 1, static_cast<int>(slice.count()));
+      if (ready == -1 && errno == EINTR) continue;
+      if (ready != 0 || slice == left) return ready;
     }
+  }
 
-    // Read response
-    char buffer[4096];
-    std::string response_str;
-    ssize_t bytes_read;
+  // Writes the header block and the body with one gather call per kernel pass, resuming after partial writes.
+  // Returns the number of bytes sent so a caller can tell whether the request reached the peer at all.
+  size_t send_all(int sock, const std::string& head, const std::string& body, Error& error) const {
+    size_t total = head.size() + body.size();
+    size_t sent = 0;
+
+    while (sent < total) {
+      // Point past what already went out without copying either buffer
+      struct iovec iov[2];
+      size_t count = 0;
+      if (sent < head.size()) {
+        iov[count++] = {const_cast<char*>(head.data()) + sent, head.size() - sent};
+      }
+      size_t body_sent = sent > head.size() ? sent - head.size() : 0;
+      if (body_sent < body.size()) {
+        iov[count++] = {const_cast<char*>(body.data()) + body_sent, body.size() - body_sent};
+      }
+
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+
+      ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n > 0) {
+        sent += static_cast<size_t>(n);
+        continue;
+      }
+      if (n == -1 && errno == EINTR) continue;
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        int ready = wait_ready(sock, POLLOUT, read_timeout_sec_, read_timeout_usec_);
+        if (ready > 0) continue;
+        error = ready == 0 ? Error::Timeout : errno == ECANCELED ? Error::Canceled : Error::Write;
+        return sent;
+      }
+      error = Error::Write;
+      return sent;
+    }
+    return sent;
+  }
+
+  // Waits up to the read timeout, clamped to the thread's deadline, then reads what is available
+  bool fill(int sock, std::string& pending, Error& error) const {
+    int ready = wait_ready(sock, POLLIN, read_timeout_sec_, read_timeout_usec_);
+    if (ready == 0) {
+      error = Error::Timeout;
+      return false;
+    }
 
-    while ((bytes_read = recv(sock, buffer, sizeof(buffer) - 1, 0)) > 0) {
-      buffer[bytes_read] = '\0';
-      response_str += buffer;
+    char buffer[4096];
+    if (ready == -1 && errno == ECANCELED) {
+      error = Error::Canceled;
+      return false;
     }
 
-    close(sock);
+    ssize_t bytes_read = ready > 0 ? recv(sock, buffer, sizeof(buffer), 0) : -1;
+    if (bytes_read <= 0) {
+      error = bytes_read == 0 ? Error::ConnectionClosed : Error::Read;
+      return false;
+    }
+    pending.append(buffer, static_cast<size_t>(bytes_read));
+    return true;
+  }
 
-    // Parse response
-    if (response_str.empty()) {
-      return res; // Empty response
+  // Reads `remaining` bytes, or until the peer closes when remaining is npos
+  template <typename Sink>
+  bool read_fixed_body(int sock, std::string& pending, size_t remaining, Sink& sink, Error& error) const {
+    while (remaining > 0) {
+      if (pending.empty() && !fill(sock, pending, error)) {
+        if (remaining != std::string::npos || error != Error::ConnectionClosed) return false;
+        error = Error::Success;
+        return true;
+      }
+      size_t n = std::min(remaining, pending.size());
+      if (!sink(pending.data(), n)) {
+        error = Error::Canceled;
+        return false;
+      }
+      pending.erase(0, n);
+      if (remaining != std::string::npos) remaining -= n;
     }
+    return true;
+  }
+
+  // Decodes Transfer-Encoding: chunked, handing each piece to sink as soon as it arrives
+  template <typename Sink>
+  bool read_chunked_body(int sock, std::string& pending, Sink& sink, Error& error) const {
+    while (true) {
+      size_t line_end;
+      while ((line_end = pending.find("\r\n")) == std::string::npos) {
+        if (!fill(sock, pending, error)) return false;
+      }
+      size_t chunk_size = std::strtoull(pending.c_str(), nullptr, 16);
+      pending.erase(0, line_end + 2);
+      if (chunk_size == 0) return true;
 
-    // Find header/body separator
-    auto header_end = response_str.find("\r\n\r\n");
-    if (header_end == std::string::npos) {
-      return res; // Invalid response
+      if (!read_fixed_body(sock, pending, chunk_size, sink, error)) return false;
+
+      while (pending.size() < 2) {
+        if (!fill(sock, pending, error)) return false;
+      }
+      pending.erase(0, 2); // Trailing CRLF after chunk data
     }
+  }
 
+  static bool parse_header(const std::string& header, Response& res) {
     // Parse status line
-    auto header = response_str.substr(0, header_end);
     auto status_line_end = header.find("\r\n");
     auto status_line = header.substr(0, status_line_end);
 
     // "HTTP/1.1 200 OK"
     if (status_line.size() < 12) {
-      return res; // Invalid status line
+      return false;
     }
 
     auto status_start = status_line.find(' ');
     auto status_end = status_line.find(' ', status_start + 1);
     if (status_start == std::string::npos || status_end == std::string::npos) {
-      return res; // Invalid status line
+      return false;
     }
 
     auto status_str = status_line.substr(status_start + 1, status_end - status_start - 1);
-    res->status = std::stoi(status_str);
+    res.status = std::stoi(status_str);
+
+    if (status_line_end == std::string::npos) return true;
 
     // Parse headers
     auto header_lines = header.substr(status_line_end + 2); // Skip status line
@@ -264,14 +1059,10 @@ private:
         value.erase(0, value.find_first_not_of(' '));
         value.erase(value.find_last_not_of(' ') + 1);
         
-        res->headers.emplace(key, value);
+        res.headers.emplace(key, value);
       }
     }
-
-    // Extract body
-    res->body = response_str.substr(header_end + 4);
-
-    return res;
+    return true;
   }
 };
 
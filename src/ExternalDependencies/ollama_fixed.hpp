@@ -8,6 +8,11 @@
 #include <fstream>
 #include <numeric>
 #include <memory>
+#include <map>
+#include <optional>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
 
 // Include the nlohmann/json library
 #include "./nlohmann/json.hpp"
@@ -15,6 +20,10 @@
 // Include our custom httplib implementation without SSL dependency
 #include "./cpp-httplib-no-ssl.h"
 
+#include "../CacheSystem/response_cache.hpp"
+#include "../CacheSystem/semantic_cache.hpp"
+#include "../ModelSystem/model_info.hpp"
+
 namespace ollama {
     using json = nlohmann::json;
 
@@ -37,38 +46,182 @@ namespace ollama {
         invalid_json_exception(const std::string& message) : exception(message) {}
     };
 
+    // The server could not be reached or did not return a complete 200 response
+    class transport_exception : public exception {
+    public:
+        transport_exception(const std::string& message, const std::shared_ptr<httplib::Response>& res)
+            : exception(message + " (" + describe(res) + ")"),
+              error(res ? res->error : httplib::Error::Unknown), status(res ? res->status : -1) {}
+
+        httplib::Error error;
+        int status;
+
+    private:
+        static std::string describe(const std::shared_ptr<httplib::Response>& res) {
+            if (!res) return httplib::to_string(httplib::Error::Unknown);
+            if (res->error != httplib::Error::Success) return httplib::to_string(res->error);
+            return "HTTP " + std::to_string(res->status);
+        }
+    };
+
+    inline bool succeeded(const std::shared_ptr<httplib::Response>& res) {
+        return res && res->status == 200 && res->error == httplib::Error::Success;
+    }
+
     // Message types
-    enum class message_type { generate, chat };
+    enum class message_type { generate, chat, embedding };
 
-    // Messages class for chat API
+    // Messages class for chat API. The history is a persistent list: each message is an
+    // immutable node pointing at the one before it, so copying a history or forking it at an
+    // earlier turn is O(1) and shares every common message. Each node keeps its serialized
+    // JSON, so forks send byte-identical prefixes without dumping them again.
     class messages {
     private:
-        std::vector<json> messages_array;
-        
+        struct node {
+            json message;
+            std::string serialized;
+            std::shared_ptr<const node> parent;
+            std::shared_ptr<const node> jump; // Skip pointer; reaches any earlier turn in O(log n) hops
+            size_t depth;
+        };
+
+        std::shared_ptr<const node> tail;
+
+        static size_t depth_of(const std::shared_ptr<const node>& n) { return n ? n->depth : 0; }
+
+        // Unlinks an unshared chain iteratively so long histories cannot overflow the stack
+        void release() noexcept {
+            while (tail && tail.use_count() == 1) {
+                std::shared_ptr<const node> parent = tail->parent;
+                tail = std::move(parent);
+            }
+            tail.reset();
+        }
+
+        // The node holding message number depth (1-based), or null for depth 0
+        std::shared_ptr<const node> ancestor(size_t depth) const {
+            std::shared_ptr<const node> current = tail;
+            while (current && current->depth > depth) {
+                current = depth_of(current->jump) >= depth ? current->jump : current->parent;
+            }
+            return current;
+        }
+
     public:
         messages() = default;
+        messages(const messages&) = default;
+        messages(messages&&) noexcept = default;
+
+        // The new chain is held before the old one is released, so assigning a history to itself
+        // or to one that shares its nodes keeps them alive
+        messages& operator=(const messages& other) {
+            std::shared_ptr<const node> kept = other.tail;
+            release();
+            tail = std::move(kept);
+            return *this;
+        }
+
+        messages& operator=(messages&& other) noexcept {
+            std::shared_ptr<const node> kept = std::move(other.tail);
+            release();
+            tail = std::move(kept);
+            return *this;
+        }
+
+        ~messages() { release(); }
         
-        void add_message(const std::string& role, const std::string& content) {
-            json message;
-            message["role"] = role;
-            message["content"] = content;
-            messages_array.push_back(message);
+        // Content is taken by value so large messages (attached files) can be moved in rather than copied
+        void add_message(const std::string& role, std::string content) {
+            auto added = std::make_shared<node>();
+            added->message["role"] = role;
+            added->message["content"] = std::move(content);
+            added->serialized = added->message.dump();
+            added->parent = tail;
+            added->depth = depth_of(tail) + 1;
+
+            // Skew-binary jumps: a jump doubles its reach whenever two equal spans line up
+            const auto& jump = tail ? tail->jump : nullptr;
+            if (tail && depth_of(tail) - depth_of(jump) == depth_of(jump) - (jump ? depth_of(jump->jump) : 0))
+                added->jump = jump ? jump->jump : nullptr;
+            else
+                added->jump = tail;
+            tail = std::move(added);
         }
         
-        void add_system(const std::string& content) {
-            add_message("system", content);
+        void add_system(std::string content) {
+            add_message("system", std::move(content));
         }
         
-        void add_user(const std::string& content) {
-            add_message("user", content);
+        void add_user(std::string content) {
+            add_message("user", std::move(content));
         }
         
-        void add_assistant(const std::string& content) {
-            add_message("assistant", content);
+        void add_assistant(std::string content) {
+            add_message("assistant", std::move(content));
         }
+
+        size_t size() const { return depth_of(tail); }
+        bool empty() const { return !tail; }
+
+        // The first count messages as a new history sharing them with this one
+        messages prefix(size_t count) const {
+            messages result;
+            result.tail = count >= size() ? tail : ancestor(count);
+            return result;
+        }
+
+        const json& at(size_t index) const {
+            if (index >= size()) throw std::out_of_range("ollama::messages index out of range");
+            return ancestor(index + 1)->message;
+        }
+
+        const json& back() const { return at(size() - 1); }
         
-        const std::vector<json>& get_messages() const {
-            return messages_array;
+        std::vector<json> get_messages() const {
+            std::vector<json> result(size());
+            for (const node* n = tail.get(); n; n = n->parent.get()) result[n->depth - 1] = n->message;
+            return result;
+        }
+
+        // Calls visit(content) for each message, newest first, without copying the history
+        template <typename Visit>
+        void for_each_content(Visit&& visit) const {
+            for (const node* n = tail.get(); n; n = n->parent.get()) {
+                auto content = n->message.find("content");
+                if (content != n->message.end() && content->is_string()) visit(content->template get_ref<const std::string&>());
+            }
+        }
+
+        // Calls visit(serialized) for each message's cached JSON, oldest first
+        template <typename Visit>
+        void for_each_serialized(Visit&& visit) const {
+            std::vector<const node*> chain(size());
+            for (const node* n = tail.get(); n; n = n->parent.get()) chain[n->depth - 1] = n;
+            for (const node* n : chain) visit(n->serialized);
+        }
+
+        // The history as a JSON array, assembled from each message's cached serialization
+        std::string serialize() const {
+            size_t bytes = 2;
+            for (const node* n = tail.get(); n; n = n->parent.get()) bytes += n->serialized.size() + 1;
+            std::string out;
+            out.reserve(bytes);
+            out.push_back('[');
+            for_each_serialized([&](const std::string& message) {
+                if (out.size() > 1) out.push_back(',');
+                out += message;
+            });
+            out.push_back(']');
+            return out;
+        }
+
+        // Serializes request with this history as its "messages" field, without dumping the history again
+        std::string splice_into(const json& request) const {
+            std::string rest = request.dump();
+            std::string body = "{\"messages\":" + serialize();
+            if (rest.size() > 2) body += "," + rest.substr(1);
+            else body += "}";
+            return body;
         }
     };
 
@@ -155,6 +308,13 @@ namespace ollama {
         const json& as_json() const {
             return json_data;
         }
+
+        std::vector<std::vector<float>> as_embeddings() const {
+            std::vector<std::vector<float>> embeddings;
+            if (valid && json_data.contains("embeddings"))
+                embeddings = json_data["embeddings"].get<std::vector<std::vector<float>>>();
+            return embeddings;
+        }
         
         bool has_error() const {
             return json_data.contains("error") && !json_data["error"].get<std::string>().empty();
@@ -196,56 +356,89 @@ public:
         this->cli->set_read_timeout(seconds, 0);
     }
 
+    // Keep connections open between requests; useful for long-lived processes such as termsaged
+    void setKeepAlive(bool on) {
+        this->cli->set_keep_alive(on);
+    }
+
+    // Gzip large request bodies; only useful when a proxy in front of Ollama decodes them
+    void setCompression(bool on) {
+        this->cli->set_compress(on, "gzip");
+    }
+
     bool is_running() {
         auto res = cli->Get("/");
-        if (res && res->status == 200 && res->body == "Ollama is running") return true;
+        if (ollama::succeeded(res) && res->body == "Ollama is running") return true;
         return false;
     }
 
     std::vector<std::string> list_running_models() {
         std::vector<std::string> models;
-        json json_response = running_model_json();
-        
-        for (auto& model : json_response["models"]) {
-            models.push_back(model["name"]);
-        }
+        for (auto& model : list_running_model_summaries()) models.push_back(std::move(model.name));
         return models;
     }
 
+    // Scans /api/ps as it arrives, keeping only the fields in model_summary
+    std::vector<ollama::model_summary> list_running_model_summaries() {
+        return scan_model_list("/api/ps", "No response returned from server when querying running models");
+    }
+
     json running_model_json() {
         json models;
         auto res = cli->Get("/api/ps");
         
-        if (res && res->status == 200) {
+        if (ollama::succeeded(res)) {
             if (ollama::log_replies) std::cout << res->body << std::endl;
             models = json::parse(res->body);
         } else { 
             if (ollama::use_exceptions) 
-                throw ollama::exception("No response returned from server when querying running models");
+                throw ollama::transport_exception("No response returned from server when querying running models", res);
         }
         return models;
     }
 
     std::vector<std::string> list_models() {
         std::vector<std::string> models;
-        json json_response = list_model_json();
-        
-        for (auto& model : json_response["models"]) {
-            models.push_back(model["name"]);
-        }
+        for (auto& model : list_model_summaries()) models.push_back(std::move(model.name));
+        return models;
+    }
+
+    // Scans /api/tags as it arrives, keeping only the fields in model_summary
+    std::vector<ollama::model_summary> list_model_summaries() {
+        auto models = scan_model_list("/api/tags", "No response returned from server when querying model list");
+        remember_digests(models);
         return models;
     }
 
+    // Architecture, family, size and context window from /api/show, skipping the bulky parts of the reply
+    ollama::model_details show_model(const std::string& model) {
+        ollama::model_details details;
+        auto scanner = ollama::make_model_details_scanner(details);
+        json request = {{"model", model}};
+        auto res = this->cli->Post("/api/show", request.dump(), "application/json", [&](const char* data, size_t length) {
+            if (ollama::log_replies) std::cout.write(data, static_cast<std::streamsize>(length));
+            return scanner.feed(data, length);
+        });
+
+        if (!ollama::succeeded(res) && !scanner_stopped(res)) {
+            if (ollama::use_exceptions)
+                throw ollama::transport_exception("No response returned from server when querying model " + model, res);
+        } else if (!scanner.finished() && ollama::use_exceptions) {
+            throw ollama::invalid_json_exception("Malformed reply from /api/show for model " + model);
+        }
+        return details;
+    }
+
     json list_model_json() {
         json models;
         auto res = cli->Get("/api/tags");
         
-        if (res && res->status == 200) {
+        if (ollama::succeeded(res)) {
             if (ollama::log_replies) std::cout << res->body << std::endl;
             models = json::parse(res->body);
         } else { 
             if (ollama::use_exceptions) 
-                throw ollama::exception("No response returned from server when querying model list");
+                throw ollama::transport_exception("No response returned from server when querying model list", res);
         }
         return models;
     }
@@ -259,13 +452,13 @@ public:
         // Send a blank request with the model name to instruct ollama to load the model into memory.
         auto res = this->cli->Post("/api/generate", request_string, "application/json");
         
-        if (res && res->status == 200) {
+        if (ollama::succeeded(res)) {
             if (ollama::log_replies) std::cout << res->body << std::endl;
             json response = json::parse(res->body);
             return response["done"];
         } else { 
             if (ollama::use_exceptions) 
-                throw ollama::exception("No response returned from server when loading model");
+                throw ollama::transport_exception("No response returned from server when loading model", res);
         }
         return false;
     }
@@ -273,10 +466,14 @@ public:
     ollama::response chat(const std::string& model, const ollama::messages& messages, json options=nullptr) {
         ollama::response response;
 
+        cache_lookup lookup;
+        if (auto cached = lookup_caches(model, messages, options, lookup)) {
+            return ollama::response(*cached, ollama::message_type::chat);
+        }
+
         // Create request object
         json request;
         request["model"] = model;
-        request["messages"] = json(messages.get_messages());
         request["stream"] = false;
         
         if (options != nullptr) {
@@ -285,32 +482,287 @@ public:
             }
         }
         
-        std::string request_string = request.dump();
+        std::string request_string = messages.splice_into(request);
         if (ollama::log_requests) std::cout << request_string << std::endl;
 
         auto res = this->cli->Post("/api/chat", request_string, "application/json");
         
-        if (res && res->status == 200) {
+        if (ollama::succeeded(res)) {
             if (ollama::log_replies) std::cout << res->body << std::endl;
             response = ollama::response(res->body, ollama::message_type::chat);
             
             if (response.has_error()) { 
                 if (ollama::use_exceptions) 
                     throw ollama::exception("Ollama response returned error: " + response.get_error());
+            } else {
+                store_caches(model, lookup, res->body);
             }
         } else {
             if (ollama::use_exceptions) 
-                throw ollama::exception("No response returned from server " + this->server_url);
+                throw ollama::transport_exception("No response returned from server " + this->server_url, res);
+        }
+
+        return response;
+    }
+
+    // Streaming chat; on_receive_token is called once per partial response and may return false to stop
+    bool chat(const std::string& model, const ollama::messages& messages,
+              std::function<bool(const ollama::response&)> on_receive_token, json options=nullptr) {
+        cache_lookup lookup;
+        if (auto cached = lookup_caches(model, messages, options, lookup)) {
+            replay_stream(*cached, on_receive_token);
+            return true;
+        }
+
+        json request;
+        request["model"] = model;
+        request["stream"] = true;
+
+        if (options != nullptr) {
+            for (auto& item : options.items()) {
+                request[item.key()] = item.value();
+            }
+        }
+
+        std::string request_string = messages.splice_into(request);
+        if (ollama::log_requests) std::cout << request_string << std::endl;
+
+        // Ollama streams newline-delimited JSON; a line may span several network reads
+        std::string partial;
+        std::string content;
+        bool completed = false;
+        auto stream_callback = [&](const char* data, size_t data_length) -> bool {
+            partial.append(data, data_length);
+            size_t line_end;
+            while ((line_end = partial.find('\n')) != std::string::npos) {
+                std::string line = partial.substr(0, line_end);
+                partial.erase(0, line_end + 1);
+                if (line.empty()) continue;
+                if (ollama::log_replies) std::cout << line << std::endl;
+
+                ollama::response response(line, ollama::message_type::chat);
+                if (response.has_error()) {
+                    if (ollama::use_exceptions)
+                        throw ollama::exception("Ollama response returned error: " + response.get_error());
+                    return false;
+                }
+
+                content += response.as_simple_string();
+                if (response.as_json().value("done", false)) {
+                    completed = true;
+                    // Cache the same shape a non-streaming request would have returned
+                    json full = response.as_json();
+                    full["message"]["role"] = "assistant";
+                    full["message"]["content"] = content;
+                    store_caches(model, lookup, full.dump());
+                }
+                if (!on_receive_token(response)) return false;
+            }
+            return true;
+        };
+
+        auto res = this->cli->Post("/api/chat", request_string, "application/json", stream_callback);
+        if (ollama::succeeded(res) || completed) return true;
+        if (res && res->status == 200 && res->error == httplib::Error::Canceled) return true; // Stopped by the callback
+
+        if (ollama::use_exceptions)
+            throw ollama::transport_exception("No response returned from server " + this->server_url, res);
+        return false;
+    }
+
+    // input may be a single string or an array of strings embedded in one request
+    ollama::response generate_embeddings(const std::string& model, const json& input, json options=nullptr) {
+        ollama::response response;
+
+        json request;
+        request["model"] = model;
+        request["input"] = input;
+
+        if (options != nullptr) {
+            for (auto& item : options.items()) {
+                request[item.key()] = item.value();
+            }
+        }
+
+        std::string request_string = request.dump();
+        if (ollama::log_requests) std::cout << request_string << std::endl;
+
+        auto res = this->cli->Post("/api/embed", request_string, "application/json");
+
+        if (ollama::succeeded(res)) {
+            if (ollama::log_replies) std::cout << res->body << std::endl;
+            response = ollama::response(res->body, ollama::message_type::embedding);
+
+            if (response.has_error()) {
+                if (ollama::use_exceptions)
+                    throw ollama::exception("Error returned from ollama when generating embeddings: " + response.get_error());
+            }
+        } else {
+            if (ollama::use_exceptions)
+                throw ollama::transport_exception("No response returned from server when generating embeddings", res);
         }
 
         return response;
     }
 
+    void set_response_cache(std::shared_ptr<ollama::response_cache> cache) {
+        this->response_cache = std::move(cache);
+    }
+
+    // Opt-in: every chat then costs one embedding request for the latest prompt
+    void set_semantic_cache(std::shared_ptr<ollama::semantic_cache> cache) {
+        this->semantic_cache = std::move(cache);
+    }
+
+    // Digest of the named model, so cache keys change when a tag is re-pulled. Digests are
+    // trusted for digest_ttl and replaced whenever /api/tags is listed, so a long-running
+    // process notices a re-pull within a minute.
+    std::string model_digest(const std::string& model) {
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(this->digest_mutex);
+            auto it = this->model_digests.find(model);
+            if (it != this->model_digests.end() && now - it->second.fetched < digest_ttl) return it->second.digest;
+        }
+
+        try {
+            list_model_summaries();
+        } catch (const std::exception&) {
+            // Fall back to the model name below
+        }
+
+        std::lock_guard<std::mutex> lock(this->digest_mutex);
+        auto it = this->model_digests.find(model);
+        if (it == this->model_digests.end() || now - it->second.fetched >= digest_ttl) {
+            // Not installed or the server is unreachable; retry after the same interval
+            this->model_digests[model] = {model, now};
+            return model;
+        }
+        return it->second.digest;
+    }
+
+    // Canonical hash of a chat request: model digest, history and options (minus "stream")
+    ollama::cache_key request_key(const std::string& model, const ollama::messages& messages, const json& options = nullptr) {
+        return ollama::response_cache::key_for_history(model_digest(model), messages, options);
+    }
+
     // Include other methods as needed
 
 private:
+    std::vector<ollama::model_summary> scan_model_list(const std::string& path, const std::string& failure) {
+        std::vector<ollama::model_summary> models;
+        auto scanner = ollama::make_model_list_scanner(models);
+        auto res = this->cli->Get(path, [&](const char* data, size_t length) {
+            if (ollama::log_replies) std::cout.write(data, static_cast<std::streamsize>(length));
+            return scanner.feed(data, length);
+        });
+
+        if (!ollama::succeeded(res) && !scanner_stopped(res)) {
+            if (ollama::use_exceptions) throw ollama::transport_exception(failure, res);
+        } else if (!scanner.finished() && ollama::use_exceptions) {
+            throw ollama::invalid_json_exception("Malformed reply from " + path);
+        }
+        return models;
+    }
+
+    void remember_digests(const std::vector<ollama::model_summary>& models) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(this->digest_mutex);
+        for (const auto& entry : models) {
+            if (entry.digest.empty()) continue;
+            this->model_digests[entry.name] = {entry.digest, now};
+            // Callers often omit ":latest"
+            if (entry.name.size() > 7 && entry.name.compare(entry.name.size() - 7, 7, ":latest") == 0)
+                this->model_digests[entry.name.substr(0, entry.name.size() - 7)] = {entry.digest, now};
+        }
+    }
+
+    // The scanner cancels the transfer when it meets malformed JSON
+    static bool scanner_stopped(const std::shared_ptr<httplib::Response>& res) {
+        return res && res->status == 200 && res->error == httplib::Error::Canceled;
+    }
+
+    // What the caches need to remember between lookup and storing the reply
+    struct cache_lookup {
+        bool exact = false;
+        ollama::cache_key key;
+        bool semantic = false;
+        std::string digest;
+        uint64_t context = 0;
+        std::string prompt;
+        std::vector<float> embedding;
+    };
+
+    std::optional<std::string> lookup_caches(const std::string& model, const ollama::messages& messages,
+                                             const json& options, cache_lookup& lookup) {
+        // Deterministic requests may be answered from the exact-match cache
+        if (this->response_cache && ollama::response_cache::is_deterministic(options)) {
+            lookup.exact = true;
+            lookup.key = request_key(model, messages, options);
+            if (auto cached = this->response_cache->get(lookup.key)) return cached;
+        }
+
+        if (!this->semantic_cache || messages.empty()) return std::nullopt;
+        const json& last = messages.back();
+        if (last.value("role", "") != "user") return std::nullopt;
+
+        // Embedding failures simply bypass the semantic cache
+        try {
+            auto embeddings = generate_embeddings(this->semantic_cache->config().embedding_model,
+                                                  last.value("content", "")).as_embeddings();
+            if (embeddings.empty()) return std::nullopt;
+            lookup.semantic = true;
+            lookup.digest = model_digest(model);
+            lookup.context = ollama::semantic_cache::context_hash(messages);
+            lookup.prompt = last.value("content", "");
+            lookup.embedding = std::move(embeddings.front());
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+        return this->semantic_cache->lookup(model, lookup.digest, lookup.context, lookup.prompt, lookup.embedding);
+    }
+
+    void store_caches(const std::string& model, const cache_lookup& lookup, const std::string& body) {
+        if (lookup.exact) this->response_cache->put(lookup.key, body);
+        if (lookup.semantic)
+            this->semantic_cache->insert(model, lookup.digest, lookup.context, lookup.prompt, lookup.embedding, body);
+    }
+
+    // Feeds a cached reply to a streaming callback as a sequence of word-sized partial responses
+    static void replay_stream(const std::string& cached, const std::function<bool(const ollama::response&)>& on_receive_token) {
+        json full = json::parse(cached);
+        std::string content = full["message"].value("content", "");
+
+        json partial;
+        partial["model"] = full.value("model", "");
+        partial["created_at"] = full.value("created_at", "");
+        partial["message"] = {{"role", "assistant"}, {"content", ""}};
+        partial["done"] = false;
+
+        size_t start = 0;
+        while (start < content.size()) {
+            size_t end = content.find(' ', start + 1);
+            end = (end == std::string::npos) ? content.size() : end;
+            partial["message"]["content"] = content.substr(start, end - start);
+            if (!on_receive_token(ollama::response(partial.dump(), ollama::message_type::chat))) return;
+            start = end;
+        }
+
+        full["message"]["content"] = "";
+        on_receive_token(ollama::response(full.dump(), ollama::message_type::chat));
+    }
+
     std::string server_url;
     httplib::Client* cli;
+    std::shared_ptr<ollama::response_cache> response_cache;
+    std::shared_ptr<ollama::semantic_cache> semantic_cache;
+    struct digest_entry {
+        std::string digest;
+        std::chrono::steady_clock::time_point fetched;
+    };
+    static constexpr std::chrono::seconds digest_ttl{60};
+    std::map<std::string, digest_entry> model_digests;
+    std::mutex digest_mutex;
 };
 
 #endif // OLLAMA_HPP 
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef JSON_STREAM_SCANNER_HPP
+#define JSON_STREAM_SCANNER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace ollama {
+
+    // One level of the path to a value: an object key, or a position in an array
+    struct json_path_step {
+        std::string key;
+        size_t index = 0;
+        bool in_array = false;
+    };
+    using json_path = std::vector<json_path_step>;
+
+    // Push-style JSON scanner for pulling a few fields out of large responses as the bytes
+    // arrive. No document is built: scalars are reported with their path, and only those
+    // the capture filter asks for are copied out at all.
+    class json_stream_scanner {
+    public:
+        using capture_filter = std::function<bool(const json_path&)>;
+        using value_handler = std::function<void(const json_path&, const std::string& value, bool is_string)>;
+
+        json_stream_scanner(capture_filter capture, value_handler on_value)
+            : capture(std::move(capture)), on_value(std::move(on_value)) {}
+
+        // False once the input is malformed; the scanner then ignores further data
+        bool feed(const char* data, size_t length) {
+            for (size_t i = 0; i < length && !failed; i++) {
+                if (!step(data[i])) failed = true;
+            }
+            return !failed;
+        }
+
+        // True after the top-level value has been closed
+        bool finished() const { return state == state_t::done; }
+
+    private:
+        enum class state_t { value, key, colon, after_value, string, escape, unicode, literal, done };
+
+        bool step(char c) {
+            switch (state) {
+            case state_t::string: return in_string(c);
+            case state_t::escape: return in_escape(c);
+            case state_t::unicode: return in_unicode(c);
+            case state_t::literal:
+                if (is_delimiter(c)) {
+                    finish_scalar(false);
+                    return step(c);
+                }
+                if (capturing) text.push_back(c);
+                return true;
+            default: break;
+            }
+
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') return true;
+
+            switch (state) {
+            case state_t::value:
+                if (c == ']' && !containers.empty() && containers.back() == '[') return close('[');
+                return begin_value(c);
+            case state_t::key:
+                if (c == '}') return close('{');
+                if (c != '"') return false;
+                begin_string(true);
+                return true;
+            case state_t::colon:
+                if (c != ':') return false;
+                state = state_t::value;
+                return true;
+            case state_t::after_value:
+                if (c == ',') {
+                    if (containers.back() == '[') {
+                        path.back().index++;
+                        state = state_t::value;
+                    } else {
+                        state = state_t::key;
+                    }
+                    return true;
+                }
+                if (c == ']' || c == '}') return close(c == ']' ? '[' : '{');
+                return false;
+            default:
+                return false;
+            }
+        }
+
+        bool begin_value(char c) {
+            if (c == '{' || c == '[') {
+                containers.push_back(c);
+                json_path_step next;
+                next.in_array = c == '[';
+                path.push_back(next);
+                state = c == '{' ? state_t::key : state_t::value;
+                return true;
+            }
+            if (c == '"') {
+                begin_string(false);
+                return true;
+            }
+            if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+                capturing = capture(path);
+                text.clear();
+                if (capturing) text.push_back(c);
+                state = state_t::literal;
+                return true;
+            }
+            return false;
+        }
+
+        bool close(char opener) {
+            if (containers.empty() || containers.back() != opener) return false;
+            containers.pop_back();
+            path.pop_back();
+            state = containers.empty() ? state_t::done : state_t::after_value;
+            return true;
+        }
+
+        void begin_string(bool key) {
+            reading_key = key;
+            capturing = key || capture(path);
+            text.clear();
+            state = state_t::string;
+        }
+
+        bool in_string(char c) {
+            if (c == '"') {
+                if (reading_key) {
+                    path.back().key = text;
+                    state = state_t::colon;
+                } else {
+                    finish_scalar(true);
+                }
+                return true;
+            }
+            if (c == '\\') {
+                state = state_t::escape;
+                return true;
+            }
+            if (capturing) text.push_back(c);
+            return true;
+        }
+
+        bool in_escape(char c) {
+            char decoded;
+            switch (c) {
+            case '"': decoded = '"'; break;
+            case '\\': decoded = '\\'; break;
+            case '/': decoded = '/'; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u':
+                code_unit = 0;
+                hex_digits = 0;
+                state = state_t::unicode;
+                return true;
+            default: return false;
+            }
+            if (capturing) text.push_back(decoded);
+            state = state_t::string;
+            return true;
+        }
+
+        bool in_unicode(char c) {
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return false;
+
+            code_unit = (code_unit << 4) | static_cast<uint32_t>(digit);
+            if (++hex_digits < 4) return true;
+
+            state = state_t::string;
+            if (code_unit >= 0xD800 && code_unit <= 0xDBFF) {
+                high_surrogate = code_unit;
+                return true;
+            }
+            uint32_t code_point = code_unit;
+            if (code_unit >= 0xDC00 && code_unit <= 0xDFFF && high_surrogate) {
+                code_point = 0x10000 + ((high_surrogate - 0xD800) << 10) + (code_unit - 0xDC00);
+            }
+            high_surrogate = 0;
+            if (capturing) append_utf8(code_point);
+            return true;
+        }
+
+        void append_utf8(uint32_t cp) {
+            if (cp < 0x80) {
+                text.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                text.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else if (cp < 0x10000) {
+                text.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                text.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else {
+                text.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                text.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                text.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        void finish_scalar(bool is_string) {
+            if (capturing) on_value(path, text, is_string);
+            state = containers.empty() ? state_t::done : state_t::after_value;
+        }
+
+        static bool is_delimiter(char c) {
+            return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        capture_filter capture;
+        value_handler on_value;
+
+        state_t state = state_t::value;
+        std::vector<char> containers;
+        json_path path;
+        std::string text;
+        bool reading_key = false;
+        bool capturing = false;
+        bool failed = false;
+        uint32_t code_unit = 0;
+        uint32_t high_surrogate = 0;
+        int hex_digits = 0;
+    };
+}
+
+#endif // JSON_STREAM_SCANNER_HPP
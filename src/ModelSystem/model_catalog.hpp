@@ -0,0 +1,267 @@
+#ifndef MODEL_CATALOG_HPP
+#define MODEL_CATALOG_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <optional>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+#include "model_info.hpp"
+
+namespace termsage {
+
+    // What TermSage knows about an installed model without asking the server
+    struct catalog_entry {
+        ollama::model_summary summary;
+        ollama::model_details details;
+    };
+
+    // $XDG_CACHE_HOME/termsage/models.bin, falling back to ~/.cache
+    inline std::string default_catalog_path() {
+        std::string base;
+        if (const char* cache = std::getenv("XDG_CACHE_HOME")) base = cache;
+        else if (const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+        else return "termsage_models.bin";
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        return base + "/models.bin";
+    }
+
+    // Persisted list of installed models with their /api/show metadata.
+    // The cached copy is shown at startup while refresh() checks the server in the
+    // background; /api/show is only called again for models whose digest changed.
+    class model_catalog {
+    public:
+        explicit model_catalog(std::string path = default_catalog_path()) : path(std::move(path)) {
+            load();
+        }
+
+        ~model_catalog() { wait(); }
+
+        model_catalog(const model_catalog&) = delete;
+        model_catalog& operator=(const model_catalog&) = delete;
+
+        std::vector<catalog_entry> entries() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return models;
+        }
+
+        bool empty() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return models.empty();
+        }
+
+        // Accepts "name" for "name:latest" as Ollama does
+        std::optional<catalog_entry> find(const std::string& name) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& entry : models) {
+                if (entry.summary.name == name || entry.summary.name == name + ":latest") return entry;
+            }
+            return std::nullopt;
+        }
+
+        // Re-lists models, fetches details for new or re-pulled ones and saves; true if anything changed
+        bool refresh(Ollama& ollama) {
+            return refresh(std::vector<Ollama*>{&ollama});
+        }
+
+        // The union of every reachable server's models; a name listed by several keeps the first
+        // server's entry. Throws only when no server could be listed.
+        bool refresh(const std::vector<Ollama*>& servers) {
+            std::vector<ollama::model_summary> listed;
+            std::vector<Ollama*> listed_by;
+            std::set<std::string> names;
+            std::optional<ollama::exception> failure;
+            size_t reached = 0;
+            for (Ollama* server : servers) {
+                try {
+                    for (auto& summary : server->list_model_summaries()) {
+                        if (!names.insert(summary.name).second) continue;
+                        listed.push_back(std::move(summary));
+                        listed_by.push_back(server);
+                    }
+                    reached++;
+                } catch (const ollama::exception& e) {
+                    failure = e;
+                }
+            }
+            if (reached == 0 && failure) throw *failure;
+
+            std::map<std::string, catalog_entry> known;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const auto& entry : models) known[entry.summary.name] = entry;
+            }
+
+            bool changed = listed.size() != known.size();
+            std::vector<catalog_entry> updated;
+            updated.reserve(listed.size());
+            for (size_t i = 0; i < listed.size(); i++) {
+                auto& summary = listed[i];
+                catalog_entry entry;
+                auto it = known.find(summary.name);
+                if (it != known.end() && it->second.summary.digest == summary.digest && !summary.digest.empty()) {
+                    entry.details = it->second.details;
+                } else {
+                    changed = true;
+                    try {
+                        entry.details = listed_by[i]->show_model(summary.name);
+                    } catch (const ollama::exception&) {
+                        // Keep the listing even if one model's details are unavailable
+                    }
+                }
+                if (it != known.end() && it->second.summary.modified_at != summary.modified_at) changed = true;
+                entry.summary = std::move(summary);
+                updated.push_back(std::move(entry));
+            }
+
+            if (!changed) return false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                models = updated;
+            }
+            save(updated);
+            return true;
+        }
+
+        // Runs refresh() on a worker thread; errors leave the cached catalog in place
+        void refresh_in_background(Ollama& ollama) {
+            refresh_in_background(std::vector<Ollama*>{&ollama});
+        }
+
+        void refresh_in_background(std::vector<Ollama*> servers) {
+            wait();
+            refreshing = true;
+            worker = std::thread([this, servers = std::move(servers)]() {
+                try {
+                    refresh(servers);
+                } catch (const std::exception&) {
+                    // Server unreachable; the next launch tries again
+                }
+                refreshing = false;
+            });
+        }
+
+        bool is_refreshing() const { return refreshing; }
+
+        void wait() {
+            if (worker.joinable()) worker.join();
+        }
+
+    private:
+        static constexpr char magic[8] = {'T', 'S', 'M', 'C', 'A', 'T', '0', '1'};
+
+        static void put_u64(std::string& out, uint64_t value) {
+            for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+
+        static void put_string(std::string& out, const std::string& value) {
+            uint32_t length = static_cast<uint32_t>(value.size());
+            for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((length >> (8 * i)) & 0xFF));
+            out += value;
+        }
+
+        static bool get_u64(const std::string& in, size_t& pos, uint64_t& value) {
+            if (in.size() - pos < 8) return false;
+            value = 0;
+            for (int i = 0; i < 8; i++) value |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos + i])) << (8 * i);
+            pos += 8;
+            return true;
+        }
+
+        static bool get_string(const std::string& in, size_t& pos, std::string& value) {
+            if (in.size() - pos < 4) return false;
+            uint32_t length = 0;
+            for (int i = 0; i < 4; i++) length |= static_cast<uint32_t>(static_cast<unsigned char>(in[pos + i])) << (8 * i);
+            pos += 4;
+            if (in.size() - pos < length) return false;
+            value.assign(in, pos, length);
+            pos += length;
+            return true;
+        }
+
+        // Layout: magic, u64 count, entries, then an FNV-1a checksum of everything before it.
+        // Written to a temporary file and renamed so readers never see a partial catalog.
+        bool save(const std::vector<catalog_entry>& snapshot) const {
+            std::string data(magic, sizeof(magic));
+            put_u64(data, snapshot.size());
+            for (const auto& entry : snapshot) {
+                put_string(data, entry.summary.name);
+                put_string(data, entry.summary.digest);
+                put_u64(data, entry.summary.size);
+                put_string(data, entry.summary.modified_at);
+                put_string(data, entry.summary.family);
+                put_string(data, entry.summary.parameter_size);
+                put_string(data, entry.summary.quantization_level);
+                put_string(data, entry.details.architecture);
+                put_u64(data, entry.details.context_length);
+            }
+            put_u64(data, ollama::fnv1a_64(data.data(), data.size()));
+
+            std::string temporary = path + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size()))) return false;
+            }
+            return std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+
+        bool load() {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return false;
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if (data.size() < sizeof(magic) + 16 || memcmp(data.data(), magic, sizeof(magic)) != 0) return false;
+
+            size_t end = data.size() - 8;
+            size_t pos = end;
+            uint64_t checksum = 0;
+            if (!get_u64(data, pos, checksum) || checksum != ollama::fnv1a_64(data.data(), end)) return false;
+            data.resize(end);
+
+            pos = sizeof(magic);
+            uint64_t count = 0;
+            if (!get_u64(data, pos, count)) return false;
+
+            std::vector<catalog_entry> loaded;
+            for (uint64_t i = 0; i < count; i++) {
+                catalog_entry entry;
+                bool ok = get_string(data, pos, entry.summary.name) && get_string(data, pos, entry.summary.digest) &&
+                          get_u64(data, pos, entry.summary.size) && get_string(data, pos, entry.summary.modified_at) &&
+                          get_string(data, pos, entry.summary.family) && get_string(data, pos, entry.summary.parameter_size) &&
+                          get_string(data, pos, entry.summary.quantization_level) &&
+                          get_string(data, pos, entry.details.architecture) && get_u64(data, pos, entry.details.context_length);
+                if (!ok) return false;
+                entry.details.family = entry.summary.family;
+                entry.details.parameter_size = entry.summary.parameter_size;
+                entry.details.quantization_level = entry.summary.quantization_level;
+                loaded.push_back(std::move(entry));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            models = std::move(loaded);
+            return true;
+        }
+
+        std::string path;
+        mutable std::mutex mutex;
+        std::vector<catalog_entry> models;
+        std::thread worker;
+        std::atomic<bool> refreshing{false};
+    };
+}
+
+#endif // MODEL_CATALOG_HPP
@@ -0,0 +1,87 @@
+#ifndef MODEL_INFO_HPP
+#define MODEL_INFO_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#include "json_stream_scanner.hpp"
+
+namespace ollama {
+
+    // One entry of /api/tags or /api/ps, without the rest of the reply
+    struct model_summary {
+        std::string name;
+        std::string digest;
+        uint64_t size = 0;
+        std::string modified_at;
+        std::string family;
+        std::string parameter_size;
+        std::string quantization_level;
+    };
+
+    // The parts of /api/show that matter to a client; the modelfile, license and tensors are skipped
+    struct model_details {
+        std::string architecture;
+        std::string family;
+        std::string parameter_size;
+        std::string quantization_level;
+        uint64_t context_length = 0;
+    };
+
+    // Scans {"models": [{...}, ...]} into summaries as it streams
+    inline json_stream_scanner make_model_list_scanner(std::vector<model_summary>& models) {
+        auto wanted = [](const json_path& path) {
+            if (path.size() < 3 || path[0].key != "models" || !path[1].in_array) return false;
+            const std::string& key = path.back().key;
+            if (path.size() == 3)
+                return key == "name" || key == "digest" || key == "size" || key == "modified_at";
+            return path.size() == 4 && path[2].key == "details" &&
+                   (key == "family" || key == "parameter_size" || key == "quantization_level");
+        };
+
+        return json_stream_scanner(wanted, [&models](const json_path& path, const std::string& value, bool) {
+            size_t index = path[1].index;
+            if (models.size() <= index) models.resize(index + 1);
+            model_summary& model = models[index];
+
+            const std::string& key = path.back().key;
+            if (key == "name") model.name = value;
+            else if (key == "digest") model.digest = value;
+            else if (key == "size") model.size = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "modified_at") model.modified_at = value;
+            else if (key == "family") model.family = value;
+            else if (key == "parameter_size") model.parameter_size = value;
+            else if (key == "quantization_level") model.quantization_level = value;
+        });
+    }
+
+    // Scans an /api/show reply; the context length lives under model_info as "<architecture>.context_length"
+    inline json_stream_scanner make_model_details_scanner(model_details& details) {
+        auto wanted = [](const json_path& path) {
+            if (path.size() != 2) return false;
+            const std::string& key = path[1].key;
+            if (path[0].key == "details")
+                return key == "family" || key == "parameter_size" || key == "quantization_level";
+            if (path[0].key == "model_info") {
+                static const std::string suffix = ".context_length";
+                return key == "general.architecture" ||
+                       (key.size() > suffix.size() && key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0);
+            }
+            return false;
+        };
+
+        return json_stream_scanner(wanted, [&details](const json_path& path, const std::string& value, bool) {
+            const std::string& key = path[1].key;
+            if (key == "family") details.family = value;
+            else if (key == "parameter_size") details.parameter_size = value;
+            else if (key == "quantization_level") details.quantization_level = value;
+            else if (key == "general.architecture") details.architecture = value;
+            else if (details.context_length == 0 || key == details.architecture + ".context_length")
+                details.context_length = std::strtoull(value.c_str(), nullptr, 10);
+        });
+    }
+}
+
+#endif // MODEL_INFO_HPP
@@ -0,0 +1,290 @@
+#ifndef BACKEND_POOL_HPP
+#define BACKEND_POOL_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+
+namespace ollama {
+
+    struct backend_pool_options {
+        std::chrono::milliseconds health_interval = std::chrono::seconds(5);
+        int probe_timeout_seconds = 2;
+        int max_failures = 3;                                // Consecutive failures before ejection
+        std::chrono::milliseconds ejection_time = std::chrono::seconds(30);
+    };
+
+    struct backend_status {
+        std::string url;
+        bool healthy = true;
+        size_t outstanding = 0;
+        int failures = 0;
+        std::set<std::string> loaded_models;
+    };
+
+    // Routes requests across several Ollama servers.
+    // A backend that already has the model loaded (per /api/ps) is preferred, ties
+    // go to the fewest outstanding requests, and failing backends are ejected for
+    // a while before health checks let them back in.
+    class backend_pool {
+        struct backend;
+
+    public:
+        // Holds a backend for the duration of one request
+        class lease {
+        public:
+            lease() = default;
+            lease(backend_pool* pool, backend* target) : pool(pool), target(target) {}
+            lease(lease&& other) noexcept : pool(other.pool), target(other.target), failed(other.failed) {
+                other.target = nullptr;
+            }
+            lease& operator=(lease&& other) noexcept {
+                release();
+                pool = other.pool;
+                target = other.target;
+                failed = other.failed;
+                other.target = nullptr;
+                return *this;
+            }
+            ~lease() { release(); }
+
+            explicit operator bool() const { return target != nullptr; }
+            Ollama& client() const { return *target->client; }
+            const std::string& url() const { return target->url; }
+
+            // Marks the request as failed so the backend's failure count goes up
+            void fail() { failed = true; }
+
+        private:
+            void release() {
+                if (target) pool->release(*target, !failed);
+                target = nullptr;
+            }
+
+            backend_pool* pool = nullptr;
+            backend* target = nullptr;
+            bool failed = false;
+        };
+
+        explicit backend_pool(const std::vector<std::string>& urls, backend_pool_options options = backend_pool_options())
+            : options(options) {
+            for (const auto& url : urls) {
+                auto b = std::make_unique<backend>();
+                b->url = url;
+                b->client = std::make_unique<Ollama>(url);
+                b->probe = std::make_unique<Ollama>(url);
+                b->probe->setReadTimeout(options.probe_timeout_seconds);
+                backends.push_back(std::move(b));
+            }
+        }
+
+        ~backend_pool() { stop_health_checks(); }
+
+        backend_pool(const backend_pool&) = delete;
+        backend_pool& operator=(const backend_pool&) = delete;
+
+        // Every backend answers from the same cache; keys hold the model digest, not the server
+        void set_response_cache(std::shared_ptr<ollama::response_cache> cache) {
+            for (auto& b : backends) b->client->set_response_cache(cache);
+        }
+
+        void set_semantic_cache(std::shared_ptr<ollama::semantic_cache> cache) {
+            for (auto& b : backends) b->client->set_semantic_cache(cache);
+        }
+
+        // Probes every backend once: liveness via "/" and warm models via /api/ps. Returns the
+        // URLs that answered, in the order they were given.
+        std::vector<std::string> refresh() {
+            std::vector<std::string> alive_urls;
+            for (auto& b : backends) {
+                bool alive = false;
+                std::vector<std::string> running;
+                try {
+                    alive = b->probe->is_running();
+                    if (alive) running = b->probe->list_running_models();
+                } catch (const std::exception&) {
+                    alive = false;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (alive) {
+                    // Answering "/" says nothing about chat; an ejected backend serves out its time
+                    auto now = std::chrono::steady_clock::now();
+                    if (b->ejected_until != std::chrono::steady_clock::time_point{} && b->ejected_until <= now) {
+                        b->failures = 0;
+                        b->ejected_until = {};
+                    }
+                    b->loaded_models = std::set<std::string>(running.begin(), running.end());
+                    alive_urls.push_back(b->url);
+                } else {
+                    record_failure(*b);
+                }
+            }
+            return alive_urls;
+        }
+
+        void start_health_checks() {
+            if (health_thread.joinable()) return;
+            stopping = false;
+            health_thread = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(health_mutex);
+                while (!stopping) {
+                    lock.unlock();
+                    refresh();
+                    lock.lock();
+                    health_cv.wait_for(lock, options.health_interval, [this]() { return stopping.load(); });
+                }
+            });
+        }
+
+        void stop_health_checks() {
+            {
+                std::lock_guard<std::mutex> lock(health_mutex);
+                stopping = true;
+            }
+            health_cv.notify_all();
+            if (health_thread.joinable()) health_thread.join();
+        }
+
+        // Picks a backend for the model; the lease is empty when every backend is ejected or excluded
+        lease acquire(const std::string& model, const std::set<std::string>& exclude = {}) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto now = std::chrono::steady_clock::now();
+
+            backend* best = nullptr;
+            bool best_warm = false;
+            for (auto& b : backends) {
+                if (b->ejected_until > now || exclude.count(b->url)) continue;
+                bool warm = is_loaded(*b, model);
+                if (!best || (warm && !best_warm) || (warm == best_warm && b->outstanding < best->outstanding)) {
+                    best = b.get();
+                    best_warm = warm;
+                }
+            }
+            if (!best) return lease();
+
+            // The model will be resident there after this request
+            best->loaded_models.insert(model);
+            best->outstanding++;
+            return lease(this, best);
+        }
+
+        // Convenience wrapper; a failed backend is reported and the next candidate tried
+        ollama::response chat(const std::string& model, const ollama::messages& messages, json options = nullptr) {
+            std::string last_error = "No healthy Ollama backend available";
+            std::set<std::string> tried;
+            for (size_t attempt = 0; attempt < backends.size(); attempt++) {
+                lease l = acquire(model, tried);
+                if (!l) break;
+                tried.insert(l.url());
+                try {
+                    auto response = l.client().chat(model, messages, options);
+                    if (response.as_json().is_null()) {
+                        l.fail();
+                        continue;
+                    }
+                    return response;
+                } catch (const ollama::exception& e) {
+                    last_error = e.what();
+                    l.fail();
+                }
+            }
+            if (ollama::use_exceptions) throw ollama::exception(last_error);
+            return ollama::response();
+        }
+
+        // Streaming form; fails over to the next backend only while no token has been delivered
+        bool chat(const std::string& model, const ollama::messages& messages,
+                  std::function<bool(const ollama::response&)> on_receive_token, json options = nullptr) {
+            std::string last_error = "No healthy Ollama backend available";
+            std::set<std::string> tried;
+            bool received = false;
+            auto forward = [&](const ollama::response& response) {
+                received = true;
+                return on_receive_token(response);
+            };
+            for (size_t attempt = 0; attempt < backends.size(); attempt++) {
+                lease l = acquire(model, tried);
+                if (!l) break;
+                tried.insert(l.url());
+                try {
+                    return l.client().chat(model, messages, forward, options);
+                } catch (const ollama::exception& e) {
+                    last_error = e.what();
+                    l.fail();
+                    if (received) throw;
+                }
+            }
+            if (ollama::use_exceptions) throw ollama::exception(last_error);
+            return false;
+        }
+
+        std::vector<backend_status> status() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<backend_status> result;
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& b : backends) {
+                backend_status s;
+                s.url = b->url;
+                s.healthy = b->ejected_until <= now;
+                s.outstanding = b->outstanding;
+                s.failures = b->failures;
+                s.loaded_models = b->loaded_models;
+                result.push_back(std::move(s));
+            }
+            return result;
+        }
+
+    private:
+        struct backend {
+            std::string url;
+            std::unique_ptr<Ollama> client;
+            std::unique_ptr<Ollama> probe;   // Short timeout, used only for health checks
+            size_t outstanding = 0;
+            int failures = 0;
+            std::chrono::steady_clock::time_point ejected_until{};
+            std::set<std::string> loaded_models;
+        };
+
+        // /api/ps reports "name:tag"; callers often omit ":latest"
+        static bool is_loaded(const backend& b, const std::string& model) {
+            return b.loaded_models.count(model) || b.loaded_models.count(model + ":latest");
+        }
+
+        void record_failure(backend& b) {
+            if (++b.failures >= options.max_failures) {
+                b.ejected_until = std::chrono::steady_clock::now() + options.ejection_time;
+                b.loaded_models.clear();
+            }
+        }
+
+        void release(backend& b, bool succeeded) {
+            std::lock_guard<std::mutex> lock(mutex);
+            b.outstanding--;
+            if (succeeded) {
+                b.failures = 0;
+            } else {
+                record_failure(b);
+            }
+        }
+
+        backend_pool_options options;
+        std::vector<std::unique_ptr<backend>> backends;
+        mutable std::mutex mutex;
+
+        std::thread health_thread;
+        std::mutex health_mutex;
+        std::condition_variable health_cv;
+        std::atomic<bool> stopping{false};
+    };
+}
+
+#endif // BACKEND_POOL_HPP
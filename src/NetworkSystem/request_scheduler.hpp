@@ -0,0 +1,261 @@
+#ifndef REQUEST_SCHEDULER_HPP
+#define REQUEST_SCHEDULER_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+
+namespace ollama {
+
+    enum class priority_class { interactive = 0, autocomplete, batch, background_index };
+
+    inline const char* to_string(priority_class cls) {
+        switch (cls) {
+        case priority_class::interactive: return "interactive";
+        case priority_class::autocomplete: return "autocomplete";
+        case priority_class::batch: return "batch";
+        case priority_class::background_index: return "background-index";
+        }
+        return "batch";
+    }
+
+    inline priority_class priority_from_string(const std::string& name) {
+        if (name == "interactive") return priority_class::interactive;
+        if (name == "autocomplete") return priority_class::autocomplete;
+        if (name == "background-index" || name == "background_index") return priority_class::background_index;
+        return priority_class::batch;
+    }
+
+    struct scheduler_options {
+        size_t server_parallelism = 4;                    // Matches OLLAMA_NUM_PARALLEL on the server
+        size_t reserved_interactive = 1;                  // Slots other classes may never occupy
+        std::array<double, 4> weights = {8.0, 4.0, 2.0, 1.0};
+        std::array<size_t, 4> max_queued = {64, 64, 1024, 4096};
+        size_t default_cost = 512;                        // Tokens assumed when num_predict is not set
+    };
+
+    // Client-side admission control and weighted fair queuing for Ollama requests.
+    // At most server_parallelism requests run at once. Each class gets capacity in
+    // proportion to its weight; within a class, shorter jobs (by num_predict) go
+    // first and clients (flows) take turns.
+    class request_scheduler {
+        struct waiter;
+
+    public:
+        // An admitted request; releasing it frees the slot
+        class ticket {
+        public:
+            ticket() = default;
+            ticket(request_scheduler* scheduler) : scheduler(scheduler) {}
+            ticket(ticket&& other) noexcept : scheduler(other.scheduler) { other.scheduler = nullptr; }
+            ticket& operator=(ticket&& other) noexcept {
+                release();
+                scheduler = other.scheduler;
+                other.scheduler = nullptr;
+                return *this;
+            }
+            ~ticket() { release(); }
+
+            explicit operator bool() const { return scheduler != nullptr; }
+
+            void release() {
+                if (scheduler) scheduler->finish();
+                scheduler = nullptr;
+            }
+
+        private:
+            request_scheduler* scheduler = nullptr;
+        };
+
+        explicit request_scheduler(scheduler_options options = scheduler_options()) : options(options) {}
+
+        // Queued jobs are dropped and blocked acquire() calls return empty tickets; running jobs finish
+        ~request_scheduler() {
+            std::unique_lock<std::mutex> lock(mutex);
+            closing = true;
+            for (auto& w : pending) w->cv.notify_one();
+            pending.clear();
+            queued.fill(0);
+            idle.wait(lock, [this]() { return running == 0 && acquiring == 0; });
+        }
+
+        request_scheduler(const request_scheduler&) = delete;
+        request_scheduler& operator=(const request_scheduler&) = delete;
+
+        // Blocks until admitted; the ticket is empty if the class queue is full or the scheduler is closing
+        ticket acquire(priority_class cls, size_t cost, uint64_t flow = 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto w = enqueue(cls, cost, flow, nullptr);
+            if (!w) return ticket();
+            dispatch();
+            acquiring++;
+            w->cv.wait(lock, [&]() { return w->granted || closing; });
+            acquiring--;
+            if (!w->granted) {
+                idle.notify_all();
+                return ticket();
+            }
+            return ticket(this);
+        }
+
+        // Runs task on its own thread once admitted; false if the class queue is full
+        bool submit(priority_class cls, size_t cost, uint64_t flow, std::function<void()> task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!enqueue(cls, cost, flow, std::move(task))) return false;
+            dispatch();
+            return true;
+        }
+
+        // Estimated generation length taken from num_predict in the request options
+        size_t estimate_cost(const json& options) const {
+            if (options.is_object()) {
+                const json& params = options.contains("options") && options["options"].is_object() ? options["options"] : options;
+                if (params.contains("num_predict") && params["num_predict"].is_number_integer()) {
+                    auto n = params["num_predict"].get<long long>();
+                    if (n > 0) return static_cast<size_t>(n);
+                }
+            }
+            return this->options.default_cost;
+        }
+
+        // Drops fairness history for a flow that will not submit again
+        void forget_flow(uint64_t flow) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int c = 0; c < 4; c++) served.erase({c, flow});
+        }
+
+        size_t running_count() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return running;
+        }
+
+        size_t queued_count(priority_class cls) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return queued[static_cast<size_t>(cls)];
+        }
+
+    private:
+        struct waiter {
+            priority_class cls;
+            size_t cost;
+            uint64_t flow;
+            uint64_t sequence;
+            std::function<void()> task;
+            std::condition_variable cv;
+            bool granted = false;
+        };
+
+        std::shared_ptr<waiter> enqueue(priority_class cls, size_t cost, uint64_t flow, std::function<void()> task) {
+            size_t index = static_cast<size_t>(cls);
+            if (closing || queued[index] >= options.max_queued[index]) return nullptr;
+
+            auto w = std::make_shared<waiter>();
+            w->cls = cls;
+            w->cost = std::max<size_t>(1, cost);
+            w->flow = flow;
+            w->sequence = next_sequence++;
+            w->task = std::move(task);
+            pending.push_back(w);
+            queued[index]++;
+            return w;
+        }
+
+        // Jobs within a class: shorter size bucket first, then the flow served least, then arrival
+        bool before(const waiter& a, const waiter& b) const {
+            auto bucket = [](size_t cost) { size_t b = 0; while (cost >>= 1) b++; return b; };
+            size_t ba = bucket(a.cost), bb = bucket(b.cost);
+            if (ba != bb) return ba < bb;
+            uint64_t sa = served_count(a), sb = served_count(b);
+            if (sa != sb) return sa < sb;
+            return a.sequence < b.sequence;
+        }
+
+        uint64_t served_count(const waiter& w) const {
+            auto it = served.find({static_cast<int>(w.cls), w.flow});
+            return it == served.end() ? 0 : it->second;
+        }
+
+        // Grants free slots to the class heads with the smallest virtual finish tags
+        void dispatch() {
+            while (running < options.server_parallelism && !pending.empty()) {
+                std::array<std::ptrdiff_t, 4> heads;
+                heads.fill(-1);
+                for (size_t i = 0; i < pending.size(); i++) {
+                    auto& head = heads[static_cast<size_t>(pending[i]->cls)];
+                    if (head == -1 || before(*pending[i], *pending[static_cast<size_t>(head)])) head = static_cast<std::ptrdiff_t>(i);
+                }
+
+                bool shared_full = running + options.reserved_interactive >= options.server_parallelism;
+                std::ptrdiff_t chosen = -1;
+                double chosen_tag = 0.0;
+                for (size_t c = 0; c < heads.size(); c++) {
+                    if (heads[c] == -1) continue;
+                    if (c != static_cast<size_t>(priority_class::interactive) && shared_full) continue;
+
+                    const waiter& w = *pending[static_cast<size_t>(heads[c])];
+                    double tag = std::max(class_finish[c], virtual_time) + static_cast<double>(w.cost) / options.weights[c];
+                    if (chosen == -1 || tag < chosen_tag) {
+                        chosen = heads[c];
+                        chosen_tag = tag;
+                    }
+                }
+                if (chosen == -1) return; // Remaining slots are reserved for interactive requests
+
+                auto w = pending[static_cast<size_t>(chosen)];
+                pending.erase(pending.begin() + chosen);
+                size_t c = static_cast<size_t>(w->cls);
+                queued[c]--;
+                virtual_time = std::max(virtual_time, class_finish[c]);
+                class_finish[c] = chosen_tag;
+                served[{static_cast<int>(c), w->flow}]++;
+                running++;
+
+                if (w->task) {
+                    std::thread([this, task = std::move(w->task)]() {
+                        ticket slot(this);
+                        try {
+                            task();
+                        } catch (...) {
+                            // Tasks report their own errors; never let one take the process down
+                        }
+                    }).detach();
+                } else {
+                    w->granted = true;
+                    w->cv.notify_one();
+                }
+            }
+        }
+
+        void finish() {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            dispatch();
+            if (running == 0) idle.notify_all();
+        }
+
+        scheduler_options options;
+        mutable std::mutex mutex;
+        std::condition_variable idle;
+        std::vector<std::shared_ptr<waiter>> pending;
+        std::array<size_t, 4> queued = {0, 0, 0, 0};
+        std::array<double, 4> class_finish = {0.0, 0.0, 0.0, 0.0};
+        std::map<std::pair<int, uint64_t>, uint64_t> served;
+        double virtual_time = 0.0;
+        size_t running = 0;
+        size_t acquiring = 0;       // Threads blocked in acquire()
+        bool closing = false;
+        uint64_t next_sequence = 0;
+    };
+}
+
+#endif // REQUEST_SCHEDULER_HPP
@@ -0,0 +1,280 @@
+#ifndef RESILIENCE_HPP
+#define RESILIENCE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+
+namespace ollama {
+
+    struct resilience_options {
+        std::chrono::milliseconds deadline = std::chrono::seconds(30);     // Whole call including retries; 0 disables
+        int max_attempts = 3;
+        std::chrono::milliseconds base_backoff = std::chrono::milliseconds(100);
+        std::chrono::milliseconds max_backoff = std::chrono::seconds(2);
+        bool hedge_embeddings = true;
+        std::chrono::milliseconds hedge_delay = std::chrono::milliseconds(200);
+        int breaker_failure_threshold = 5;                                  // Consecutive failures that open the breaker
+        std::chrono::milliseconds breaker_cooldown = std::chrono::seconds(10);
+    };
+
+    // Generations can run for minutes, so streamed chats keep the retries and breaker but no overall deadline
+    inline resilience_options generation_resilience() {
+        resilience_options options;
+        options.deadline = std::chrono::milliseconds(0);
+        return options;
+    }
+
+    // Large embedding batches are slow by nature; hedging them would only double the load
+    inline resilience_options bulk_embedding_resilience() {
+        resilience_options options;
+        options.deadline = std::chrono::minutes(2);
+        options.hedge_embeddings = false;
+        return options;
+    }
+
+    // Thrown instead of contacting the server while the circuit breaker is open
+    class circuit_open_exception : public exception {
+    public:
+        circuit_open_exception(const std::string& message) : exception(message) {}
+    };
+
+    // Closed -> open after repeated failures; after the cooldown a single
+    // half-open trial decides whether to close again or re-open.
+    class circuit_breaker {
+    public:
+        enum class state { closed, open, half_open };
+
+        circuit_breaker(int failure_threshold, std::chrono::milliseconds cooldown)
+            : failure_threshold(failure_threshold), cooldown(cooldown) {}
+
+        bool allow() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (current == state::closed) return true;
+            if (current == state::open && std::chrono::steady_clock::now() >= opened_at + cooldown) {
+                current = state::half_open;
+                trial_in_flight = false;
+            }
+            if (current == state::half_open && !trial_in_flight) {
+                trial_in_flight = true;
+                return true;
+            }
+            return false;
+        }
+
+        void record_success() {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures = 0;
+            current = state::closed;
+            trial_in_flight = false;
+        }
+
+        void record_failure() {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures++;
+            if (current == state::half_open || failures >= failure_threshold) {
+                current = state::open;
+                opened_at = std::chrono::steady_clock::now();
+                trial_in_flight = false;
+            }
+        }
+
+        state get_state() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return current;
+        }
+
+    private:
+        int failure_threshold;
+        std::chrono::milliseconds cooldown;
+        state current = state::closed;
+        int failures = 0;
+        bool trial_in_flight = false;
+        std::chrono::steady_clock::time_point opened_at;
+        mutable std::mutex mutex;
+    };
+
+    // Wraps an Ollama client with deadlines, retries, hedging and a circuit breaker.
+    // Idempotent calls retry on any transport failure; chat only retries when the
+    // request cannot have reached the model (connection errors, HTTP 5xx).
+    class resilient_ollama {
+    public:
+        explicit resilient_ollama(Ollama& ollama, resilience_options options = resilience_options())
+            : ollama(ollama), options(options),
+              breaker(options.breaker_failure_threshold, options.breaker_cooldown),
+              rng(std::random_device{}()) {}
+
+        // Hedged requests may still be running; they reference the wrapped client
+        ~resilient_ollama() {
+            std::unique_lock<std::mutex> lock(hedge_mutex);
+            hedge_cv.wait(lock, [this]() { return hedges_in_flight == 0; });
+        }
+
+        resilient_ollama(const resilient_ollama&) = delete;
+        resilient_ollama& operator=(const resilient_ollama&) = delete;
+
+        ollama::response chat(const std::string& model, const ollama::messages& messages, json options = nullptr) {
+            return run<ollama::response>(false, [&]() { return ollama.chat(model, messages, options); });
+        }
+
+        // Retried only while no token has been delivered to on_receive_token
+        bool chat(const std::string& model, const ollama::messages& messages,
+                  std::function<bool(const ollama::response&)> on_receive_token, json options = nullptr) {
+            bool received = false;
+            auto forward = [&](const ollama::response& response) {
+                received = true;
+                return on_receive_token(response);
+            };
+            return run<bool>(false, [&]() { return ollama.chat(model, messages, forward, options); },
+                             [&]() { return !received; });
+        }
+
+        ollama::response generate_embeddings(const std::string& model, const json& input, json options = nullptr) {
+            auto call = [this, model, input, options]() { return ollama.generate_embeddings(model, input, options); };
+            if (!this->options.hedge_embeddings) return run<ollama::response>(true, call);
+            return run<ollama::response>(true, [&]() { return hedged(call); });
+        }
+
+        std::vector<std::string> list_models() {
+            return run<std::vector<std::string>>(true, [&]() { return ollama.list_models(); });
+        }
+
+        std::vector<std::string> list_running_models() {
+            return run<std::vector<std::string>>(true, [&]() { return ollama.list_running_models(); });
+        }
+
+        circuit_breaker::state breaker_state() const { return breaker.get_state(); }
+
+    private:
+        static bool retryable(const transport_exception& e, bool idempotent) {
+            if (idempotent) return true;
+            return e.error == httplib::Error::Connection || e.status >= 500;
+        }
+
+        template <typename Result, typename Call>
+        Result run(bool idempotent, Call call, std::function<bool()> may_retry = nullptr) {
+            auto deadline = options.deadline.count() > 0
+                ? std::chrono::steady_clock::now() + options.deadline
+                : httplib::detail::Deadline{};
+            httplib::DeadlineScope scope(deadline);
+
+            for (int attempt = 1;; attempt++) {
+                if (!breaker.allow())
+                    throw circuit_open_exception("Ollama circuit breaker is open; failing fast");
+
+                try {
+                    Result result = call();
+                    breaker.record_success();
+                    return result;
+                } catch (const transport_exception& e) {
+                    breaker.record_failure();
+                    bool again = attempt < options.max_attempts && retryable(e, idempotent) &&
+                                 (!may_retry || may_retry());
+                    if (!again || !backoff(attempt, deadline)) throw;
+                } catch (const ollama::exception&) {
+                    // The server answered, even if with an error
+                    breaker.record_success();
+                    throw;
+                }
+            }
+        }
+
+        // Sleeps a jittered exponential delay; false when it would overrun the deadline
+        bool backoff(int attempt, httplib::detail::Deadline deadline) {
+            auto exponential = std::chrono::milliseconds(options.base_backoff.count() << std::min(attempt - 1, 20));
+            auto cap = std::min(options.max_backoff, exponential);
+            std::chrono::milliseconds delay;
+            {
+                std::lock_guard<std::mutex> lock(rng_mutex);
+                delay = std::chrono::milliseconds(std::uniform_int_distribution<long long>(0, cap.count())(rng));
+            }
+            if (deadline != httplib::detail::Deadline{} && std::chrono::steady_clock::now() + delay >= deadline)
+                return false;
+            std::this_thread::sleep_for(delay);
+            return true;
+        }
+
+        // Issues a second copy of the call if the first is slower than hedge_delay; first success wins
+        ollama::response hedged(const std::function<ollama::response()>& call) {
+            struct race {
+                std::mutex mutex;
+                std::condition_variable cv;
+                int pending = 0;
+                bool done = false;
+                ollama::response result;
+                std::exception_ptr error;
+            };
+            auto state = std::make_shared<race>();
+            auto deadline = httplib::detail::request_deadline();
+
+            auto launch = [this, state, call, deadline]() {
+                {
+                    std::lock_guard<std::mutex> lock(hedge_mutex);
+                    hedges_in_flight++;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->pending++;
+                }
+                std::thread([this, state, call, deadline]() {
+                    httplib::DeadlineScope scope(deadline);
+                    ollama::response result;
+                    std::exception_ptr error;
+                    try {
+                        result = call();
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->pending--;
+                        if (!state->done && !error) {
+                            state->done = true;
+                            state->result = result;
+                        } else if (!state->done && state->pending == 0) {
+                            state->done = true;
+                            state->error = error;
+                        }
+                    }
+                    state->cv.notify_all();
+                    // Notify under the lock so the destructor cannot finish before we stop touching this
+                    std::lock_guard<std::mutex> lock(hedge_mutex);
+                    hedges_in_flight--;
+                    hedge_cv.notify_all();
+                }).detach();
+            };
+
+            launch();
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if (!state->cv.wait_for(lock, options.hedge_delay, [&]() { return state->done; })) {
+                lock.unlock();
+                launch();
+                lock.lock();
+            }
+            state->cv.wait(lock, [&]() { return state->done; });
+            if (state->error) std::rethrow_exception(state->error);
+            return state->result;
+        }
+
+        Ollama& ollama;
+        resilience_options options;
+        circuit_breaker breaker;
+
+        std::mt19937_64 rng;
+        std::mutex rng_mutex;
+
+        std::mutex hedge_mutex;
+        std::condition_variable hedge_cv;
+        int hedges_in_flight = 0;
+    };
+}
+
+#endif // RESILIENCE_HPP
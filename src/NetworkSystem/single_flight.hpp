@@ -0,0 +1,161 @@
+#ifndef SINGLE_FLIGHT_HPP
+#define SINGLE_FLIGHT_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+
+namespace ollama {
+
+    // Coalesces identical deterministic chat requests that are in flight at the same time.
+    // The first caller (the leader) talks to the server; later callers with the same
+    // request key attach to its stream, replaying the partial responses that have already
+    // arrived and then following live. Non-deterministic requests pass straight through.
+    class single_flight {
+    public:
+        bool chat(Ollama& ollama, const std::string& model, const ollama::messages& messages,
+                  std::function<bool(const ollama::response&)> on_receive_token, json options = nullptr) {
+            if (!ollama::response_cache::is_deterministic(options))
+                return ollama.chat(model, messages, on_receive_token, options);
+
+            ollama::cache_key key = ollama.request_key(model, messages, options);
+            std::shared_ptr<flight> current;
+            bool leader = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = flights.find(key);
+                if (it == flights.end()) {
+                    current = std::make_shared<flight>();
+                    flights[key] = current;
+                    leader = true;
+                } else {
+                    current = it->second;
+                    coalesced++;
+                }
+                current->consumers++;
+            }
+
+            if (leader) return lead(ollama, key, current, model, messages, on_receive_token, options);
+            return follow(*current, on_receive_token);
+        }
+
+        ollama::response chat(Ollama& ollama, const std::string& model, const ollama::messages& messages, json options = nullptr) {
+            std::string content;
+            json last;
+            chat(ollama, model, messages, [&](const ollama::response& response) {
+                content += response.as_simple_string();
+                last = response.as_json();
+                return true;
+            }, options);
+
+            if (last.is_null()) return ollama::response();
+            last["message"] = {{"role", "assistant"}, {"content", content}};
+            return ollama::response(last.dump(), ollama::message_type::chat);
+        }
+
+        // Number of requests that were served by attaching to another caller's stream
+        size_t coalesced_count() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return coalesced;
+        }
+
+    private:
+        struct flight {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<std::string> partials;   // Every partial response so far, for late joiners
+            bool done = false;
+            std::exception_ptr error;
+            size_t consumers = 0;                // Callers still reading; guarded by single_flight::mutex
+        };
+
+        bool lead(Ollama& ollama, const ollama::cache_key& key, const std::shared_ptr<flight>& current,
+                  const std::string& model, const ollama::messages& messages,
+                  const std::function<bool(const ollama::response&)>& on_receive_token, const json& options) {
+            bool reading = true;
+            bool result = false;
+            try {
+                result = ollama.chat(model, messages, [&](const ollama::response& response) {
+                    {
+                        std::lock_guard<std::mutex> lock(current->mutex);
+                        current->partials.push_back(response.as_json().dump());
+                    }
+                    current->cv.notify_all();
+
+                    if (reading && !on_receive_token(response)) {
+                        reading = false;
+                        release(*current);
+                    }
+                    // Keep streaming while anyone is still attached; once nobody is, stop new joiners too
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (current->consumers > 0) return true;
+                    forget(key, current);
+                    return false;
+                }, options);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                current->error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                forget(key, current);
+                if (reading) current->consumers--;
+            }
+            {
+                std::lock_guard<std::mutex> lock(current->mutex);
+                current->done = true;
+            }
+            current->cv.notify_all();
+
+            std::lock_guard<std::mutex> lock(current->mutex);
+            if (current->error && reading) std::rethrow_exception(current->error);
+            return result;
+        }
+
+        bool follow(flight& current, const std::function<bool(const ollama::response&)>& on_receive_token) {
+            size_t next = 0;
+            while (true) {
+                std::string partial;
+                {
+                    std::unique_lock<std::mutex> lock(current.mutex);
+                    current.cv.wait(lock, [&]() { return current.done || next < current.partials.size(); });
+                    if (next >= current.partials.size()) {
+                        release(current);
+                        if (current.error) std::rethrow_exception(current.error);
+                        return true;
+                    }
+                    partial = current.partials[next++];
+                }
+
+                if (!on_receive_token(ollama::response(partial, ollama::message_type::chat))) {
+                    release(current);
+                    return true;
+                }
+            }
+        }
+
+        // Caller holds mutex
+        void forget(const ollama::cache_key& key, const std::shared_ptr<flight>& current) {
+            auto it = flights.find(key);
+            if (it != flights.end() && it->second == current) flights.erase(it);
+        }
+
+        void release(flight& current) {
+            std::lock_guard<std::mutex> lock(mutex);
+            current.consumers--;
+        }
+
+        mutable std::mutex mutex;
+        std::unordered_map<ollama::cache_key, std::shared_ptr<flight>, ollama::cache_key_hash> flights;
+        size_t coalesced = 0;
+    };
+}
+
+#endif // SINGLE_FLIGHT_HPP
@@ -0,0 +1,518 @@
+#ifndef LOG_WATCHER_HPP
+#define LOG_WATCHER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cmath>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "../CacheSystem/response_cache.hpp"
+
+namespace termsage {
+
+    // Hashes the statement behind a log line: tokens containing digits (timestamps, ids, counts,
+    // addresses), long hex strings and quoted values count as placeholders and whitespace runs
+    // as one space, so repeats of one statement share a hash. Nothing is allocated.
+    inline uint64_t log_template_hash(std::string_view line) {
+        enum : unsigned char { other = 0, space = 1, word = 2, hex = 4, digit = 8 };
+        static const auto classes = []() {
+            std::array<unsigned char, 256> table{};
+            for (int c = 0; c < 256; c++) {
+                if (std::isspace(c)) table[c] = space;
+                else if (std::isdigit(c)) table[c] = word | hex | digit;
+                else if (std::isxdigit(c)) table[c] = word | hex;
+                else if (std::isalpha(c) || c == '_' || c == '.' || c == ':' || c == '-' || c >= 0x80) table[c] = word;
+            }
+            return table;
+        }();
+
+        uint64_t hash = ollama::fnv1a_64(nullptr, 0);
+        size_t i = 0, size = line.size();
+        while (i < size) {
+            unsigned char c = static_cast<unsigned char>(line[i]);
+            unsigned char kind = classes[c];
+            if (c == '"' || c == '\'') {
+                size_t close = line.find(static_cast<char>(c), i + 1);
+                if (close != std::string_view::npos) {
+                    hash = ollama::fnv1a_64("\x01", 1, hash);
+                    i = close + 1;
+                    continue;
+                }
+            }
+            if (kind == space) {
+                while (i < size && classes[static_cast<unsigned char>(line[i])] == space) i++;
+                if (i < size) hash = ollama::fnv1a_64(" ", 1, hash);
+                continue;
+            }
+            if (!(kind & word)) {
+                hash = ollama::fnv1a_64(line.data() + i, 1, hash);
+                i++;
+                continue;
+            }
+
+            size_t start = i;
+            unsigned char all = hex, any = 0;
+            while (i < size && (classes[static_cast<unsigned char>(line[i])] & word)) {
+                unsigned char w = classes[static_cast<unsigned char>(line[i])];
+                all &= w;
+                any |= w;
+                i++;
+            }
+            if ((any & digit) || ((all & hex) && i - start >= 8)) hash = ollama::fnv1a_64("\x02", 1, hash);
+            else hash = ollama::fnv1a_64(line.data() + start, i - start, hash);
+        }
+        return hash;
+    }
+
+    struct watch_options {
+        std::string path;                                     // Empty to read stdin
+        std::chrono::seconds window{60};                      // Time scale of "usual" line rates
+        std::chrono::milliseconds debounce{2000};             // Quiet time before a batch goes out
+        std::chrono::milliseconds max_delay{10000};           // ...unless novelty keeps arriving this long
+        std::chrono::milliseconds cooldown{30000};            // Minimum time between model calls
+        size_t baseline_bytes = 256 * 1024;                   // Existing data learned as normal at startup
+        size_t max_templates = 65536;
+        size_t max_examples = 40;                             // New patterns quoted per batch
+        size_t context_lines = 30;                            // Most recent lines sent along
+    };
+
+    // What the model is asked about: one example per new or bursting pattern, and recent lines
+    struct triage_batch {
+        std::vector<std::string> findings;
+        size_t new_patterns = 0;
+        size_t bursts = 0;
+        size_t lines_seen = 0;                                // Since the previous batch
+        std::vector<std::string> context;
+    };
+
+    // Follows a log and decides when it is worth asking the model about. Every line is
+    // hashed as a template; a template that has never been seen, or one suddenly arriving far
+    // faster than usual, is a finding. Findings are batched until the log is quiet for a moment
+    // and handed to `analyze` on its own thread, so reading never waits for the model and heavy
+    // log rates cost only hashing. Context, templates and pending findings are all bounded.
+    class log_watcher {
+    public:
+        using analyzer = std::function<void(const triage_batch&)>;
+
+        log_watcher(watch_options options, analyzer analyze) : config(std::move(options)), analyze(std::move(analyze)) {
+            worker = std::thread([this]() { analyze_loop(); });
+        }
+
+        ~log_watcher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            worker.join();
+            close_source();
+        }
+
+        log_watcher(const log_watcher&) = delete;
+        log_watcher& operator=(const log_watcher&) = delete;
+
+        // Follows until stop is set or stdin ends; false if the file cannot be opened
+        bool run(const std::atomic<bool>& stop) {
+            if (!open_source(true)) return false;
+
+            while (!stop) {
+                int timeout = next_timeout();
+                if (!wait_for_data(timeout)) break; // stdin closed
+                read_available();
+                maybe_flush(false);
+            }
+
+            // Report what is still pending before returning
+            maybe_flush(true);
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this]() { return !busy && !ready; });
+            return true;
+        }
+
+        size_t lines_read() const { return total_lines; }
+        size_t templates_known() const { return templates.size(); }
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct template_stats {
+            double short_rate = 0;     // Decayed count over about one window
+            double long_rate = 0;      // ...and over ten windows
+            clock::time_point first_seen;
+            clock::time_point last_seen;
+            clock::time_point burst_reported;
+        };
+
+        struct pending_finding {
+            std::string example;
+            size_t count = 0;
+            bool burst = false;
+        };
+
+        // ---- input ----------------------------------------------------------------------
+
+        bool open_source(bool initial) {
+            if (config.path.empty()) {
+                // What is already waiting (the lines `tail -f` starts with) is the baseline
+                fd = STDIN_FILENO;
+                learning = true;
+                return true;
+            }
+            fd = ::open(config.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            inode = st.st_ino;
+            offset = 0;
+
+            // Existing content is the baseline of normal patterns, not news
+            if (initial) {
+                size_t size = static_cast<size_t>(st.st_size);
+                offset = size > config.baseline_bytes ? size - config.baseline_bytes : 0;
+                if (offset > 0) offset = next_line_start(offset, size);
+                learning = true;
+                read_file();
+                learning = false;
+            }
+
+#ifdef __linux__
+            if (notify_fd == -1) notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (notify_fd != -1) {
+                if (watch_descriptor != -1) inotify_rm_watch(notify_fd, watch_descriptor);
+                watch_descriptor = inotify_add_watch(notify_fd, config.path.c_str(),
+                                                     IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF | IN_CLOSE_WRITE);
+            }
+#endif
+            return true;
+        }
+
+        void close_source() {
+            if (fd != -1 && fd != STDIN_FILENO) ::close(fd);
+            fd = -1;
+#ifdef __linux__
+            if (notify_fd != -1) ::close(notify_fd);
+            notify_fd = -1;
+            watch_descriptor = -1;
+#endif
+        }
+
+        // Waits for new data or the timeout; false once stdin has ended
+        bool wait_for_data(int timeout) {
+            if (config.path.empty()) {
+                if (stdin_done) return false;
+                struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+                stdin_ready = poll(&pfd, 1, learning ? 100 : timeout) > 0;
+                if (!stdin_ready) learning = false;
+                return true;
+            }
+#ifdef __linux__
+            if (notify_fd != -1 && watch_descriptor != -1) {
+                struct pollfd pfd = {notify_fd, POLLIN, 0};
+                // Still poll now and then: inotify misses writes through some network filesystems
+                if (poll(&pfd, 1, std::min(timeout, 1000)) > 0) {
+                    char events[4096];
+                    while (::read(notify_fd, events, sizeof(events)) > 0) {}
+                }
+                return true;
+            }
+#endif
+            poll(nullptr, 0, std::min(timeout, 250));
+            return true;
+        }
+
+        void read_available() {
+            if (config.path.empty()) {
+                if (!stdin_ready) return;
+                char buffer[65536];
+                ssize_t n = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+                if (n == -1 && errno == EINTR) return;
+                if (n <= 0) {
+                    if (n == 0 || errno != EAGAIN) {
+                        stdin_done = true;
+                        if (!partial.empty()) take_line(partial);
+                        partial.clear();
+                    }
+                    return;
+                }
+                ingest(std::string_view(buffer, static_cast<size_t>(n)));
+                baseline_read += static_cast<size_t>(n);
+                if (baseline_read >= config.baseline_bytes) learning = false;
+                return;
+            }
+
+            // Rotation replaces the file; truncation shrinks it. Either way start from the top.
+            struct stat st;
+            if (stat(config.path.c_str(), &st) == 0 && st.st_ino != inode) {
+                read_file();
+                close_source();
+                partial.clear();
+                if (!open_source(false)) return;
+            } else if (fd != -1 && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < offset) {
+                offset = 0;
+                partial.clear();
+            }
+            read_file();
+        }
+
+        // Where the first whole line at or after from begins; the line from cuts into is skipped
+        size_t next_line_start(size_t from, size_t size) {
+            char buffer[4096];
+            size_t position = from - 1;    // A newline just before from means it already starts a line
+            while (position < size) {
+                ssize_t n = pread(fd, buffer, sizeof(buffer), static_cast<off_t>(position));
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) break;
+                auto newline = static_cast<const char*>(memchr(buffer, '\n', static_cast<size_t>(n)));
+                if (newline) return position + static_cast<size_t>(newline - buffer) + 1;
+                position += static_cast<size_t>(n);
+            }
+            return size;
+        }
+
+        void read_file() {
+            if (fd == -1) return;
+            char buffer[65536];
+            while (true) {
+                ssize_t n = pread(fd, buffer, sizeof(buffer), static_cast<off_t>(offset));
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) break;
+                offset += static_cast<size_t>(n);
+                ingest(std::string_view(buffer, static_cast<size_t>(n)));
+            }
+        }
+
+        void ingest(std::string_view data) {
+            // One clock read per block; lines read together arrived together
+            read_time = clock::now();
+            size_t start = 0, end;
+            while ((end = data.find('\n', start)) != std::string_view::npos) {
+                if (partial.empty()) {
+                    take_line(data.substr(start, end - start));
+                } else {
+                    partial.append(data.substr(start, end - start));
+                    take_line(partial);
+                    partial.clear();
+                }
+                start = end + 1;
+            }
+            partial.append(data.substr(start));
+            // A runaway line without newlines is cut rather than grown without limit
+            if (partial.size() > 65536) {
+                take_line(partial);
+                partial.clear();
+            }
+        }
+
+        // ---- detection ------------------------------------------------------------------
+
+        void take_line(std::string_view line) {
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) return;
+            auto now = read_time;
+            total_lines++;
+            lines_since_batch++;
+
+            uint64_t hash = log_template_hash(line);
+            bool baseline = learning;
+
+            auto found = templates.find(hash);
+            bool is_new = found == templates.end();
+            template_stats& stats = is_new ? templates[hash] : found->second;
+
+            // Exponentially decayed counts; a burst is the short-term rate far above the long-term one
+            double window = std::chrono::duration<double>(config.window).count();
+            if (!is_new && now != stats.last_seen) {
+                double elapsed = std::chrono::duration<double>(now - stats.last_seen).count();
+                stats.short_rate *= std::exp(-elapsed / window);
+                stats.long_rate *= std::exp(-elapsed / (10 * window));
+            }
+            stats.short_rate += 1;
+            stats.long_rate += 1;
+            stats.last_seen = now;
+
+            if (is_new) stats.first_seen = now;
+
+            // Steady traffic keeps short near a tenth of long; five times that is a burst. Young
+            // templates are skipped while their long-term count is still filling up.
+            bool burst = !is_new && !baseline && stats.short_rate > 20 && stats.short_rate > stats.long_rate / 2 &&
+                         now - stats.first_seen > 3 * config.window && now - stats.burst_reported > config.window;
+            if (burst) stats.burst_reported = now;
+
+            line = line.substr(0, 400);
+            if (!baseline && (is_new || burst)) {
+                record_finding(hash, line, burst, now);
+            } else if (!pending.empty()) {
+                // Repeats of a pattern waiting to be reported show how often it happens
+                auto waiting = pending.find(hash);
+                if (waiting != pending.end()) waiting->second.count++;
+            }
+
+            // Ring of recent lines; assign() reuses each slot's buffer
+            if (recent.size() < config.context_lines) recent.emplace_back(line);
+            else if (!recent.empty()) recent[recent_next].assign(line.data(), line.size());
+            if (!recent.empty()) recent_next = (recent_next + 1) % config.context_lines;
+            if (templates.size() > config.max_templates) evict_templates();
+        }
+
+        void record_finding(uint64_t hash, std::string_view line, bool burst, clock::time_point now) {
+            auto it = pending.find(hash);
+            if (it != pending.end()) {
+                it->second.count++;
+            } else if (pending.size() < config.max_examples) {
+                pending[hash] = {std::string(line), 1, burst};
+            } else {
+                overflow++;
+            }
+            if (burst) pending_bursts++;
+            else pending_new++;
+            if (pending.size() == 1 && it == pending.end()) first_finding = now;
+            last_finding = now;
+        }
+
+        // Forgets the least recently seen quarter of the templates
+        void evict_templates() {
+            std::vector<clock::time_point> seen;
+            seen.reserve(templates.size());
+            for (const auto& item : templates) seen.push_back(item.second.last_seen);
+            auto cut = seen.begin() + static_cast<std::ptrdiff_t>(seen.size() / 4);
+            std::nth_element(seen.begin(), cut, seen.end());
+            clock::time_point oldest = *cut;
+            for (auto it = templates.begin(); it != templates.end();) {
+                if (it->second.last_seen < oldest) it = templates.erase(it);
+                else ++it;
+            }
+        }
+
+        // ---- batching -------------------------------------------------------------------
+
+        int next_timeout() const {
+            if (pending.empty()) return 1000;
+            auto now = clock::now();
+            auto due = std::min(last_finding + config.debounce, first_finding + config.max_delay);
+            due = std::max(due, last_call + config.cooldown);
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+            return static_cast<int>(std::clamp<long long>(wait + 1, 1, 1000));
+        }
+
+        void maybe_flush(bool force) {
+            if (pending.empty()) return;
+            auto now = clock::now();
+            if (!force) {
+                bool settled = now - last_finding >= config.debounce || now - first_finding >= config.max_delay;
+                if (!settled || now - last_call < config.cooldown) return;
+            }
+
+            triage_batch batch;
+            for (const auto& item : pending) {
+                std::string label = item.second.burst ? "[burst]" : "[new]";
+                if (item.second.count > 1) label += " x" + std::to_string(item.second.count);
+                batch.findings.push_back(label + " " + item.second.example);
+            }
+            if (overflow) batch.findings.push_back("... and " + std::to_string(overflow) + " more lines with new patterns");
+            batch.new_patterns = pending_new;
+            batch.bursts = pending_bursts;
+            batch.lines_seen = lines_since_batch;
+            for (size_t i = 0; i < recent.size(); i++) batch.context.push_back(recent[(recent_next + i) % recent.size()]);
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // One model call at a time; until it finishes, findings keep accumulating
+                if (busy || ready) {
+                    if (!force) return;
+                    idle.wait(lock, [this]() { return !busy && !ready; });
+                }
+                next_batch = std::move(batch);
+                ready = true;
+            }
+            wake.notify_one();
+
+            pending.clear();
+            overflow = pending_new = pending_bursts = 0;
+            lines_since_batch = 0;
+            last_call = now;
+        }
+
+        void analyze_loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [this]() { return stopping || ready; });
+                if (!ready) return;
+                triage_batch batch = std::move(next_batch);
+                ready = false;
+                busy = true;
+                lock.unlock();
+                try {
+                    analyze(batch);
+                } catch (const std::exception&) {
+                    // A failed call loses one batch; watching goes on
+                }
+                lock.lock();
+                busy = false;
+                idle.notify_all();
+            }
+        }
+
+        watch_options config;
+        analyzer analyze;
+
+        int fd = -1;
+        ino_t inode = 0;
+        size_t offset = 0;
+        int notify_fd = -1;
+        int watch_descriptor = -1;
+        bool stdin_ready = false;
+        bool stdin_done = false;
+        bool learning = false;
+        size_t baseline_read = 0;
+        std::string partial;
+
+        std::unordered_map<uint64_t, template_stats> templates;
+        clock::time_point read_time;
+        std::vector<std::string> recent;
+        size_t recent_next = 0;
+        std::unordered_map<uint64_t, pending_finding> pending;
+        size_t overflow = 0;
+        size_t pending_new = 0;
+        size_t pending_bursts = 0;
+        size_t total_lines = 0;
+        size_t lines_since_batch = 0;
+        clock::time_point first_finding;
+        clock::time_point last_finding;
+        clock::time_point last_call{};
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::thread worker;
+        triage_batch next_batch;
+        bool ready = false;
+        bool busy = false;
+        bool stopping = false;
+    };
+}
+
+#endif // LOG_WATCHER_HPP
@@ -0,0 +1,401 @@
+#ifndef MAP_REDUCE_HPP
+#define MAP_REDUCE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+#include "../NetworkSystem/resilience.hpp"
+#include "../NetworkSystem/request_scheduler.hpp"
+
+namespace termsage {
+
+    struct map_reduce_options {
+        std::string task;               // What the user asked for, e.g. "summarize errors"
+        std::string model;
+        size_t chunk_bytes = 6144;      // Input per request; sized to fit the model's context
+        size_t jobs = 4;                // Requests in flight at once
+        size_t fanout = 8;              // Most partial results merged by one request
+        ollama::json options = nullptr; // Passed with every chat, e.g. {"options": {"num_ctx": 4096}}
+        ollama::request_scheduler* scheduler = nullptr; // When set, every request waits for a batch slot
+        // When set, answers (system prompt, user input) in place of the server; tests stub the model with it
+        std::function<std::string(const std::string&, const std::string&)> chat;
+    };
+
+    // Answers a task over input of any size. Input is cut into chunks at line boundaries; each
+    // chunk is condensed into notes by its own request ("map"), with at most `jobs` requests
+    // running and 2 * jobs chunks held in memory. Notes are merged in input order as soon as
+    // enough are ready ("reduce"), level by level like a binary counter, so only a few
+    // partial results per level are ever kept. The final answer is streamed.
+    class map_reduce {
+    public:
+        using progress_callback = std::function<void(const std::string&)>;
+
+        map_reduce(Ollama& server, map_reduce_options config, progress_callback progress = nullptr)
+            : client(server, ollama::generation_resilience()), config(std::move(config)), progress(std::move(progress)) {
+            this->config.jobs = std::max<size_t>(1, this->config.jobs);
+            this->config.fanout = std::max<size_t>(2, this->config.fanout);
+            this->config.chunk_bytes = std::max<size_t>(256, this->config.chunk_bytes);
+        }
+
+        ~map_reduce() { stop_workers(); }
+
+        map_reduce(const map_reduce&) = delete;
+        map_reduce& operator=(const map_reduce&) = delete;
+
+        // Reads fd to the end and streams the answer to on_token; throws ollama::exception on failure
+        void run(int fd, const std::function<void(const std::string&)>& on_token) {
+            std::string first = next_chunk(fd);
+            std::string second = next_chunk(fd);
+            if (second.empty()) {
+                // Fits in one request; no notes needed
+                ask(direct_prompt(), first, &on_token);
+                return;
+            }
+
+            start_workers();
+            submit_map(std::move(first));
+            submit_map(std::move(second));
+            for (std::string chunk; !failed() && !(chunk = next_chunk(fd)).empty();) submit_map(std::move(chunk));
+            wait_idle();
+            rethrow();
+
+            // Whatever is left on each level, earliest input (highest level) first
+            std::vector<std::string> notes;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+                    for (auto& note : level->group) notes.push_back(std::move(note));
+                }
+                levels.clear();
+            }
+            while (notes.size() > 1 && (notes.size() > config.fanout || total_size(notes) > config.chunk_bytes)) {
+                notes = reduce_round(std::move(notes));
+            }
+
+            report("Writing the answer from " + std::to_string(chunks) + " chunks");
+            ask(final_prompt(), join(notes), &on_token);
+        }
+
+    private:
+        // Items arriving at one level in any order are taken in sequence, then grouped
+        struct level {
+            std::map<size_t, std::string> waiting;
+            size_t next_in = 0;
+            std::vector<std::string> group;
+            size_t group_bytes = 0;
+            size_t next_out = 0;
+        };
+
+        // ---- input ----------------------------------------------------------------------
+
+        // Up to chunk_bytes of input, ending at a line break when there is one in the back half
+        std::string next_chunk(int fd) {
+            while (!input_done && carry.size() < config.chunk_bytes) {
+                char buffer[65536];
+                ssize_t n = ::read(fd, buffer, sizeof(buffer));
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) {
+                    input_done = true;
+                    break;
+                }
+                carry.append(buffer, static_cast<size_t>(n));
+            }
+
+            size_t cut = std::min(carry.size(), config.chunk_bytes);
+            if (cut < carry.size()) {
+                size_t line = carry.rfind('\n', cut - 1);
+                if (line != std::string::npos && line >= cut / 2) {
+                    cut = line + 1;
+                } else {
+                    while (cut > 0 && (static_cast<unsigned char>(carry[cut]) & 0xC0) == 0x80) cut--;
+                }
+            }
+            std::string chunk = carry.substr(0, cut);
+            carry.erase(0, cut);
+            return chunk;
+        }
+
+        // ---- requests -------------------------------------------------------------------
+
+        std::string direct_prompt() const {
+            return "Complete the following task using the input provided by the user.\nTask: " + config.task;
+        }
+
+        std::string map_prompt(size_t part) const {
+            return "You are helping with a task over a large input that has been split into parts.\nTask: " + config.task +
+                   "\nFrom part " + std::to_string(part + 1) + ", given by the user, extract only what is relevant to "
+                   "the task as concise notes. If nothing is relevant, reply exactly: nothing relevant";
+        }
+
+        std::string reduce_prompt() const {
+            return "You are helping with a task over a large input.\nTask: " + config.task +
+                   "\nThe user gives notes taken from consecutive parts of the input. Merge them into one set of "
+                   "concise notes in the same order, keeping every relevant detail and dropping repetition.";
+        }
+
+        std::string final_prompt() const {
+            return "The user gives notes taken, in order, from consecutive parts of a large input. "
+                   "Use them to complete this task about the whole input.\nTask: " + config.task;
+        }
+
+        // One chat; streamed to on_token when given, otherwise returned whole
+        std::string ask(const std::string& system, const std::string& input,
+                        const std::function<void(const std::string&)>* on_token = nullptr) {
+            if (config.chat) {
+                std::string reply = config.chat(system, input);
+                if (!on_token) return reply;
+                (*on_token)(reply);
+                return std::string();
+            }
+
+            ollama::messages request;
+            request.add_system(system);
+            request.add_user(input);
+            ollama::request_scheduler::ticket slot;
+            if (config.scheduler) slot = config.scheduler->acquire(ollama::priority_class::batch, config.scheduler->estimate_cost(config.options));
+            if (on_token) {
+                client.chat(config.model, request, [&](const ollama::response& response) {
+                    (*on_token)(response.as_simple_string());
+                    return true;
+                }, config.options);
+                return std::string();
+            }
+            return client.chat(config.model, request, config.options).as_simple_string();
+        }
+
+        static bool nothing_relevant(const std::string& note) {
+            size_t start = note.find_first_not_of(" \n\t\"'*");
+            if (start == std::string::npos) return true;
+            std::string head = note.substr(start, 16);
+            std::transform(head.begin(), head.end(), head.begin(), [](unsigned char c) { return std::tolower(c); });
+            return head == "nothing relevant";
+        }
+
+        static size_t total_size(const std::vector<std::string>& notes) {
+            size_t size = 0;
+            for (const auto& note : notes) size += note.size();
+            return size;
+        }
+
+        static std::string join(const std::vector<std::string>& notes) {
+            std::string joined;
+            for (const auto& note : notes) {
+                if (!joined.empty()) joined += "\n\n---\n\n";
+                joined += note;
+            }
+            return joined;
+        }
+
+        // ---- map and reduce -------------------------------------------------------------
+
+        void submit_map(std::string chunk) {
+            size_t part;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Bounded memory: never more than 2 * jobs chunks read but not yet condensed
+                idle.wait(lock, [this]() { return maps_in_flight < 2 * config.jobs || !error.empty(); });
+                if (!error.empty()) return;
+                part = chunks++;
+                maps_in_flight++;
+            }
+            report("Read chunk " + std::to_string(part + 1) + " (" + std::to_string(chunk.size()) + " bytes)");
+
+            submit([this, part, chunk = std::move(chunk)]() {
+                std::string note = ask(map_prompt(part), chunk);
+                if (nothing_relevant(note)) note.clear();
+                report("Chunk " + std::to_string(part + 1) + " done");
+                std::lock_guard<std::mutex> lock(mutex);
+                maps_in_flight--;
+                deliver(0, part, std::move(note));
+            });
+        }
+
+        // Called with the mutex held. Levels are indexed afresh after every dispatch, which
+        // can add a level above and move the vector.
+        void deliver(size_t depth, size_t sequence, std::string note) {
+            if (levels.size() <= depth) levels.resize(depth + 1);
+            levels[depth].waiting.emplace(sequence, std::move(note));
+
+            while (true) {
+                auto next = levels[depth].waiting.find(levels[depth].next_in);
+                if (next == levels[depth].waiting.end()) break;
+                std::string ready = std::move(next->second);
+                levels[depth].waiting.erase(next);
+                levels[depth].next_in++;
+                if (ready.empty()) continue;
+
+                if (!levels[depth].group.empty() && levels[depth].group_bytes + ready.size() > config.chunk_bytes) dispatch_reduce(depth);
+                levels[depth].group_bytes += ready.size();
+                levels[depth].group.push_back(std::move(ready));
+                if (levels[depth].group.size() >= config.fanout) dispatch_reduce(depth);
+            }
+        }
+
+        // Merges a level's group into one note for the level above; called with the mutex held
+        void dispatch_reduce(size_t depth) {
+            level& current = levels[depth];
+            std::vector<std::string> group = std::move(current.group);
+            current.group.clear();
+            current.group_bytes = 0;
+            size_t sequence = current.next_out++;
+            // The level above expects every sequence number, so a lone note simply moves up
+            if (group.size() == 1) {
+                deliver(depth + 1, sequence, std::move(group.front()));
+                return;
+            }
+
+            submit_locked([this, depth, sequence, group = std::move(group)]() {
+                std::string merged = ask(reduce_prompt(), join(group));
+                report("Merged " + std::to_string(group.size()) + " notes");
+                std::lock_guard<std::mutex> lock(mutex);
+                deliver(depth + 1, sequence, std::move(merged));
+            });
+        }
+
+        // Merges consecutive notes in parallel until they fit one request
+        std::vector<std::string> reduce_round(std::vector<std::string> notes) {
+            std::vector<std::vector<std::string>> groups(1);
+            size_t bytes = 0;
+            for (auto& note : notes) {
+                if (!groups.back().empty() && (groups.back().size() >= config.fanout || bytes + note.size() > config.chunk_bytes)) {
+                    groups.emplace_back();
+                    bytes = 0;
+                }
+                bytes += note.size();
+                groups.back().push_back(std::move(note));
+            }
+
+            // A round that cannot shrink the list would loop forever; merge pairs instead
+            if (groups.size() == notes.size()) {
+                std::vector<std::vector<std::string>> pairs;
+                for (size_t i = 0; i < groups.size(); i += 2) {
+                    pairs.emplace_back(std::move(groups[i]));
+                    if (i + 1 < groups.size()) pairs.back().push_back(std::move(groups[i + 1].front()));
+                }
+                groups = std::move(pairs);
+            }
+
+            std::vector<std::string> merged(groups.size());
+            for (size_t i = 0; i < groups.size(); i++) {
+                if (groups[i].size() == 1) {
+                    merged[i] = std::move(groups[i].front());
+                    continue;
+                }
+                submit([this, i, &merged, group = std::move(groups[i])]() {
+                    std::string result = ask(reduce_prompt(), join(group));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    merged[i] = std::move(result);
+                });
+            }
+            wait_idle();
+            rethrow();
+            report("Merged notes into " + std::to_string(merged.size()));
+            return merged;
+        }
+
+        // ---- worker pool ----------------------------------------------------------------
+
+        void start_workers() {
+            for (size_t i = 0; i < config.jobs; i++) {
+                workers.emplace_back([this]() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (true) {
+                        work.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                        if (tasks.empty()) return;
+                        auto task = std::move(tasks.front());
+                        tasks.pop_front();
+                        lock.unlock();
+                        try {
+                            if (!failed()) task();
+                        } catch (const std::exception& e) {
+                            std::lock_guard<std::mutex> guard(mutex);
+                            if (error.empty()) error = e.what();
+                        }
+                        lock.lock();
+                        pending--;
+                        idle.notify_all();
+                    }
+                });
+            }
+        }
+
+        void stop_workers() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            work.notify_all();
+            for (auto& worker : workers) worker.join();
+            workers.clear();
+        }
+
+        void submit(std::function<void()> task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            submit_locked(std::move(task));
+        }
+
+        void submit_locked(std::function<void()> task) {
+            tasks.push_back(std::move(task));
+            pending++;
+            work.notify_one();
+        }
+
+        // Waits until every task, including reduces queued by finishing tasks, has run
+        void wait_idle() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this]() { return pending == 0; });
+        }
+
+        bool failed() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return !error.empty();
+        }
+
+        void rethrow() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error.empty()) throw ollama::exception(error);
+        }
+
+        // Progress comes from every worker; the callback sees one message at a time
+        void report(const std::string& message) {
+            if (!progress) return;
+            std::lock_guard<std::mutex> lock(report_mutex);
+            progress(message);
+        }
+
+        ollama::resilient_ollama client;    // Retries transient failures and fails fast while the server is down
+        map_reduce_options config;
+        progress_callback progress;
+        std::mutex report_mutex;
+
+        std::string carry;
+        bool input_done = false;
+
+        std::mutex mutex;
+        std::condition_variable work;
+        std::condition_variable idle;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        size_t pending = 0;
+        bool stopping = false;
+        std::string error;
+
+        size_t chunks = 0;
+        size_t maps_in_flight = 0;
+        std::vector<level> levels;
+    };
+}
+
+#endif // MAP_REDUCE_HPP
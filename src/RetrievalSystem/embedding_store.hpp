@@ -0,0 +1,250 @@
+#ifndef EMBEDDING_STORE_HPP
+#define EMBEDDING_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+#include "../NetworkSystem/resilience.hpp"
+#include "../NetworkSystem/request_scheduler.hpp"
+
+namespace termsage {
+
+    struct document_chunk {
+        std::string source;
+        std::string text;
+    };
+
+    struct retrieved_chunk {
+        const document_chunk* chunk;
+        float score;
+    };
+
+    // Rough token estimate used for prompt budgeting (about four bytes per token)
+    inline size_t estimate_tokens(const std::string& text) {
+        return (text.size() + 3) / 4;
+    }
+
+    // Local store of document chunks and their unit-length embeddings.
+    // Vectors are kept in one contiguous array so a top-k query is a single linear scan.
+    class embedding_store {
+    public:
+        explicit embedding_store(std::string embedding_model = "nomic-embed-text")
+            : embedding_model(std::move(embedding_model)) {}
+
+        const std::string& model() const { return embedding_model; }
+        size_t size() const { return chunks.size(); }
+        bool empty() const { return chunks.empty(); }
+
+        // Chunks and embeds a file, or every regular file under a directory; returns chunks added.
+        // With a scheduler, each batch waits for a background-index slot.
+        size_t index_path(Ollama& ollama, const std::string& path, ollama::request_scheduler* scheduler = nullptr) {
+            namespace fs = std::filesystem;
+            std::vector<document_chunk> pending;
+
+            auto add_file = [&](const fs::path& file) {
+                std::ifstream in(file, std::ios::binary);
+                if (!in) return;
+                std::stringstream buffer;
+                buffer << in.rdbuf();
+                for (auto& text : split_chunks(buffer.str())) {
+                    // Re-indexing a path only embeds chunks that are not stored yet
+                    if (chunk_hashes.count(chunk_hash(file.string(), text))) continue;
+                    pending.push_back({file.string(), std::move(text)});
+                }
+            };
+
+            std::error_code ec;
+            if (fs::is_directory(path, ec)) {
+                for (auto& entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec)) {
+                    if (entry.is_regular_file(ec)) add_file(entry.path());
+                }
+            } else if (fs::is_regular_file(path, ec)) {
+                add_file(path);
+            }
+
+            // Embed in batches so one request never carries the whole corpus; a failed batch is retried
+            ollama::resilient_ollama client(ollama, ollama::bulk_embedding_resilience());
+            const size_t batch_size = 32;
+            size_t added = 0;
+            for (size_t i = 0; i < pending.size(); i += batch_size) {
+                std::vector<std::string> inputs;
+                for (size_t j = i; j < std::min(pending.size(), i + batch_size); j++) inputs.push_back(pending[j].text);
+
+                ollama::request_scheduler::ticket slot;
+                if (scheduler) slot = scheduler->acquire(ollama::priority_class::background_index, inputs.size());
+
+                auto embeddings = client.generate_embeddings(embedding_model, inputs).as_embeddings();
+                if (embeddings.size() != inputs.size()) break;
+                for (size_t j = 0; j < embeddings.size(); j++) {
+                    if (add(std::move(pending[i + j]), std::move(embeddings[j]))) added++;
+                }
+            }
+            return added;
+        }
+
+        bool add(document_chunk chunk, std::vector<float> embedding) {
+            if (embedding.empty()) return false;
+            if (dimensions == 0) dimensions = embedding.size();
+            if (embedding.size() != dimensions || !normalize(embedding)) return false;
+
+            chunk_hashes.insert(chunk_hash(chunk.source, chunk.text));
+            chunks.push_back(std::move(chunk));
+            vectors.insert(vectors.end(), embedding.begin(), embedding.end());
+            return true;
+        }
+
+        std::vector<retrieved_chunk> search(std::vector<float> query, size_t k) const {
+            std::vector<retrieved_chunk> results;
+            if (query.size() != dimensions || !normalize(query) || k == 0) return results;
+
+            // Keep a small min-heap of the best k scores
+            auto worse = [](const retrieved_chunk& a, const retrieved_chunk& b) { return a.score > b.score; };
+            for (size_t i = 0; i < chunks.size(); i++) {
+                const float* vec = vectors.data() + i * dimensions;
+                float score = 0.0f;
+                for (size_t d = 0; d < dimensions; d++) score += vec[d] * query[d];
+
+                if (results.size() < k) {
+                    results.push_back({&chunks[i], score});
+                    std::push_heap(results.begin(), results.end(), worse);
+                } else if (score > results.front().score) {
+                    std::pop_heap(results.begin(), results.end(), worse);
+                    results.back() = {&chunks[i], score};
+                    std::push_heap(results.begin(), results.end(), worse);
+                }
+            }
+            std::sort_heap(results.begin(), results.end(), worse);
+            return results;
+        }
+
+        // Binary layout: magic, dimensions, count, then per chunk: source, text, vector
+        bool save(const std::string& path) const {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+
+            out.write(magic, sizeof(magic));
+            write_u32(out, static_cast<uint32_t>(dimensions));
+            write_u32(out, static_cast<uint32_t>(chunks.size()));
+            for (size_t i = 0; i < chunks.size(); i++) {
+                write_string(out, chunks[i].source);
+                write_string(out, chunks[i].text);
+                out.write(reinterpret_cast<const char*>(vectors.data() + i * dimensions),
+                          static_cast<std::streamsize>(dimensions * sizeof(float)));
+            }
+            return static_cast<bool>(out);
+        }
+
+        bool load(const std::string& path) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return false;
+
+            char header[sizeof(magic)];
+            if (!in.read(header, sizeof(header)) || memcmp(header, magic, sizeof(magic)) != 0) return false;
+
+            uint32_t dims = 0, count = 0;
+            if (!read_u32(in, dims) || !read_u32(in, count)) return false;
+
+            std::vector<document_chunk> loaded_chunks(count);
+            std::vector<float> loaded_vectors(static_cast<size_t>(count) * dims);
+            for (uint32_t i = 0; i < count; i++) {
+                if (!read_string(in, loaded_chunks[i].source) || !read_string(in, loaded_chunks[i].text)) return false;
+                if (!in.read(reinterpret_cast<char*>(loaded_vectors.data() + static_cast<size_t>(i) * dims),
+                             static_cast<std::streamsize>(dims * sizeof(float)))) return false;
+            }
+
+            dimensions = dims;
+            chunk_hashes.clear();
+            for (const auto& chunk : loaded_chunks) chunk_hashes.insert(chunk_hash(chunk.source, chunk.text));
+            chunks = std::move(loaded_chunks);
+            vectors = std::move(loaded_vectors);
+            return true;
+        }
+
+        // Splits text at paragraph or line boundaries into overlapping chunks of about max_chars
+        static std::vector<std::string> split_chunks(const std::string& text, size_t max_chars = 800, size_t overlap = 100) {
+            std::vector<std::string> result;
+            size_t start = 0;
+            while (start < text.size()) {
+                size_t end = std::min(text.size(), start + max_chars);
+                if (end < text.size()) {
+                    size_t cut = text.rfind("\n\n", end);
+                    if (cut == std::string::npos || cut <= start + max_chars / 2) cut = text.rfind('\n', end);
+                    if (cut != std::string::npos && cut > start + max_chars / 2) end = cut;
+                }
+
+                std::string chunk = text.substr(start, end - start);
+                if (chunk.find_first_not_of(" \t\r\n") != std::string::npos) result.push_back(std::move(chunk));
+                if (end >= text.size()) break;
+                start = end > start + overlap ? end - overlap : end;
+            }
+            return result;
+        }
+
+    private:
+        static constexpr char magic[8] = {'T', 'S', 'R', 'A', 'G', '0', '0', '1'};
+
+        static bool normalize(std::vector<float>& v) {
+            double norm = 0.0;
+            for (float x : v) norm += static_cast<double>(x) * x;
+            if (norm == 0.0) return false;
+            float scale = static_cast<float>(1.0 / std::sqrt(norm));
+            for (float& x : v) x *= scale;
+            return true;
+        }
+
+        static uint64_t chunk_hash(const std::string& source, const std::string& text) {
+            return ollama::fnv1a_64(text.data(), text.size(), ollama::fnv1a_64(source.data(), source.size()));
+        }
+
+        static void write_u32(std::ofstream& out, uint32_t value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        static void write_string(std::ofstream& out, const std::string& value) {
+            write_u32(out, static_cast<uint32_t>(value.size()));
+            out.write(value.data(), static_cast<std::streamsize>(value.size()));
+        }
+
+        static bool read_u32(std::ifstream& in, uint32_t& value) {
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+        }
+
+        static bool read_string(std::ifstream& in, std::string& value) {
+            uint32_t length = 0;
+            if (!read_u32(in, length)) return false;
+            value.resize(length);
+            return static_cast<bool>(in.read(value.data(), length));
+        }
+
+        std::string embedding_model;
+        size_t dimensions = 0;
+        std::vector<document_chunk> chunks;
+        std::vector<float> vectors;
+        std::unordered_set<uint64_t> chunk_hashes;
+    };
+
+    // Packs the best chunks into a context block without exceeding budget_tokens
+    inline std::string pack_context(const std::vector<retrieved_chunk>& results, size_t budget_tokens) {
+        std::string context;
+        size_t used = 0;
+        for (const auto& result : results) {
+            std::string block = "[" + result.chunk->source + "]\n" + result.chunk->text + "\n\n";
+            size_t cost = estimate_tokens(block);
+            if (used + cost > budget_tokens) continue;
+            context += block;
+            used += cost;
+        }
+        return context;
+    }
+}
+
+#endif // EMBEDDING_STORE_HPP
@@ -0,0 +1,749 @@
+#ifndef FILE_CONTEXT_HPP
+#define FILE_CONTEXT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "embedding_store.hpp"
+#include "../CacheSystem/response_cache.hpp"
+
+namespace termsage {
+
+    // Glob match from pattern[p] against path[s]. '*' and '?' stay within a path component, a
+    // whole-component "**" spans any number of them and [...] is a character class. With hidden
+    // set, wildcards do not match a leading '.', as in a shell.
+    inline bool glob_match_from(std::string_view pattern, size_t p, std::string_view path, size_t s, bool hidden) {
+        auto component_start = [&](size_t i) { return i == 0 || path[i - 1] == '/'; };
+        while (p < pattern.size()) {
+            char c = pattern[p];
+            if (c == '*' && pattern.substr(p, 2) == "**" && (p == 0 || pattern[p - 1] == '/') &&
+                (p + 2 == pattern.size() || pattern[p + 2] == '/')) {
+                bool trailing = p + 2 == pattern.size();
+                for (size_t i = s;;) {
+                    if (!trailing && glob_match_from(pattern, p + 3, path, i, hidden)) return true;
+                    if (i == path.size()) return trailing;
+                    if (hidden && path[i] == '.') return false;
+                    size_t slash = path.find('/', i);
+                    i = slash == std::string_view::npos ? path.size() : slash + 1;
+                }
+            }
+            if (c == '*') {
+                if (hidden && s < path.size() && path[s] == '.' && component_start(s)) return false;
+                for (size_t i = s;; i++) {
+                    if (glob_match_from(pattern, p + 1, path, i, hidden)) return true;
+                    if (i == path.size() || path[i] == '/') return false;
+                }
+            }
+            if (s == path.size()) return false;
+            if (c == '?') {
+                if (path[s] == '/' || (hidden && path[s] == '.' && component_start(s))) return false;
+                p++;
+                s++;
+                continue;
+            }
+            if (c == '[') {
+                size_t first = p + 1;
+                bool negate = first < pattern.size() && (pattern[first] == '!' || pattern[first] == '^');
+                if (negate) first++;
+                size_t close = pattern.find(']', first + 1);   // A ']' right after '[' is literal
+                if (close != std::string_view::npos) {
+                    bool found = false;
+                    for (size_t i = first; i < close; i++) {
+                        if (i + 2 < close && pattern[i + 1] == '-') {
+                            found |= path[s] >= pattern[i] && path[s] <= pattern[i + 2];
+                            i += 2;
+                        } else {
+                            found |= path[s] == pattern[i];
+                        }
+                    }
+                    if (found == negate || path[s] == '/') return false;
+                    p = close + 1;
+                    s++;
+                    continue;
+                }
+            }
+            if (c == '\\' && p + 1 < pattern.size()) c = pattern[++p];
+            if (c != path[s]) return false;
+            p++;
+            s++;
+        }
+        return s == path.size();
+    }
+
+    inline bool glob_match(std::string_view pattern, std::string_view path, bool hidden = false) {
+        return glob_match_from(pattern, 0, path, 0, hidden);
+    }
+
+    // True when data holds a NUL byte, the test git and grep use for binary files. The SIMD path
+    // checks 64 bytes per branch, so a text file is ruled out at close to memory speed.
+    inline bool looks_binary(const char* data, size_t size) {
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 64 <= size; i += 64) {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), zero);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16)), zero);
+            __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32)), zero);
+            __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48)), zero);
+            if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) return true;
+        }
+#elif defined(__ARM_NEON)
+        const uint8x16_t zero = vdupq_n_u8(0);
+        for (; i + 64 <= size; i += 64) {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data + i);
+            uint8x16_t any = vorrq_u8(vorrq_u8(vceqq_u8(vld1q_u8(bytes), zero), vceqq_u8(vld1q_u8(bytes + 16), zero)),
+                                      vorrq_u8(vceqq_u8(vld1q_u8(bytes + 32), zero), vceqq_u8(vld1q_u8(bytes + 48), zero)));
+            if (vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(any), 4)), 0)) return true;
+        }
+#endif
+        return i < size && memchr(data + i, 0, size - i) != nullptr;
+    }
+
+    // .gitignore rules for a directory walk. Rules from nested .gitignore files are pushed on the
+    // way down and popped on the way back up; the last matching rule decides, as in git.
+    class ignore_rules {
+    public:
+        // Adds the rules in a .gitignore-format file; base is its directory relative to the walk root ("" or "dir/")
+        bool load(const std::string& file, const std::string& base) {
+            std::ifstream in(file);
+            if (!in) return false;
+            std::string line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\')) line.pop_back();
+                if (line.empty() || line[0] == '#') continue;
+
+                rule added;
+                added.base = base;
+                if (line[0] == '!') {
+                    added.negate = true;
+                    line.erase(0, 1);
+                }
+                if (!line.empty() && line.back() == '/') {
+                    added.dir_only = true;
+                    line.pop_back();
+                }
+                if (!line.empty() && line[0] == '/') {
+                    added.anchored = true;
+                    line.erase(0, 1);
+                }
+                if (line.empty()) continue;
+                if (line.find('/') != std::string::npos) added.anchored = true;
+                added.pattern = std::move(line);
+                rules.push_back(std::move(added));
+            }
+            return true;
+        }
+
+        size_t mark() const { return rules.size(); }
+        void pop(size_t mark) { rules.resize(mark); }
+
+        // path is relative to the walk root, without a trailing '/'
+        bool ignored(std::string_view path, bool is_dir) const {
+            for (auto it = rules.rbegin(); it != rules.rend(); ++it) {
+                if (it->dir_only && !is_dir) continue;
+                if (path.compare(0, it->base.size(), it->base) != 0) continue;
+                std::string_view relative = path.substr(it->base.size());
+                if (!it->anchored) {
+                    size_t slash = relative.rfind('/');
+                    if (slash != std::string_view::npos) relative.remove_prefix(slash + 1);
+                }
+                if (glob_match(it->pattern, relative)) return !it->negate;
+            }
+            return false;
+        }
+
+    private:
+        struct rule {
+            std::string pattern;
+            std::string base;
+            bool negate = false;
+            bool dir_only = false;
+            bool anchored = false;
+        };
+
+        std::vector<rule> rules;
+    };
+
+    // What one /add did
+    struct attach_report {
+        size_t added = 0;
+        size_t duplicate = 0;   // Already attached, or the same content under another path
+        size_t binary = 0;
+        size_t too_large = 0;
+        size_t ignored = 0;     // Files and directories left out by .gitignore
+        size_t missing = 0;     // Patterns that matched nothing
+    };
+
+    // Attached content chosen for one question
+    struct packed_context {
+        std::string text;
+        size_t files = 0;
+        size_t excerpts = 0;
+        size_t omitted = 0;     // Excerpts left out for the budget
+        size_t present = 0;     // Excerpts skipped because the conversation already holds them
+        size_t tokens = 0;
+    };
+
+    // Files attached to the conversation with /add. Patterns are expanded with .gitignore applied,
+    // files are read through mmap on several threads and binary ones dropped. Each file is cut into
+    // excerpts of a few dozen lines; for every question the excerpts are ranked against it (BM25,
+    // plus a boost for files it names) and packed into a token budget, skipping boilerplate repeated
+    // across files and lines the conversation already contains.
+    class file_context {
+    public:
+        explicit file_context(size_t max_file_bytes = 1 << 20) : max_file_bytes(max_file_bytes) {}
+
+        // Attaches files matching each pattern: a file, a directory (everything under it) or a glob such as src/**/*.cpp
+        attach_report add(const std::vector<std::string>& patterns) {
+            attach_report report;
+            std::vector<std::string> candidates;
+            for (const auto& pattern : patterns) {
+                size_t before = candidates.size();
+                expand(pattern, candidates, report);
+                if (candidates.size() == before) report.missing++;
+            }
+
+            // Read in parallel; each worker fills its own slots
+            std::vector<attached_file> loaded(candidates.size());
+            std::vector<read_status> status(candidates.size(), read_status::missing);
+            std::atomic<size_t> next{0};
+            auto work = [&]() {
+                for (size_t i = next++; i < candidates.size(); i = next++) {
+                    loaded[i].path = candidates[i];
+                    status[i] = read_file(loaded[i]);
+                }
+            };
+            unsigned threads = std::max(1u, std::min<unsigned>({8u, std::thread::hardware_concurrency(),
+                                                                static_cast<unsigned>(candidates.size() / 16 + 1)}));
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < threads; t++) workers.emplace_back(work);
+            work();
+            for (auto& worker : workers) worker.join();
+
+            for (size_t i = 0; i < loaded.size(); i++) {
+                switch (status[i]) {
+                case read_status::binary: report.binary++; continue;
+                case read_status::too_large: report.too_large++; continue;
+                case read_status::missing: continue;
+                case read_status::ok: break;
+                }
+                bool seen = std::any_of(files.begin(), files.end(), [&](const attached_file& file) {
+                    return (file.device == loaded[i].device && file.inode == loaded[i].inode) || file.hash == loaded[i].hash;
+                });
+                if (seen) {
+                    report.duplicate++;
+                    continue;
+                }
+                files.push_back(std::move(loaded[i]));
+                report.added++;
+            }
+            return report;
+        }
+
+        // Detaches files whose path matches pattern; returns how many
+        size_t remove(std::string_view pattern) {
+            size_t before = files.size();
+            files.erase(std::remove_if(files.begin(), files.end(), [&](const attached_file& file) {
+                return glob_match(pattern, file.path) || file.path.rfind(std::string(pattern) + "/", 0) == 0;
+            }), files.end());
+            return before - files.size();
+        }
+
+        void clear() { files.clear(); }
+        bool empty() const { return files.empty(); }
+        size_t size() const { return files.size(); }
+
+        size_t tokens() const {
+            size_t total = 0;
+            for (const auto& file : files) total += estimate_tokens(file.content);
+            return total;
+        }
+
+        std::vector<std::pair<std::string, size_t>> list() const {
+            std::vector<std::pair<std::string, size_t>> result;
+            for (const auto& file : files) result.emplace_back(file.path, estimate_tokens(file.content));
+            return result;
+        }
+
+        // The excerpts that best answer question within budget_tokens, in file order
+        packed_context pack(std::string_view question, size_t budget_tokens, const ollama::messages& history) {
+            refresh();
+            packed_context result;
+
+            // Lines already in the conversation, so pasted or quoted code is not sent twice
+            std::unordered_set<uint64_t> present;
+            history.for_each_content([&](const std::string& content) {
+                for_each_significant_line(content.data(), content.size(), [&](uint64_t hash) { present.insert(hash); });
+            });
+
+            struct candidate {
+                size_t file;
+                size_t chunk;
+                size_t cost;
+                double score = 0;
+            };
+            std::vector<candidate> candidates;
+            std::unordered_set<uint64_t> chunk_hashes;
+            size_t total_cost = 0;
+            for (size_t f = 0; f < files.size(); f++) {
+                for (size_t c = 0; c < files[f].chunks.size(); c++) {
+                    const excerpt& chunk = files[f].chunks[c];
+                    if (!chunk_hashes.insert(chunk.hash).second) continue;   // License headers and other repeats
+                    size_t known = 0;
+                    for (uint64_t line : chunk.lines) known += present.count(line);
+                    if (chunk.lines.size() >= 2 && known * 5 >= chunk.lines.size() * 4) {
+                        result.present++;
+                        continue;
+                    }
+                    size_t cost = (chunk.end - chunk.begin + 3) / 4 + header_tokens;
+                    candidates.push_back({f, c, cost});
+                    total_cost += cost;
+                }
+            }
+            if (candidates.empty()) return result;
+
+            std::vector<size_t> order(candidates.size());
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            if (total_cost > budget_tokens) {
+                score(question, candidates);
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return candidates[a].score > candidates[b].score; });
+            }
+
+            std::vector<bool> chosen(candidates.size(), false);
+            for (size_t i : order) {
+                if (result.tokens + candidates[i].cost > budget_tokens) continue;
+                chosen[i] = true;
+                result.tokens += candidates[i].cost;
+            }
+
+            // Runs of consecutive excerpts from one file become one block
+            result.text = "Files the user attached";
+            if (total_cost > budget_tokens) result.text += " (the parts most relevant to the question)";
+            result.text += ":\n\n";
+            size_t last_file = SIZE_MAX;
+            for (size_t i = 0; i < candidates.size();) {
+                if (!chosen[i]) {
+                    result.omitted++;
+                    i++;
+                    continue;
+                }
+                size_t j = i + 1;
+                while (j < candidates.size() && chosen[j] && candidates[j].file == candidates[i].file &&
+                       candidates[j].chunk == candidates[j - 1].chunk + 1) j++;
+
+                const attached_file& file = files[candidates[i].file];
+                const excerpt& first = file.chunks[candidates[i].chunk];
+                const excerpt& last = file.chunks[candidates[j - 1].chunk];
+                result.text += file.path;
+                if (first.begin != 0 || last.end != file.content.size())
+                    result.text += ", lines " + std::to_string(first.first_line) + "-" + std::to_string(last.last_line) +
+                                   " of " + std::to_string(file.chunks.back().last_line);
+                std::string_view body(file.content.data() + first.begin, last.end - first.begin);
+                std::string fence = fence_for(body);
+                result.text += ":\n" + fence + "\n";
+                result.text.append(body);
+                if (result.text.back() != '\n') result.text.push_back('\n');
+                result.text += fence + "\n\n";
+
+                if (candidates[i].file != last_file) result.files++;
+                last_file = candidates[i].file;
+                result.excerpts += j - i;
+                i = j;
+            }
+            return result;
+        }
+
+    private:
+        static constexpr size_t header_tokens = 16;
+        static constexpr size_t min_chunk_lines = 20;
+        static constexpr size_t max_chunk_lines = 60;
+        static constexpr size_t max_chunk_bytes = 3000;
+
+        struct excerpt {
+            size_t begin;
+            size_t end;
+            size_t first_line;
+            size_t last_line;
+            uint64_t hash;                                   // Ignoring whitespace
+            std::vector<uint64_t> lines;                     // Hashes of trimmed lines of 12+ bytes
+            std::vector<std::pair<uint64_t, uint32_t>> terms; // Sorted term hashes and counts
+            uint32_t length = 0;                             // Terms in all
+        };
+
+        struct attached_file {
+            std::string path;          // As the user named it
+            std::string content;
+            uint64_t device = 0;
+            uint64_t inode = 0;
+            int64_t mtime = 0;
+            uint64_t size = 0;
+            uint64_t hash = 0;
+            uint64_t stem = 0;         // Term hash of the file name without extension
+            std::vector<excerpt> chunks;
+        };
+
+        enum class read_status { ok, missing, binary, too_large };
+
+        static bool is_glob(std::string_view text) {
+            return text.find_first_of("*?[") != std::string_view::npos;
+        }
+
+        // Adds the files a pattern names to out
+        void expand(std::string pattern, std::vector<std::string>& out, attach_report& report) const {
+            if (pattern.rfind("~/", 0) == 0) {
+                if (const char* home = std::getenv("HOME")) pattern = home + pattern.substr(1);
+            }
+            while (pattern.size() > 1 && pattern.back() == '/') pattern.pop_back();
+
+            // The literal directories before the first wildcard are where the walk starts
+            std::string base;
+            std::string rest = pattern;
+            if (is_glob(pattern)) {
+                size_t wildcard = pattern.find_first_of("*?[");
+                size_t slash = pattern.rfind('/', wildcard);
+                base = slash == std::string::npos ? "" : pattern.substr(0, slash + 1);
+                rest = pattern.substr(base.size());
+            } else {
+                struct stat info;
+                if (stat(pattern.c_str(), &info) != 0) return;
+                if (S_ISREG(info.st_mode)) {
+                    out.push_back(pattern);   // Named outright, so .gitignore does not apply
+                    return;
+                }
+                if (!S_ISDIR(info.st_mode)) return;
+                base = pattern == "/" ? pattern : pattern + "/";
+                rest = "**";
+            }
+            if (base == "./") base.clear();
+
+            // .gitignore files from the repository root down to the base apply as in git
+            ignore_rules rules;
+            std::string root_relative;
+            char resolved[PATH_MAX];
+            if (realpath(base.empty() ? "." : base.c_str(), resolved)) {
+                std::string dir = resolved;
+                std::vector<std::string> chain;
+                std::string root;
+                for (std::string probe = dir;; probe = probe.substr(0, probe.rfind('/'))) {
+                    if (probe.empty()) probe = "/";
+                    chain.push_back(probe);
+                    if (access((probe + "/.git").c_str(), F_OK) == 0) {
+                        root = probe;
+                        break;
+                    }
+                    if (probe == "/") break;
+                }
+                if (!root.empty()) {
+                    rules.load(root + "/.git/info/exclude", "");
+                    for (size_t i = chain.size(); i-- > 1;) {
+                        std::string relative = chain[i] == root ? "" : chain[i].substr(root.size() + 1) + "/";
+                        rules.load(chain[i] + "/.gitignore", relative);
+                    }
+                    root_relative = dir == root ? "" : dir.substr(root.size() + (root == "/" ? 0 : 1)) + "/";
+                }
+            }
+
+            size_t depth = rest.find("**") != std::string::npos ? SIZE_MAX
+                         : static_cast<size_t>(std::count(rest.begin(), rest.end(), '/')) + 1;
+            walk(base, "", root_relative, rest, depth, rules, out, report);
+        }
+
+        // Visits dir (base + relative), matching files against pattern relative to the base
+        void walk(const std::string& base, const std::string& relative, const std::string& root_relative,
+                  const std::string& pattern, size_t depth, ignore_rules& rules,
+                  std::vector<std::string>& out, attach_report& report) const {
+            std::string dir = base + relative;
+            DIR* handle = opendir(dir.empty() ? "." : dir.c_str());
+            if (!handle) return;
+            size_t mark = rules.mark();
+            rules.load(dir + ".gitignore", root_relative + relative);
+
+            std::vector<std::pair<std::string, bool>> entries;
+            while (dirent* entry = readdir(handle)) {
+                std::string name = entry->d_name;
+                if (name == "." || name == ".." || name == ".git") continue;
+                bool is_dir = entry->d_type == DT_DIR;
+                bool is_file = entry->d_type == DT_REG;
+                if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+                    // Symlinks to files are followed; symlinked directories are not, so the walk cannot loop
+                    struct stat info;
+                    if (stat((dir + name).c_str(), &info) != 0) continue;
+                    is_file = S_ISREG(info.st_mode);
+                    is_dir = S_ISDIR(info.st_mode) && entry->d_type != DT_LNK;
+                }
+                if (!is_dir && !is_file) continue;
+                if (rules.ignored(root_relative + relative + name, is_dir)) {
+                    report.ignored++;
+                    continue;
+                }
+                entries.emplace_back(std::move(name), is_dir);
+            }
+            closedir(handle);
+
+            // Sorted so attachments keep a stable order between runs
+            std::sort(entries.begin(), entries.end());
+            for (const auto& [name, is_dir] : entries) {
+                std::string path = relative + name;
+                if (is_dir) {
+                    if (depth > 1) walk(base, path + "/", root_relative, pattern, depth - 1, rules, out, report);
+                } else if (glob_match(pattern, path, true)) {
+                    out.push_back(base + path);
+                }
+            }
+            rules.pop(mark);
+        }
+
+        // Maps the file and copies it out; a mapping is not kept because the file may be
+        // truncated while attached, which would fault on access
+        read_status read_file(attached_file& file) const {
+            int fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return read_status::missing;
+            struct stat info;
+            if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+                close(fd);
+                return read_status::missing;
+            }
+            if (static_cast<uint64_t>(info.st_size) > max_file_bytes) {
+                close(fd);
+                return read_status::too_large;
+            }
+
+            size_t size = static_cast<size_t>(info.st_size);
+            if (size > 0) {
+                void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    close(fd);
+                    return read_status::missing;
+                }
+                const char* data = static_cast<const char*>(mapped);
+                bool binary = looks_binary(data, size);
+                if (!binary) file.content.assign(data, size);
+                munmap(mapped, size);
+                if (binary) {
+                    close(fd);
+                    return read_status::binary;
+                }
+            }
+            close(fd);
+
+            file.device = static_cast<uint64_t>(info.st_dev);
+            file.inode = static_cast<uint64_t>(info.st_ino);
+            file.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+            file.size = size;
+            file.hash = ollama::fnv1a_64(file.content.data(), file.content.size());
+
+            std::string_view name = file.path;
+            name.remove_prefix(name.rfind('/') == std::string_view::npos ? 0 : name.rfind('/') + 1);
+            name = name.substr(0, name.find('.', 1));
+            file.stem = term_hash(name);
+
+            chunk(file);
+            return read_status::ok;
+        }
+
+        // Re-reads attached files that changed on disk and drops ones that are gone
+        void refresh() {
+            for (size_t i = 0; i < files.size();) {
+                struct stat info;
+                attached_file& file = files[i];
+                if (stat(file.path.c_str(), &info) == 0 &&
+                    static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec == file.mtime &&
+                    static_cast<uint64_t>(info.st_size) == file.size) {
+                    i++;
+                    continue;
+                }
+                attached_file reread;
+                reread.path = file.path;
+                if (read_file(reread) == read_status::ok) {
+                    file = std::move(reread);
+                    i++;
+                } else {
+                    files.erase(files.begin() + static_cast<ptrdiff_t>(i));
+                }
+            }
+        }
+
+        // Cuts a file into excerpts of up to 60 lines, ending at a blank line once past 20
+        static void chunk(attached_file& file) {
+            const std::string& text = file.content;
+            size_t begin = 0;
+            size_t line_number = 1;
+            while (begin < text.size()) {
+                excerpt part;
+                part.begin = begin;
+                part.first_line = line_number;
+                size_t position = begin;
+                size_t lines = 0;
+                while (position < text.size()) {
+                    const void* found = memchr(text.data() + position, '\n', text.size() - position);
+                    size_t end = found ? static_cast<size_t>(static_cast<const char*>(found) - text.data()) + 1 : text.size();
+                    bool blank = text.find_first_not_of(" \t\r\n", position) >= end;
+                    position = end;
+                    lines++;
+                    if (lines >= max_chunk_lines || position - begin >= max_chunk_bytes) break;
+                    if (lines >= min_chunk_lines && blank) break;
+                }
+                part.end = position;
+                part.last_line = line_number + lines - 1;
+                line_number += lines;
+                begin = position;
+
+                std::string_view body(text.data() + part.begin, part.end - part.begin);
+                // Whitespace is skipped so reindenting or rewrapping keeps the hash
+                uint64_t hash = ollama::fnv1a_64(nullptr, 0);
+                for (size_t at = body.find_first_not_of(" \t\r\n"); at != std::string_view::npos;) {
+                    size_t end = std::min(body.find_first_of(" \t\r\n", at), body.size());
+                    hash = ollama::fnv1a_64(body.data() + at, end - at, hash);
+                    at = body.find_first_not_of(" \t\r\n", end);
+                }
+                part.hash = hash;
+                for_each_significant_line(body.data(), body.size(), [&](uint64_t line) { part.lines.push_back(line); });
+
+                std::vector<uint64_t> terms;
+                for_each_term(body, [&](uint64_t term) { terms.push_back(term); });
+                part.length = static_cast<uint32_t>(terms.size());
+                std::sort(terms.begin(), terms.end());
+                for (size_t i = 0; i < terms.size();) {
+                    size_t j = i;
+                    while (j < terms.size() && terms[j] == terms[i]) j++;
+                    part.terms.emplace_back(terms[i], static_cast<uint32_t>(j - i));
+                    i = j;
+                }
+                file.chunks.push_back(std::move(part));
+            }
+        }
+
+        // BM25 of each excerpt against the question's terms; a file the question names gets a boost
+        template <typename Candidates>
+        void score(std::string_view question, Candidates& candidates) const {
+            std::vector<uint64_t> query;
+            for_each_term(question, [&](uint64_t term) { query.push_back(term); });
+            std::sort(query.begin(), query.end());
+            query.erase(std::unique(query.begin(), query.end()), query.end());
+
+            auto count_of = [](const excerpt& chunk, uint64_t term) -> uint32_t {
+                auto it = std::lower_bound(chunk.terms.begin(), chunk.terms.end(), std::make_pair(term, uint32_t(0)));
+                return it != chunk.terms.end() && it->first == term ? it->second : 0;
+            };
+
+            double total_length = 0;
+            for (const auto& c : candidates) total_length += files[c.file].chunks[c.chunk].length;
+            double average_length = std::max(1.0, total_length / static_cast<double>(candidates.size()));
+            double n = static_cast<double>(candidates.size());
+
+            for (uint64_t term : query) {
+                size_t df = 0;
+                for (const auto& c : candidates) df += count_of(files[c.file].chunks[c.chunk], term) > 0;
+                if (df == 0) continue;
+                double idf = std::log(1.0 + (n - static_cast<double>(df) + 0.5) / (static_cast<double>(df) + 0.5));
+                for (auto& c : candidates) {
+                    const excerpt& chunk = files[c.file].chunks[c.chunk];
+                    double tf = count_of(chunk, term);
+                    if (tf > 0) c.score += idf * tf * 2.2 / (tf + 1.2 * (0.25 + 0.75 * chunk.length / average_length));
+                    if (files[c.file].stem == term) c.score += 2.0;
+                }
+            }
+            // With nothing else to go on, the top of each file says the most about it
+            for (auto& c : candidates) {
+                if (c.chunk == 0) c.score += 0.01;
+            }
+        }
+
+        // Calls visit(hash) for each identifier or word, lowercased, and for the parts of snake_case and camelCase ones
+        template <typename Visit>
+        static void for_each_term(std::string_view text, Visit&& visit) {
+            auto word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+            size_t i = 0;
+            while (i < text.size()) {
+                if (!word(text[i])) {
+                    i++;
+                    continue;
+                }
+                size_t start = i;
+                while (i < text.size() && word(text[i])) i++;
+                std::string_view token = text.substr(start, i - start);
+                if (token.size() < 2 || token.size() > 64) continue;
+                visit(term_hash(token));
+
+                size_t part = 0;
+                bool split = false;
+                for (size_t k = 1; k <= token.size(); k++) {
+                    bool boundary = k == token.size() || token[k] == '_' ||
+                                    (std::isupper(static_cast<unsigned char>(token[k])) && std::islower(static_cast<unsigned char>(token[k - 1])));
+                    if (!boundary) continue;
+                    if (k < token.size()) split = true;
+                    if (split && k - part >= 2) visit(term_hash(token.substr(part, k - part)));
+                    part = k < token.size() && token[k] == '_' ? k + 1 : k;
+                }
+            }
+        }
+
+        // Case-insensitive: hashed from a lowered copy, a block at a time
+        static uint64_t term_hash(std::string_view term) {
+            uint64_t hash = ollama::fnv1a_64(nullptr, 0);
+            char lowered[64];
+            for (size_t at = 0; at < term.size(); at += sizeof(lowered)) {
+                size_t length = std::min(term.size() - at, sizeof(lowered));
+                for (size_t i = 0; i < length; i++) lowered[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(term[at + i])));
+                hash = ollama::fnv1a_64(lowered, length, hash);
+            }
+            return hash;
+        }
+
+        // A backtick fence longer than any backtick run in text, so the excerpt cannot close it early
+        static std::string fence_for(std::string_view text) {
+            size_t longest = 0;
+            for (size_t at = text.find('`'); at != std::string_view::npos;) {
+                size_t end = std::min(text.find_first_not_of('`', at), text.size());
+                longest = std::max(longest, end - at);
+                at = text.find('`', end);
+            }
+            return std::string(std::max<size_t>(3, longest + 1), '`');
+        }
+
+        // Calls visit(hash) for each line of at least 12 bytes once leading and trailing whitespace is trimmed
+        template <typename Visit>
+        static void for_each_significant_line(const char* data, size_t size, Visit&& visit) {
+            size_t position = 0;
+            while (position < size) {
+                const void* found = memchr(data + position, '\n', size - position);
+                size_t end = found ? static_cast<size_t>(static_cast<const char*>(found) - data) : size;
+                size_t first = position;
+                size_t last = end;
+                while (first < last && std::isspace(static_cast<unsigned char>(data[first]))) first++;
+                while (last > first && std::isspace(static_cast<unsigned char>(data[last - 1]))) last--;
+                if (last - first >= 12) visit(ollama::fnv1a_64(data + first, last - first));
+                position = end + 1;
+            }
+        }
+
+        size_t max_file_bytes;
+        std::vector<attached_file> files;
+    };
+}
+
+#endif // FILE_CONTEXT_HPP
@@ -0,0 +1,656 @@
+#ifndef SESSION_INDEX_HPP
+#define SESSION_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "session_log.hpp"
+
+namespace termsage {
+
+    struct search_hit {
+        std::string session; // Log name without the .log suffix
+        session_role role;
+        double score;
+        std::string snippet;
+        std::vector<std::pair<size_t, size_t>> highlights; // Byte ranges of matched terms in snippet
+    };
+
+    // Splits text into lowercase terms: runs of ASCII letters and digits plus any non-ASCII
+    // bytes, so UTF-8 words stay whole. emit(term, begin, end) gets byte offsets into text.
+    template <typename Emit>
+    inline void for_each_term(std::string_view text, Emit&& emit) {
+        constexpr size_t max_term = 64;
+        std::string term;
+        size_t begin = 0;
+        for (size_t i = 0; i <= text.size(); i++) {
+            unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+            if (std::isalnum(c) || c >= 0x80) {
+                if (term.empty()) begin = i;
+                if (term.size() < max_term) term.push_back(static_cast<char>(std::tolower(c)));
+                continue;
+            }
+            if (term.size() >= 2 || (term.size() == 1 && std::isdigit(static_cast<unsigned char>(term[0])))) emit(term, begin, i);
+            term.clear();
+        }
+    }
+
+    // Intersection of two ascending id lists. Each id of the shorter list is compared against
+    // four ids of the longer one at a time, so the longer list is skipped through in blocks.
+    inline std::vector<uint32_t> intersect_postings(const std::vector<uint32_t>& first, const std::vector<uint32_t>& second) {
+        const std::vector<uint32_t>& a = first.size() <= second.size() ? first : second;
+        const std::vector<uint32_t>& b = first.size() <= second.size() ? second : first;
+        std::vector<uint32_t> out;
+        out.reserve(a.size());
+
+        size_t j = 0;
+        for (uint32_t id : a) {
+#if defined(__SSE2__) || defined(__ARM_NEON)
+            while (j + 4 <= b.size() && b[j + 3] < id) j += 4;
+            if (j + 4 <= b.size()) {
+#if defined(__SSE2__)
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + j));
+                bool found = _mm_movemask_epi8(_mm_cmpeq_epi32(block, _mm_set1_epi32(static_cast<int>(id)))) != 0;
+#else
+                bool found = vmaxvq_u32(vceqq_u32(vld1q_u32(b.data() + j), vdupq_n_u32(id))) != 0;
+#endif
+                if (found) out.push_back(id);
+                continue;
+            }
+#endif
+            while (j < b.size() && b[j] < id) j++;
+            if (j == b.size()) break;
+            if (b[j] == id) out.push_back(id);
+        }
+        return out;
+    }
+
+    // Inverted index over every session log, kept next to the logs in index.bin.
+    // Postings are doc-id deltas and term frequencies as varints. update() only reads the
+    // bytes appended to each log since it last ran; new postings collect in memory and are
+    // merged into the mapped file by save(). Queries binary-search the mapped term table,
+    // intersect the posting lists and rank the matches with BM25.
+    class session_index {
+    public:
+        explicit session_index(std::string dir = default_session_dir()) : dir(std::move(dir)) {
+            load();
+        }
+
+        ~session_index() {
+            wait();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!delta.empty() || files_changed) save_locked();
+            unmap();
+        }
+
+        session_index(const session_index&) = delete;
+        session_index& operator=(const session_index&) = delete;
+
+        // Indexes whatever was appended to the logs since the last call; returns the new documents
+        size_t update() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return update_locked();
+        }
+
+        // Runs update() and save() on a worker thread, for catching up at startup
+        void update_in_background() {
+            wait();
+            worker = std::thread([this]() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (update_locked() > 0 || files_changed) save_locked();
+            });
+        }
+
+        void wait() {
+            if (worker.joinable()) worker.join();
+        }
+
+        bool save() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return save_locked();
+        }
+
+        size_t document_count() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return docs.size();
+        }
+
+        // Best matches for all query terms; if no document has every term, for any of them
+        std::vector<search_hit> search(std::string_view query, size_t limit = 10) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<std::string> terms;
+            for_each_term(query, [&](const std::string& term, size_t, size_t) {
+                if (std::find(terms.begin(), terms.end(), term) == terms.end()) terms.push_back(term);
+            });
+            if (terms.empty() || docs.empty()) return {};
+
+            std::vector<std::vector<uint32_t>> ids(terms.size()), tfs(terms.size());
+            for (size_t t = 0; t < terms.size(); t++) postings_for(terms[t], ids[t], tfs[t]);
+
+            // Shortest lists first keeps every intersection as small as possible
+            std::vector<size_t> order(terms.size());
+            for (size_t t = 0; t < order.size(); t++) order[t] = t;
+            std::sort(order.begin(), order.end(), [&](size_t x, size_t y) { return ids[x].size() < ids[y].size(); });
+            std::vector<uint32_t> matches = ids[order[0]];
+            for (size_t k = 1; k < order.size() && !matches.empty(); k++) matches = intersect_postings(matches, ids[order[k]]);
+
+            if (matches.empty()) {
+                for (const auto& list : ids) matches.insert(matches.end(), list.begin(), list.end());
+                std::sort(matches.begin(), matches.end());
+                matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+            }
+            if (matches.empty()) return {};
+
+            // BM25 with the usual k1 = 1.2, b = 0.75
+            const double k1 = 1.2, b = 0.75;
+            double n = static_cast<double>(docs.size());
+            double average = std::max(1.0, static_cast<double>(total_tokens) / n);
+            std::vector<double> scores(matches.size(), 0.0);
+            for (size_t t = 0; t < terms.size(); t++) {
+                double df = static_cast<double>(ids[t].size());
+                if (df == 0) continue;
+                double idf = std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+                size_t p = 0;
+                for (size_t m = 0; m < matches.size() && p < ids[t].size(); m++) {
+                    while (p < ids[t].size() && ids[t][p] < matches[m]) p++;
+                    if (p == ids[t].size() || ids[t][p] != matches[m]) continue;
+                    double tf = tfs[t][p];
+                    double length = docs[matches[m]].tokens;
+                    scores[m] += idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * length / average));
+                }
+            }
+
+            std::vector<size_t> ranked(matches.size());
+            for (size_t m = 0; m < ranked.size(); m++) ranked[m] = m;
+            size_t count = std::min(limit, ranked.size());
+            std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [&](size_t x, size_t y) {
+                return scores[x] != scores[y] ? scores[x] > scores[y] : matches[x] > matches[y];
+            });
+
+            std::vector<search_hit> hits;
+            for (size_t r = 0; r < count; r++) {
+                const doc_info& doc = docs[matches[ranked[r]]];
+                search_hit hit;
+                const std::string& name = files[doc.file].name;
+                hit.session = name.substr(0, name.size() - 4);
+                hit.role = static_cast<session_role>(doc.role);
+                hit.score = scores[ranked[r]];
+                make_snippet(read_document(doc), terms, hit);
+                hits.push_back(std::move(hit));
+            }
+            return hits;
+        }
+
+    private:
+        struct file_info {
+            std::string name;
+            uint64_t indexed_size = 0;
+        };
+
+        // Location of one logged turn and its length in terms
+        struct doc_info {
+            uint32_t file;
+            uint32_t length;
+            uint64_t offset;
+            uint32_t tokens;
+            uint16_t role;
+            uint16_t reserved;
+        };
+
+        // Fixed-size slot of the sorted term table
+        struct term_entry {
+            uint32_t term_offset;
+            uint32_t term_length;
+            uint64_t postings_offset;
+            uint32_t postings_length;
+            uint32_t df;
+            uint32_t last_doc;
+            uint32_t reserved;
+        };
+
+        // Postings added since the last save; the first doc id is absolute
+        struct delta_postings {
+            std::string bytes;
+            uint32_t df = 0;
+            uint32_t last_doc = 0;
+        };
+
+        static constexpr char magic[8] = {'T', 'S', 'S', 'I', 'D', 'X', '0', '2'};
+        static constexpr size_t header_fields = 7;
+        static constexpr size_t delta_limit = 64 << 20;
+
+        static void put_varint(std::string& out, uint32_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        static bool get_varint(const unsigned char*& p, const unsigned char* end, uint32_t& value) {
+            value = 0;
+            for (int shift = 0; shift < 35 && p < end; shift += 7) {
+                unsigned char byte = *p++;
+                value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        // Stops at the first id that is not below doc_count, so a damaged list never indexes past docs
+        static void decode(const char* data, size_t length, uint32_t previous, size_t doc_count,
+                           std::vector<uint32_t>& ids, std::vector<uint32_t>& tfs) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+            const unsigned char* end = p + length;
+            uint32_t gap, tf;
+            while (p < end && get_varint(p, end, gap) && get_varint(p, end, tf)) {
+                if (gap > doc_count || previous + gap >= doc_count) return;
+                previous += gap;
+                ids.push_back(previous);
+                tfs.push_back(tf);
+            }
+        }
+
+        std::string index_path() const { return dir + "/index.bin"; }
+
+        // ---- ingest ---------------------------------------------------------------------
+
+        size_t update_locked() {
+            std::vector<std::string> names;
+            if (DIR* handle = opendir(dir.c_str())) {
+                while (struct dirent* entry = readdir(handle)) {
+                    std::string name = entry->d_name;
+                    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0) names.push_back(name);
+                }
+                closedir(handle);
+            }
+            std::sort(names.begin(), names.end());
+
+            size_t before = docs.size();
+            for (const auto& name : names) {
+                uint32_t file = file_id(name);
+                std::string path = dir + "/" + name;
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1) continue;
+                struct stat st;
+                if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) <= files[file].indexed_size) {
+                    ::close(fd);
+                    continue;
+                }
+
+                size_t size = static_cast<size_t>(st.st_size);
+                void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (base == MAP_FAILED) continue;
+                const char* data = static_cast<const char*>(base);
+                size_t end = session_log::scan_records(data, size, files[file].indexed_size,
+                    [&](const session_record& record, size_t payload) {
+                        if (record.role == session_role::user || record.role == session_role::assistant)
+                            add_document(file, record, payload);
+                    });
+                munmap(base, size);
+                if (end > files[file].indexed_size) {
+                    files[file].indexed_size = end;
+                    files_changed = true;
+                }
+                if (delta_bytes > delta_limit) save_locked();
+            }
+            return docs.size() - before;
+        }
+
+        uint32_t file_id(const std::string& name) {
+            auto it = file_ids.find(name);
+            if (it != file_ids.end()) return it->second;
+            uint32_t id = static_cast<uint32_t>(files.size());
+            files.push_back({name, 0});
+            file_ids[name] = id;
+            return id;
+        }
+
+        void add_document(uint32_t file, const session_record& record, size_t payload) {
+            uint32_t id = static_cast<uint32_t>(docs.size());
+            std::unordered_map<std::string, uint32_t> counts;
+            uint32_t tokens = 0;
+            for_each_term(record.content, [&](const std::string& term, size_t, size_t) {
+                counts[term]++;
+                tokens++;
+            });
+
+            for (const auto& [term, tf] : counts) {
+                delta_postings& list = delta[term];
+                size_t before = list.bytes.size();
+                put_varint(list.bytes, list.df == 0 ? id : id - list.last_doc);
+                put_varint(list.bytes, tf);
+                list.df++;
+                list.last_doc = id;
+                delta_bytes += list.bytes.size() - before;
+            }
+            docs.push_back({file, static_cast<uint32_t>(record.content.size()), payload, tokens, static_cast<uint16_t>(record.role), 0});
+            total_tokens += tokens;
+        }
+
+        // ---- lookup ---------------------------------------------------------------------
+
+        term_entry base_entry(size_t i) const {
+            term_entry entry;
+            memcpy(&entry, base_terms + i * sizeof(term_entry), sizeof(entry));
+            return entry;
+        }
+
+        std::string_view base_term(const term_entry& entry) const {
+            if (entry.term_offset > strings_size || entry.term_length > strings_size - entry.term_offset) return {};
+            return std::string_view(base_strings + entry.term_offset, entry.term_length);
+        }
+
+        bool find_base(const std::string& term, term_entry& found) const {
+            size_t low = 0, high = base_term_count;
+            while (low < high) {
+                size_t middle = low + (high - low) / 2;
+                term_entry entry = base_entry(middle);
+                int order = base_term(entry).compare(term);
+                if (order == 0) {
+                    found = entry;
+                    return entry.postings_offset <= postings_size && entry.postings_length <= postings_size - entry.postings_offset;
+                }
+                if (order < 0) low = middle + 1;
+                else high = middle;
+            }
+            return false;
+        }
+
+        void postings_for(const std::string& term, std::vector<uint32_t>& ids, std::vector<uint32_t>& tfs) const {
+            term_entry entry;
+            if (find_base(term, entry)) {
+                ids.reserve(entry.df);
+                tfs.reserve(entry.df);
+                if (entry.postings_offset <= postings_size && entry.postings_length <= postings_size - entry.postings_offset)
+                    decode(base_postings + entry.postings_offset, entry.postings_length, 0, docs.size(), ids, tfs);
+            }
+            // Delta ids all come after the saved ones, so the lists simply concatenate
+            auto it = delta.find(term);
+            if (it != delta.end()) decode(it->second.bytes.data(), it->second.bytes.size(), 0, docs.size(), ids, tfs);
+        }
+
+        std::string read_document(const doc_info& doc) const {
+            std::string content(doc.length, '\0');
+            std::string path = dir + "/" + files[doc.file].name;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return std::string();
+            ssize_t n = pread(fd, content.data(), content.size(), static_cast<off_t>(doc.offset));
+            ::close(fd);
+            if (n != static_cast<ssize_t>(content.size())) return std::string();
+            return content;
+        }
+
+        // About 160 bytes around the first match, on UTF-8 boundaries, with every match marked
+        static void make_snippet(const std::string& content, const std::vector<std::string>& terms, search_hit& hit) {
+            constexpr size_t before = 60, width = 160;
+            size_t first = std::string::npos;
+            for_each_term(content, [&](const std::string& term, size_t begin, size_t) {
+                if (first == std::string::npos && std::find(terms.begin(), terms.end(), term) != terms.end()) first = begin;
+            });
+            if (first == std::string::npos) first = 0;
+
+            auto continuation = [&](size_t i) {
+                return i < content.size() && (static_cast<unsigned char>(content[i]) & 0xC0) == 0x80;
+            };
+            size_t start = first > before ? first - before : 0;
+            while (start > 0 && start < first && content[start - 1] != ' ' && content[start - 1] != '\n') start++;
+            while (continuation(start)) start++;
+            size_t end = std::min(content.size(), start + width);
+            while (end > start && continuation(end)) end--;
+
+            std::string lead = start > 0 ? "…" : "";
+            hit.snippet = lead + content.substr(start, end - start) + (end < content.size() ? "…" : "");
+            for (size_t i = lead.size(); i < lead.size() + (end - start); i++) {
+                if (hit.snippet[i] == '\n' || hit.snippet[i] == '\t' || hit.snippet[i] == '\r') hit.snippet[i] = ' ';
+            }
+            for_each_term(std::string_view(content).substr(start, end - start), [&](const std::string& term, size_t begin, size_t stop) {
+                if (std::find(terms.begin(), terms.end(), term) != terms.end())
+                    hit.highlights.emplace_back(lead.size() + begin, lead.size() + stop);
+            });
+        }
+
+        // ---- persistence ----------------------------------------------------------------
+        //
+        // Layout: magic, seven u64 header fields (files, docs, terms, total tokens, bytes of the
+        // file section, strings, postings), an FNV-1a checksum of the header fields and everything
+        // after the checksum, the file section, padding to 8 bytes, then the doc table, term table,
+        // strings and postings.
+
+        void load() {
+            int fd = ::open(index_path().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return;
+            }
+            size_t size = static_cast<size_t>(st.st_size);
+            void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED) return;
+            mapped = static_cast<char*>(base);
+            mapped_size = size;
+            if (!parse()) {
+                unmap();
+                files.clear();
+                file_ids.clear();
+                docs.clear();
+                total_tokens = 0;
+            }
+        }
+
+        bool parse() {
+            size_t fixed = sizeof(magic) + (header_fields + 1) * 8;
+            if (mapped_size < fixed || memcmp(mapped, magic, sizeof(magic)) != 0) return false;
+            uint64_t header[header_fields + 1];
+            memcpy(header, mapped + sizeof(magic), sizeof(header));
+            uint64_t file_count = header[0], doc_count = header[1], term_count = header[2];
+            uint64_t files_size = header[4];
+            if (files_size > mapped_size - fixed) return false;
+            uint64_t checksum = ollama::fnv1a_64(mapped + sizeof(magic), header_fields * 8);
+            checksum = ollama::fnv1a_64(mapped + fixed, mapped_size - fixed, checksum);
+            if (checksum != header[header_fields]) return false;
+
+            const char* p = mapped + fixed;
+            const char* files_end = p + files_size;
+            for (uint64_t i = 0; i < file_count; i++) {
+                if (files_end - p < 12) return false;
+                file_info info;
+                uint32_t length;
+                memcpy(&info.indexed_size, p, 8);
+                memcpy(&length, p + 8, 4);
+                p += 12;
+                if (static_cast<size_t>(files_end - p) < length) return false;
+                info.name.assign(p, length);
+                p += length;
+                file_ids[info.name] = static_cast<uint32_t>(files.size());
+                files.push_back(std::move(info));
+            }
+
+            size_t offset = (fixed + files_size + 7) & ~static_cast<size_t>(7);
+            uint64_t tables = doc_count * sizeof(doc_info) + term_count * sizeof(term_entry);
+            if (offset > mapped_size || tables > mapped_size - offset ||
+                header[5] + header[6] != mapped_size - offset - tables) return false;
+
+            docs.resize(doc_count);
+            memcpy(docs.data(), mapped + offset, doc_count * sizeof(doc_info));
+            offset += doc_count * sizeof(doc_info);
+            for (const auto& doc : docs) {
+                if (doc.file >= files.size()) return false;
+            }
+            base_terms = mapped + offset;
+            base_term_count = term_count;
+            offset += term_count * sizeof(term_entry);
+            base_strings = mapped + offset;
+            strings_size = header[5];
+            base_postings = base_strings + strings_size;
+            postings_size = header[6];
+            total_tokens = header[3];
+            return true;
+        }
+
+        void unmap() {
+            if (mapped) munmap(mapped, mapped_size);
+            mapped = nullptr;
+            mapped_size = 0;
+            base_terms = base_strings = base_postings = nullptr;
+            base_term_count = strings_size = postings_size = 0;
+        }
+
+        // Merges the saved terms with the in-memory ones into a new file, then maps that
+        bool save_locked() {
+            std::vector<const std::string*> added;
+            added.reserve(delta.size());
+            for (const auto& item : delta) added.push_back(&item.first);
+            std::sort(added.begin(), added.end(), [](const std::string* x, const std::string* y) { return *x < *y; });
+
+            std::vector<term_entry> terms;
+            terms.reserve(base_term_count + added.size());
+            std::string strings, postings;
+            strings.reserve(strings_size);
+            postings.reserve(postings_size + delta_bytes);
+
+            auto emit = [&](std::string_view term, uint32_t df, uint32_t last_doc) {
+                term_entry entry{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(term.size()),
+                                 0, 0, df, last_doc, 0};
+                strings.append(term.data(), term.size());
+                terms.push_back(entry);
+            };
+
+            size_t i = 0, j = 0;
+            while (i < base_term_count || j < added.size()) {
+                term_entry saved{};
+                std::string_view saved_term;
+                if (i < base_term_count) {
+                    saved = base_entry(i);
+                    saved_term = base_term(saved);
+                }
+                int order = i == base_term_count ? 1 : j == added.size() ? -1 : saved_term.compare(*added[j]);
+                size_t start = postings.size();
+
+                if (order <= 0) {
+                    if (saved.postings_offset <= postings_size && saved.postings_length <= postings_size - saved.postings_offset)
+                        postings.append(base_postings + saved.postings_offset, saved.postings_length);
+                }
+                if (order >= 0) {
+                    const delta_postings& list = delta.at(*added[j]);
+                    if (order == 0) {
+                        // The first delta id is absolute; rebase it onto the saved list
+                        const unsigned char* p = reinterpret_cast<const unsigned char*>(list.bytes.data());
+                        const unsigned char* end = p + list.bytes.size();
+                        uint32_t first;
+                        get_varint(p, end, first);
+                        put_varint(postings, first - saved.last_doc);
+                        postings.append(reinterpret_cast<const char*>(p), static_cast<size_t>(end - p));
+                        emit(saved_term, saved.df + list.df, list.last_doc);
+                    } else {
+                        postings.append(list.bytes);
+                        emit(*added[j], list.df, list.last_doc);
+                    }
+                    j++;
+                } else {
+                    emit(saved_term, saved.df, saved.last_doc);
+                }
+                if (order <= 0) i++;
+                terms.back().postings_offset = start;
+                terms.back().postings_length = static_cast<uint32_t>(postings.size() - start);
+            }
+
+            std::string file_section;
+            for (const auto& file : files) {
+                uint32_t length = static_cast<uint32_t>(file.name.size());
+                file_section.append(reinterpret_cast<const char*>(&file.indexed_size), 8);
+                file_section.append(reinterpret_cast<const char*>(&length), 4);
+                file_section += file.name;
+            }
+            uint64_t header[header_fields + 1] = {files.size(), docs.size(), terms.size(), total_tokens,
+                                                  file_section.size(), strings.size(), postings.size(), 0};
+            size_t fixed = sizeof(magic) + sizeof(header) + file_section.size();
+            std::string padding((8 - fixed % 8) % 8, '\0');
+
+            uint64_t checksum = ollama::fnv1a_64(reinterpret_cast<const char*>(header), header_fields * 8);
+            checksum = ollama::fnv1a_64(file_section.data(), file_section.size(), checksum);
+            checksum = ollama::fnv1a_64(padding.data(), padding.size(), checksum);
+            checksum = ollama::fnv1a_64(reinterpret_cast<const char*>(docs.data()), docs.size() * sizeof(doc_info), checksum);
+            checksum = ollama::fnv1a_64(reinterpret_cast<const char*>(terms.data()), terms.size() * sizeof(term_entry), checksum);
+            checksum = ollama::fnv1a_64(strings.data(), strings.size(), checksum);
+            checksum = ollama::fnv1a_64(postings.data(), postings.size(), checksum);
+            header[header_fields] = checksum;
+
+            std::string temporary = index_path() + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                out.write(magic, sizeof(magic));
+                out.write(reinterpret_cast<const char*>(header), sizeof(header));
+                out << file_section << padding;
+                out.write(reinterpret_cast<const char*>(docs.data()), static_cast<std::streamsize>(docs.size() * sizeof(doc_info)));
+                out.write(reinterpret_cast<const char*>(terms.data()), static_cast<std::streamsize>(terms.size() * sizeof(term_entry)));
+                out << strings << postings;
+                if (!out) return false;
+            }
+            if (std::rename(temporary.c_str(), index_path().c_str()) != 0) return false;
+
+            // Map the merged file; if that fails everything is re-indexed by the next update()
+            unmap();
+            delta.clear();
+            delta_bytes = 0;
+            files_changed = false;
+            size_t expected = docs.size();
+            files.clear();
+            file_ids.clear();
+            docs.clear();
+            total_tokens = 0;
+            load();
+            return docs.size() == expected;
+        }
+
+        std::string dir;
+        mutable std::mutex mutex;
+        std::thread worker;
+
+        std::vector<file_info> files;
+        std::unordered_map<std::string, uint32_t> file_ids;
+        std::vector<doc_info> docs;
+        uint64_t total_tokens = 0;
+        bool files_changed = false;
+
+        std::unordered_map<std::string, delta_postings> delta;
+        size_t delta_bytes = 0;
+
+        char* mapped = nullptr;
+        size_t mapped_size = 0;
+        const char* base_terms = nullptr;
+        size_t base_term_count = 0;
+        const char* base_strings = nullptr;
+        size_t strings_size = 0;
+        const char* base_postings = nullptr;
+        size_t postings_size = 0;
+    };
+}
+
+#endif // SESSION_INDEX_HPP
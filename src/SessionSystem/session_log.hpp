@@ -0,0 +1,376 @@
+#ifndef SESSION_LOG_HPP
+#define SESSION_LOG_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "../ExternalDependencies/ollama_fixed.hpp"
+
+namespace termsage {
+
+    // parent records start a forked log: "<parent log name>\n<messages shared>"
+    enum class session_role : uint16_t { model = 0, system = 1, user = 2, assistant = 3, parent = 4 };
+
+    // One logged turn; content points into the mapped log and lives as long as it does
+    struct session_record {
+        session_role role;
+        std::string_view content;
+    };
+
+    // $XDG_STATE_HOME/termsage/sessions, falling back to ~/.local/state
+    inline std::string default_session_dir() {
+        std::string base;
+        if (const char* state = std::getenv("XDG_STATE_HOME")) {
+            base = state;
+        } else if (const char* home = std::getenv("HOME")) {
+            base = std::string(home) + "/.local";
+            mkdir(base.c_str(), 0755);
+            base += "/state";
+        } else {
+            return ".";
+        }
+
+        mkdir(base.c_str(), 0755);
+        base += "/termsage";
+        mkdir(base.c_str(), 0700);
+        base += "/sessions";
+        mkdir(base.c_str(), 0700);
+        return base;
+    }
+
+    // A fresh log name that sorts by start time
+    inline std::string new_session_path(const std::string& dir = default_session_dir()) {
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+        std::string base = dir + "/" + stamp + "-" + std::to_string(getpid());
+        std::string path = base + ".log";
+        for (int copy = 2; access(path.c_str(), F_OK) == 0; copy++) path = base + "-" + std::to_string(copy) + ".log";
+        return path;
+    }
+
+    // The most recently written log in dir, or an empty string
+    inline std::string latest_session_path(const std::string& dir = default_session_dir()) {
+        DIR* handle = opendir(dir.c_str());
+        if (!handle) return std::string();
+
+        std::string latest;
+        struct timespec latest_time{};
+        while (struct dirent* entry = readdir(handle)) {
+            std::string name = entry->d_name;
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".log") != 0) continue;
+            std::string path = dir + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) continue;
+            if (latest.empty() || st.st_mtim.tv_sec > latest_time.tv_sec ||
+                (st.st_mtim.tv_sec == latest_time.tv_sec && st.st_mtim.tv_nsec > latest_time.tv_nsec)) {
+                latest = path;
+                latest_time = st.st_mtim;
+            }
+        }
+        closedir(handle);
+        return latest;
+    }
+
+    // Append-only log of a chat session. Each turn is one framed, checksummed record written
+    // with a single write(2) as soon as it happens, so a crash loses at most the reply being
+    // generated; a background thread batches fdatasync() so disk flushes never block typing.
+    // Opening an existing log mmaps it and indexes the frames without touching JSON.
+    class session_log {
+    public:
+        explicit session_log(std::chrono::milliseconds sync_interval = std::chrono::milliseconds(1000))
+            : sync_interval(sync_interval) {}
+
+        ~session_log() { close_log(); }
+
+        session_log(const session_log&) = delete;
+        session_log& operator=(const session_log&) = delete;
+
+        // Opens or creates the log; false if it cannot be used (the session then runs unlogged)
+        bool open(const std::string& log_path) {
+            close_log();
+            bool created = access(log_path.c_str(), F_OK) != 0;
+            fd = ::open(log_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+            if (fd == -1) return false;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close_log();
+                return false;
+            }
+
+            if (st.st_size == 0) {
+                if (::write(fd, magic, sizeof(magic)) != static_cast<ssize_t>(sizeof(magic))) {
+                    close_log();
+                    return false;
+                }
+                if (created) sync_directory(log_path);
+            } else if (!index_existing(static_cast<size_t>(st.st_size))) {
+                // Not a session log; refuse rather than append to someone else's file
+                close_log();
+                return false;
+            }
+
+            path_ = log_path;
+            stopping = false;
+            flusher = std::thread([this]() { flush_loop(); });
+            return true;
+        }
+
+        bool is_open() const { return fd != -1; }
+        const std::string& path() const { return path_; }
+
+        // Records found on disk when the log was opened
+        const std::vector<session_record>& records() const { return loaded; }
+
+        // Model of the most recent model record, if any
+        std::string model() const {
+            for (auto it = loaded.rbegin(); it != loaded.rend(); ++it) {
+                if (it->role == session_role::model) return std::string(it->content);
+            }
+            return std::string();
+        }
+
+        // Rebuilds chat history from the loaded records, following parent logs of forks;
+        // returns the number of turns added
+        size_t replay(ollama::messages& history) const {
+            size_t turns = 0;
+            replay_records(loaded, directory(), SIZE_MAX, history, turns, 0);
+            return turns;
+        }
+
+        bool append(session_role role, std::string_view content) {
+            if (fd == -1 || content.size() > UINT32_MAX) return false;
+
+            record_header header{static_cast<uint32_t>(content.size()), static_cast<uint16_t>(role), 0, 0};
+            header.checksum = checksum(header.role, content.data(), content.size());
+            std::string frame(reinterpret_cast<const char*>(&header), sizeof(header));
+            frame.append(content.data(), content.size());
+
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t written = 0;
+            while (written < frame.size()) {
+                ssize_t n = ::write(fd, frame.data() + written, frame.size() - written);
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                written += static_cast<size_t>(n);
+            }
+            unsynced += frame.size();
+            if (unsynced >= sync_bytes) wake.notify_one();
+            return true;
+        }
+
+        // Calls visit(record, payload_offset) for each intact record of a mapped log, starting at
+        // offset (0 for the beginning). Returns where the intact records end, or 0 if data is not a log.
+        template <typename Visit>
+        static size_t scan_records(const char* data, size_t size, size_t offset, Visit&& visit) {
+            if (size < sizeof(magic) || memcmp(data, magic, sizeof(magic)) != 0) return 0;
+            if (offset < sizeof(magic)) offset = sizeof(magic);
+
+            while (offset + sizeof(record_header) <= size) {
+                record_header header;
+                memcpy(&header, data + offset, sizeof(header));
+                size_t payload = offset + sizeof(header);
+                if (header.length > size - payload || header.role > static_cast<uint16_t>(session_role::parent)) break;
+                if (checksum(header.role, data + payload, header.length) != header.checksum) break;
+                visit(session_record{static_cast<session_role>(header.role), std::string_view(data + payload, header.length)}, payload);
+                offset = payload + header.length;
+            }
+            return offset;
+        }
+
+        // Starts a forked log: its first messages are the first `messages` of the log at parent_path,
+        // which must be in the same directory. The shared turns are neither copied nor indexed twice.
+        bool append_parent(const std::string& parent_path, size_t messages) {
+            std::string name = parent_path.substr(parent_path.rfind('/') + 1);
+            return append(session_role::parent, name + "\n" + std::to_string(messages));
+        }
+
+        // Writes a whole history, as when a fork has no parent log to refer to
+        bool append_history(const ollama::messages& history) {
+            for (size_t i = 0; i < history.size(); i++) {
+                const auto& message = history.at(i);
+                std::string role = message.value("role", "");
+                session_role kind = role == "system" ? session_role::system
+                                  : role == "assistant" ? session_role::assistant : session_role::user;
+                if (!append(kind, message.value("content", ""))) return false;
+            }
+            return true;
+        }
+
+        // Forces everything written so far to disk
+        void sync() {
+            std::lock_guard<std::mutex> lock(mutex);
+            sync_locked();
+        }
+
+    private:
+        // Frame: length, role, reserved, checksum of role and payload, payload
+        struct record_header {
+            uint32_t length;
+            uint16_t role;
+            uint16_t reserved;
+            uint32_t checksum;
+        };
+
+        static constexpr char magic[8] = {'T', 'S', 'S', 'E', 'S', 'S', 'N', '1'};
+        static constexpr int max_fork_depth = 64;
+        static constexpr size_t sync_bytes = 1 << 20;
+
+        // Walks frame headers only; a torn or corrupt tail from a crash is cut off
+        bool index_existing(size_t file_size) {
+            void* base = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) return false;
+            mapped = static_cast<char*>(base);
+            mapped_size = file_size;
+
+            size_t offset = scan_records(mapped, mapped_size, 0, [this](const session_record& record, size_t) {
+                loaded.push_back(record);
+            });
+            if (offset == 0) return false;
+            if (offset != file_size && ftruncate(fd, static_cast<off_t>(offset)) != 0) return false;
+            return true;
+        }
+
+        std::string directory() const {
+            size_t slash = path_.rfind('/');
+            return slash == std::string::npos ? "." : path_.substr(0, slash);
+        }
+
+        // Adds at most limit messages to history, expanding parent records; returns messages added
+        static size_t replay_records(const std::vector<session_record>& records, const std::string& dir, size_t limit,
+                                     ollama::messages& history, size_t& turns, int depth) {
+            size_t added = 0;
+            for (const auto& record : records) {
+                if (added == limit) break;
+                std::string content(record.content);
+                switch (record.role) {
+                case session_role::system: history.add_system(content); added++; break;
+                case session_role::user: history.add_user(content); added++; turns++; break;
+                case session_role::assistant: history.add_assistant(content); added++; break;
+                case session_role::model: break;
+                case session_role::parent: {
+                    size_t newline = content.find('\n');
+                    if (newline == std::string::npos || depth >= max_fork_depth) break;
+                    size_t shared = std::strtoull(content.c_str() + newline + 1, nullptr, 10);
+                    added += replay_file(dir + "/" + content.substr(0, newline), dir, std::min(shared, limit - added),
+                                         history, turns, depth + 1);
+                    break;
+                }
+                }
+            }
+            return added;
+        }
+
+        // A parent log may be open for appending elsewhere; it is only mapped and read here
+        static size_t replay_file(const std::string& log_path, const std::string& dir, size_t limit,
+                                  ollama::messages& history, size_t& turns, int depth) {
+            int file = ::open(log_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file == -1) return 0;
+            struct stat st;
+            if (fstat(file, &st) != 0 || st.st_size == 0) {
+                ::close(file);
+                return 0;
+            }
+            size_t size = static_cast<size_t>(st.st_size);
+            void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+            ::close(file);
+            if (base == MAP_FAILED) return 0;
+
+            std::vector<session_record> records;
+            scan_records(static_cast<const char*>(base), size, 0, [&](const session_record& record, size_t) { records.push_back(record); });
+            size_t added = replay_records(records, dir, limit, history, turns, depth);
+            munmap(base, size);
+            return added;
+        }
+
+        static uint32_t checksum(uint16_t role, const char* data, size_t len) {
+            uint32_t hash = 2166136261u;
+            for (int i = 0; i < 2; i++) {
+                hash ^= static_cast<unsigned char>(role >> (8 * i));
+                hash *= 16777619u;
+            }
+            for (size_t i = 0; i < len; i++) {
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        // A new file is only durable once its directory entry is
+        static void sync_directory(const std::string& file) {
+            size_t slash = file.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : file.substr(0, slash == 0 ? 1 : slash);
+            int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd == -1) return;
+            fsync(dir_fd);
+            ::close(dir_fd);
+        }
+
+        void sync_locked() {
+            if (fd == -1 || unsynced == 0) return;
+            fdatasync(fd);
+            unsynced = 0;
+        }
+
+        // Group commit: one fdatasync per interval, or sooner after a large burst
+        void flush_loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping) {
+                wake.wait_for(lock, sync_interval, [this]() { return stopping || unsynced >= sync_bytes; });
+                sync_locked();
+            }
+        }
+
+        void close_log() {
+            if (flusher.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_one();
+                flusher.join();
+            }
+            sync_locked();
+            loaded.clear();
+            if (mapped) munmap(mapped, mapped_size);
+            mapped = nullptr;
+            mapped_size = 0;
+            if (fd != -1) ::close(fd);
+            fd = -1;
+            unsynced = 0;
+            path_.clear();
+        }
+
+        std::chrono::milliseconds sync_interval;
+        std::string path_;
+        int fd = -1;
+        char* mapped = nullptr;
+        size_t mapped_size = 0;
+        std::vector<session_record> loaded;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread flusher;
+        size_t unsynced = 0;
+        bool stopping = false;
+    };
+}
+
+#endif // SESSION_LOG_HPP
@@ -0,0 +1,162 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace termsage {
+
+    // Single-threaded loop for the interactive REPL. It waits on stdin, Ctrl-C and work posted
+    // by background threads (streamed tokens, finished requests) in one poll(), so input is
+    // collected while a reply is generated. Posted work always runs on the loop's thread.
+    class event_loop {
+    public:
+        std::function<void()> on_interrupt;
+
+        event_loop() {
+            if (pipe(wake_pipe) == 0) {
+                for (int fd : wake_pipe) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            }
+            if (pipe(signal_pipe()) == 0) {
+                for (int fd : signal_pipe()) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            }
+
+            // SIGINT only wakes the loop; what it means depends on whether a reply is streaming
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = [](int) {
+                int saved = errno;
+                char byte = 1;
+                ssize_t ignored = write(signal_pipe()[1], &byte, 1);
+                (void)ignored;
+                errno = saved;
+            };
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGINT, &action, &previous_sigint);
+        }
+
+        ~event_loop() {
+            sigaction(SIGINT, &previous_sigint, nullptr);
+            for (int fd : wake_pipe) if (fd != -1) close(fd);
+            for (int& fd : signal_pipe()) {
+                if (fd != -1) close(fd);
+                fd = -1;
+            }
+        }
+
+        event_loop(const event_loop&) = delete;
+        event_loop& operator=(const event_loop&) = delete;
+
+        // Queues work for the loop thread; safe to call from any thread
+        void post(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                posted.push_back(std::move(task));
+            }
+            char byte = 1;
+            ssize_t ignored = write(wake_pipe[1], &byte, 1);
+            (void)ignored;
+        }
+
+        // Lines typed so far, including any entered while a reply was streaming
+        bool has_line() const { return !lines.empty(); }
+
+        std::string take_line() {
+            std::string line = std::move(lines.front());
+            lines.pop_front();
+            return line;
+        }
+
+        // False after end of input (Ctrl-D or a closed pipe)
+        bool input_open() const { return stdin_open; }
+
+        // Runs the loop until a line is available; false at end of input
+        bool wait_for_line(std::string& line) {
+            while (!has_line() && stdin_open) run_once();
+            if (!has_line()) return false;
+            line = take_line();
+            return true;
+        }
+
+        // Waits for one batch of events (or timeout_ms, -1 for none) and dispatches them
+        void run_once(int timeout_ms = -1) {
+            struct pollfd fds[3] = {
+                {signal_pipe()[0], POLLIN, 0},
+                {wake_pipe[0], POLLIN, 0},
+                {stdin_open ? STDIN_FILENO : -1, POLLIN, 0},
+            };
+            int ready = poll(fds, 3, timeout_ms);
+            if (ready <= 0) return;
+
+            if (fds[0].revents & POLLIN) {
+                drain(signal_pipe()[0]);
+                if (on_interrupt) on_interrupt();
+            }
+            if (fds[1].revents & POLLIN) {
+                drain(wake_pipe[0]);
+                std::deque<std::function<void()>> tasks;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.swap(posted);
+                }
+                for (auto& task : tasks) task();
+            }
+            if (fds[2].revents & (POLLIN | POLLHUP | POLLERR)) read_input();
+        }
+
+    private:
+        static int (&signal_pipe())[2] {
+            static int fds[2] = {-1, -1};
+            return fds;
+        }
+
+        static void drain(int fd) {
+            char buffer[64];
+            while (read(fd, buffer, sizeof(buffer)) > 0) {}
+        }
+
+        // Complete lines are dispatched; a partial line waits for the rest
+        void read_input() {
+            char buffer[4096];
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n == -1 && (errno == EINTR || errno == EAGAIN)) return;
+            if (n <= 0) {
+                stdin_open = false;
+                if (!partial.empty()) lines.push_back(partial);
+                partial.clear();
+                return;
+            }
+
+            partial.append(buffer, static_cast<size_t>(n));
+            size_t start = 0, end;
+            while ((end = partial.find('\n', start)) != std::string::npos) {
+                std::string line = partial.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                start = end + 1;
+                lines.push_back(std::move(line));
+            }
+            partial.erase(0, start);
+        }
+
+        int wake_pipe[2] = {-1, -1};
+        struct sigaction previous_sigint;
+        std::mutex mutex;
+        std::deque<std::function<void()>> posted;
+        std::string partial;
+        std::deque<std::string> lines;
+        bool stdin_open = true;
+    };
+}
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,470 @@
+#ifndef MARKDOWN_RENDERER_HPP
+#define MARKDOWN_RENDERER_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+
+namespace termsage {
+
+    // Streaming Markdown to ANSI renderer. Every byte goes through a resumable state machine
+    // exactly once; only a short line prefix (to tell a heading or list from plain text), an
+    // emphasis marker run or an identifier inside a code fence is ever held back. Earlier
+    // output is never revisited, so the cost of a token is proportional to the token alone.
+    class markdown_renderer {
+    public:
+        explicit markdown_renderer(bool color = true) : color(color) {}
+
+        // Renders newly arrived text, appending terminal output to out
+        void feed(std::string_view text, std::string& out) {
+            for (char c : text) put(c, out);
+        }
+
+        // Emits anything still held back and clears all styling; call at the end of a reply
+        void finish(std::string& out) {
+            if (in_code) {
+                if (line_start && closes_fence()) close_fence(out);
+                else if (line_start) release_fence_candidate(out);
+                if (in_code) {
+                    flush_code_token(out);
+                    if (code_state != code_t::normal) out.append(style(0));
+                }
+            } else {
+                if (line_start && !prefix.empty()) resolve_prefix(true, out);
+                if (tick_count > 0) resolve_ticks(out);
+                if (marker_count > 0) resolve_marker(' ', out);
+                reset_line(out);
+            }
+            *this = markdown_renderer(color);
+        }
+
+    private:
+        enum class block_t { plain, heading, quote, list, table };
+        enum class code_t { normal, string, comment };
+
+        void put(char c, std::string& out) {
+            if (in_code) {
+                put_code(c, out);
+            } else if (line_start) {
+                prefix.push_back(c);
+                resolve_prefix(false, out);
+            } else {
+                put_inline(c, out);
+            }
+        }
+
+        // ---- line starts ----------------------------------------------------------------
+
+        // Decides what a line is once enough of its start has arrived
+        void resolve_prefix(bool at_end, std::string& out) {
+            size_t indent = prefix.find_first_not_of(' ');
+            if (indent == std::string::npos) {
+                if (at_end || prefix.size() > 8) emit_prefix_as_text(out);
+                return;
+            }
+            std::string_view rest = std::string_view(prefix).substr(indent);
+            bool line_ended = rest.back() == '\n';
+            bool complete = at_end || line_ended || rest.size() > 12;
+
+            // Fences keep collecting the info string until the end of the line
+            if (starts_with(rest, "```") || starts_with(rest, "~~~")) {
+                if (line_ended || at_end) open_fence(rest, out);
+                return;
+            }
+            if (!complete && (rest == "`" || rest == "``" || rest == "~" || rest == "~~")) return;
+
+            char lead = rest[0];
+            if (lead == '#') {
+                size_t level = rest.find_first_not_of('#');
+                if (level == std::string_view::npos && !complete && rest.size() <= 6) return;
+                if (level != std::string_view::npos && level <= 6 && rest[level] == ' ') {
+                    block = block_t::heading;
+                    begin_line(out);
+                    consume_prefix(0, out);
+                    return;
+                }
+            } else if (lead == '-' || lead == '*' || lead == '+' || lead == '_') {
+                // Three or more markers alone on a line are a rule; that needs the whole line
+                size_t other = rest.find_first_not_of(std::string(1, lead) + " \n");
+                if (other == std::string_view::npos) {
+                    if (!complete) return;
+                    if (std::count(rest.begin(), rest.end(), lead) >= 3) {
+                        out.append(indent, ' ').append(style(2)).append("────────────────────").append(style(0));
+                        if (line_ended) out.push_back('\n');
+                        prefix.clear();
+                        return;
+                    }
+                }
+                if (lead != '_' && rest.size() >= 2 && rest[1] == ' ') {
+                    block = block_t::list;
+                    begin_line(out);
+                    out.append(prefix, 0, indent);
+                    out.append(style(33)).append("•").append(style(0)).push_back(' ');
+                    consume_prefix(indent + 2, out);
+                    return;
+                }
+            } else if (std::isdigit(static_cast<unsigned char>(lead))) {
+                size_t digits = 0;
+                while (digits < rest.size() && std::isdigit(static_cast<unsigned char>(rest[digits]))) digits++;
+                if (digits == rest.size() && !complete && digits < 10) return;
+                if (digits < rest.size() && (rest[digits] == '.' || rest[digits] == ')')) {
+                    if (digits + 1 == rest.size() && !complete) return;
+                    if (digits + 1 < rest.size() && rest[digits + 1] == ' ') {
+                        block = block_t::list;
+                        begin_line(out);
+                        out.append(prefix, 0, indent);
+                        out.append(style(33)).append(rest.substr(0, digits + 1)).append(style(0)).push_back(' ');
+                        consume_prefix(indent + digits + 2, out);
+                        return;
+                    }
+                }
+            } else if (lead == '>') {
+                if (rest.size() == 1 && !complete) return;
+                block = block_t::quote;
+                begin_line(out);
+                out.append(prefix, 0, indent);
+                out.append(style(2)).append("│ ").append(current_style());
+                consume_prefix(indent + (rest.size() > 1 && rest[1] == ' ' ? 2 : 1), out);
+                return;
+            } else if (lead == '|') {
+                block = block_t::table;
+            }
+
+            emit_prefix_as_text(out);
+        }
+
+        // The line is ordinary text; run the collected prefix through inline rendering
+        void emit_prefix_as_text(std::string& out) {
+            begin_line(out);
+            consume_prefix(0, out);
+        }
+
+        // Drops the first `skip` bytes of the prefix and renders the rest as body text
+        void consume_prefix(size_t skip, std::string& out) {
+            std::string held;
+            held.swap(prefix);
+            for (size_t i = skip; i < held.size(); i++) put_inline(held[i], out);
+        }
+
+        void begin_line(std::string& out) {
+            line_start = false;
+            if (block != block_t::plain) out.append(current_style());
+        }
+
+        // ---- inline text ----------------------------------------------------------------
+
+        void put_inline(char c, std::string& out) {
+            if (c == '`') {
+                if (!inline_code && marker_count > 0) resolve_marker(c, out);
+                tick_count++;
+                return;
+            }
+            if (tick_count > 0) resolve_ticks(out);
+
+            if (c == '\n') {
+                if (marker_count > 0) resolve_marker(c, out);
+                reset_line(out);
+                out.push_back('\n');
+                line_start = true;
+                block = block_t::plain;
+                return;
+            }
+
+            if (inline_code) {
+                out.push_back(c);
+                previous = c;
+                return;
+            }
+
+            if (c == '*' || c == '_') {
+                if (marker_count > 0 && c != marker) flush_marker(out);
+                marker = c;
+                marker_count++;
+                return;
+            }
+            if (marker_count > 0) resolve_marker(c, out);
+
+            if (c == '|' && block == block_t::table) {
+                out.append(style(2)).push_back('|');
+                out.append(current_style());
+            } else {
+                out.push_back(c);
+            }
+            previous = c;
+        }
+
+        // A code span opens with a run of one or two backticks and closes on a run of the same
+        // length; other runs are literal, so a ``` mentioned mid-sentence stays visible
+        void resolve_ticks(std::string& out) {
+            int count = tick_count;
+            tick_count = 0;
+            if (inline_code ? count == code_ticks : count <= 2) {
+                inline_code = !inline_code;
+                code_ticks = count;
+                out.append(current_style());
+            } else {
+                out.append(static_cast<size_t>(count), '`');
+            }
+            previous = '`';
+        }
+
+        // A marker run is settled by the character after it: it closes an open style when it
+        // follows text, and opens one when text follows it
+        void resolve_marker(char next, std::string& out) {
+            bool after_text = previous != 0 && !std::isspace(static_cast<unsigned char>(previous));
+            bool after_word = previous != 0 && std::isalnum(static_cast<unsigned char>(previous));
+            bool before_text = !std::isspace(static_cast<unsigned char>(next));
+            bool intraword = marker == '_' && after_word && std::isalnum(static_cast<unsigned char>(next));
+            int count = marker_count;
+            marker_count = 0;
+
+            bool closing = after_text && ((count >= 2 && bold) || (count % 2 == 1 && italic));
+            bool opening = before_text && !after_word;
+            if (intraword || (!closing && !opening)) {
+                out.append(static_cast<size_t>(count), marker);
+                previous = marker;
+                return;
+            }
+            if (count >= 2) bold = !bold;
+            if (count % 2 == 1) italic = !italic;
+            out.append(current_style());
+            previous = marker;
+        }
+
+        void flush_marker(std::string& out) {
+            if (marker_count == 0) return;
+            out.append(static_cast<size_t>(marker_count), marker);
+            previous = marker;
+            marker_count = 0;
+        }
+
+        // Styles never carry over a line break, so a stray marker cannot tint the rest of a reply
+        void reset_line(std::string& out) {
+            if (bold || italic || inline_code || block != block_t::plain) out.append(style(0));
+            bold = italic = inline_code = false;
+            previous = 0;
+        }
+
+        // ---- fenced code ----------------------------------------------------------------
+
+        // The fence is the whole opening run; only a run at least as long closes it
+        void open_fence(std::string_view rest, std::string& out) {
+            size_t run = rest.find_first_not_of(rest[0]);
+            if (run == std::string_view::npos) run = rest.size();
+            fence = std::string(rest.substr(0, run));
+            std::string_view info = rest.substr(run);
+            while (!info.empty() && (info.back() == '\n' || info.back() == '\r' || info.back() == ' ')) info.remove_suffix(1);
+            while (!info.empty() && info.front() == ' ') info.remove_prefix(1);
+            language = std::string(info.substr(0, info.find(' ')));
+            for (auto& ch : language) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+
+            static const std::unordered_set<std::string> hash_languages = {
+                "python", "py", "sh", "bash", "shell", "zsh", "ruby", "rb", "yaml", "yml",
+                "toml", "perl", "r", "cmake", "dockerfile", "makefile", "ini", "conf",
+            };
+            static const std::unordered_set<std::string> dash_languages = {"sql", "lua", "haskell", "hs"};
+            comment_opener = hash_languages.count(language) ? '#' : dash_languages.count(language) ? '-' : '/';
+
+            bool line_ended = rest.back() == '\n';
+            out.append(style(2)).append("┌─ ").append(language.empty() ? "code" : language).append(style(0));
+            if (line_ended) out.push_back('\n');
+            prefix.clear();
+            in_code = true;
+            line_start = true;
+            code_state = code_t::normal;
+        }
+
+        void close_fence(std::string& out) {
+            flush_code_token(out);
+            out.append(style(2)).append("└─").append(style(0));
+            prefix.clear();
+            in_code = false;
+            line_start = true;
+            block = block_t::plain;
+        }
+
+        void put_code(char c, std::string& out) {
+            // A closing fence can only start a line
+            if (line_start) {
+                bool in_run = prefix.find_first_not_of(fence[0]) == std::string::npos;
+                if ((c == fence[0] && in_run) || ((c == ' ' || c == '\r') && prefix.size() >= fence.size())) {
+                    prefix.push_back(c);
+                    return;
+                }
+                if (c == '\n' && closes_fence()) {
+                    close_fence(out);
+                    out.push_back('\n');
+                    return;
+                }
+                release_fence_candidate(out);
+            }
+            code_char(c, out);
+        }
+
+        // A run of the fence character at least as long as the opening one, then only spaces
+        bool closes_fence() const {
+            size_t run = prefix.find_first_not_of(fence[0]);
+            if (run == std::string::npos) run = prefix.size();
+            return run >= fence.size() && prefix.find_first_not_of(" \r", run) == std::string::npos;
+        }
+
+        // Characters that looked like the start of a closing fence were code after all
+        void release_fence_candidate(std::string& out) {
+            std::string held;
+            held.swap(prefix);
+            line_start = false;
+            for (char h : held) code_char(h, out);
+        }
+
+        void code_char(char c, std::string& out) {
+            line_start = false;
+            if (c == '\n') {
+                flush_code_token(out);
+                if (code_state != code_t::normal) out.append(style(0));
+                code_state = code_t::normal;
+                out.push_back('\n');
+                line_start = true;
+                return;
+            }
+
+            if (code_state == code_t::comment) {
+                out.push_back(c);
+                return;
+            }
+            if (code_state == code_t::string) {
+                out.push_back(c);
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == quote) {
+                    out.append(style(0));
+                    code_state = code_t::normal;
+                }
+                return;
+            }
+
+            // "//" and "--" need one character of lookahead
+            if (pending_comment) {
+                pending_comment = false;
+                if (c == comment_opener) {
+                    out.append(style(90)).push_back(c);
+                    out.push_back(c);
+                    code_state = code_t::comment;
+                    return;
+                }
+                out.push_back(comment_opener);
+            }
+
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+                token.push_back(c);
+                return;
+            }
+            flush_code_token(out);
+
+            if (c == comment_opener) {
+                if (comment_opener == '#') {
+                    out.append(style(90)).push_back(c);
+                    code_state = code_t::comment;
+                } else {
+                    pending_comment = true;
+                }
+            } else if (c == '"' || c == '\'' || c == '`') {
+                quote = c;
+                escaped = false;
+                code_state = code_t::string;
+                out.append(style(32)).push_back(c);
+            } else {
+                out.push_back(c);
+            }
+        }
+
+        void flush_code_token(std::string& out) {
+            if (pending_comment) {
+                out.push_back(comment_opener);
+                pending_comment = false;
+            }
+            if (token.empty()) return;
+            if (std::isdigit(static_cast<unsigned char>(token[0]))) {
+                out.append(style(35)).append(token).append(style(0));
+            } else if (keywords().count(token)) {
+                out.append(style(34)).append(token).append(style(0));
+            } else {
+                out.append(token);
+            }
+            token.clear();
+        }
+
+        // Common to the languages models answer in most; no attempt is made to be exact per language
+        static const std::unordered_set<std::string>& keywords() {
+            static const std::unordered_set<std::string> words = {
+                "if", "else", "elif", "for", "while", "do", "return", "break", "continue", "switch", "case",
+                "default", "try", "catch", "except", "finally", "throw", "raise", "class", "struct", "enum",
+                "union", "interface", "impl", "trait", "fn", "def", "func", "function", "lambda", "let", "var",
+                "const", "static", "mut", "auto", "int", "long", "short", "char", "bool", "float", "double",
+                "void", "unsigned", "signed", "import", "from", "export", "include", "using", "namespace",
+                "package", "mod", "use", "pub", "public", "private", "protected", "virtual", "override",
+                "template", "typename", "new", "delete", "true", "false", "null", "nullptr", "None", "True",
+                "False", "nil", "self", "this", "async", "await", "yield", "with", "as", "in", "is", "not",
+                "and", "or", "match", "type", "extends", "implements", "then", "fi", "done", "esac", "local",
+                "SELECT", "FROM", "WHERE", "INSERT", "UPDATE", "JOIN", "select", "where", "insert", "update",
+            };
+            return words;
+        }
+
+        // ---- styles ---------------------------------------------------------------------
+
+        std::string style(int code) const {
+            if (!color) return std::string();
+            return "\x1b[" + std::to_string(code) + "m";
+        }
+
+        // Complete SGR sequence for the current block and inline state
+        std::string current_style() const {
+            if (!color) return std::string();
+            std::string sgr = "\x1b[0";
+            if (block == block_t::heading) sgr += ";1;36";
+            if (block == block_t::quote) sgr += ";2";
+            if (bold) sgr += ";1";
+            if (italic) sgr += ";3";
+            if (inline_code) sgr += ";36";
+            return sgr + "m";
+        }
+
+        static bool starts_with(std::string_view text, std::string_view head) {
+            return text.substr(0, head.size()) == head;
+        }
+
+        bool color;
+
+        // Line state
+        bool line_start = true;
+        std::string prefix;
+        block_t block = block_t::plain;
+
+        // Inline state
+        bool bold = false;
+        bool italic = false;
+        bool inline_code = false;
+        int code_ticks = 0;
+        int tick_count = 0;
+        char marker = 0;
+        int marker_count = 0;
+        char previous = 0;
+
+        // Code fence state
+        bool in_code = false;
+        std::string fence;
+        std::string language;
+        char comment_opener = '/';
+        code_t code_state = code_t::normal;
+        std::string token;
+        bool pending_comment = false;
+        char quote = 0;
+        bool escaped = false;
+    };
+}
+
+#endif // MARKDOWN_RENDERER_HPP
@@ -0,0 +1,98 @@
+#ifndef TERMINAL_WRITER_HPP
+#define TERMINAL_WRITER_HPP
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace termsage {
+
+    // Output stage for streamed tokens. Text is buffered and written with a single write(2)
+    // per frame, at most max_fps times a second; a newline or the end of a reply flushes at
+    // once. A UTF-8 sequence split across tokens is held back until it is complete.
+    class terminal_writer {
+    public:
+        explicit terminal_writer(int fd = STDOUT_FILENO, int max_fps = 60)
+            : fd(fd), frame(std::chrono::microseconds(1000000 / std::max(1, max_fps))) {
+            buffer.reserve(4096);
+        }
+
+        ~terminal_writer() { flush(); }
+
+        terminal_writer(const terminal_writer&) = delete;
+        terminal_writer& operator=(const terminal_writer&) = delete;
+
+        void write(std::string_view text) {
+            if (text.empty()) return;
+            if (buffer.empty()) first_pending = clock::now();
+            buffer.append(text.data(), text.size());
+            if (text.find('\n') != std::string_view::npos) flush_complete();
+        }
+
+        // Writes the frame if one is due; call after each batch of events
+        void tick() {
+            if (!buffer.empty() && clock::now() >= next_frame()) flush_complete();
+        }
+
+        // Milliseconds until the pending frame is due, or -1 when nothing is buffered (a poll() timeout)
+        int ms_until_frame() const {
+            if (buffer.empty()) return -1;
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_frame() - clock::now()).count();
+            return static_cast<int>(std::max<long long>(0, wait + 1));
+        }
+
+        // Everything, including an unfinished UTF-8 sequence; for the end of a reply or before other output
+        void flush() { emit(buffer.size()); }
+
+        size_t frames_written() const { return frames; }
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point next_frame() const {
+            return std::max(last_write + frame, first_pending);
+        }
+
+        void flush_complete() { emit(complete_prefix()); }
+
+        // Length of the buffer up to the last whole UTF-8 character
+        size_t complete_prefix() const {
+            size_t size = buffer.size();
+            size_t i = size;
+            // Step back over at most three continuation bytes to the lead byte
+            while (i > 0 && size - i < 4 && (static_cast<unsigned char>(buffer[i - 1]) & 0xC0) == 0x80) i--;
+            if (i == 0) return size;
+            unsigned char lead = static_cast<unsigned char>(buffer[i - 1]);
+            size_t needed = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+            return size - (i - 1) >= needed ? size : i - 1;
+        }
+
+        void emit(size_t length) {
+            if (length == 0) return;
+            size_t written = 0;
+            while (written < length) {
+                ssize_t n = ::write(fd, buffer.data() + written, length - written);
+                if (n == -1 && errno == EINTR) continue;
+                if (n <= 0) break; // Terminal gone; drop the frame rather than spin
+                written += static_cast<size_t>(n);
+            }
+            buffer.erase(0, length);
+            last_write = clock::now();
+            if (!buffer.empty()) first_pending = last_write;
+            frames++;
+        }
+
+        int fd;
+        clock::duration frame;
+        std::string buffer;
+        clock::time_point last_write{};
+        clock::time_point first_pending{};
+        size_t frames = 0;
+    };
+}
+
+#endif // TERMINAL_WRITER_HPP
@@ -1,50 +1,391 @@
 #define CPPHTTPLIB_OPENSSL_SUPPORT 0
 #include "ExternalDependencies/ollama_fixed.hpp"
+#include "RetrievalSystem/embedding_store.hpp"
+#include "NetworkSystem/backend_pool.hpp"
+#include "NetworkSystem/resilience.hpp"
+#include "DaemonSystem/daemon_protocol.hpp"
+#include "ModelSystem/model_catalog.hpp"
+#include "TerminalSystem/event_loop.hpp"
+#include "TerminalSystem/terminal_writer.hpp"
+#include "TerminalSystem/markdown_renderer.hpp"
+#include "SessionSystem/session_log.hpp"
+#include "SessionSystem/session_index.hpp"
+#include "PipeSystem/map_reduce.hpp"
+#include "PipeSystem/log_watcher.hpp"
+#include "AutoCompleteSystem/autocomplete.hpp"
+#include "AutoCompleteSystem/command_index.hpp"
+#include "RetrievalSystem/file_context.hpp"
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <limits>
 #include <vector>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
 
-int main() {
-    // Create an Ollama instance
-    Ollama ollama;
-    
-    // Check if Ollama server is running
-    if (!ollama.is_running()) {
-        std::cout << "Ollama server is not running. Please start it first with 'ollama serve'." << std::endl;
-        return 1;
+int main(int argc, char* argv[]) {
+    // Command line options
+    bool rag_mode = false;
+    std::string rag_store_path = "termsage_rag.bin";
+    std::string embed_model = "nomic-embed-text";
+    std::vector<std::string> index_paths;
+    size_t rag_top_k = 4;
+    size_t rag_budget_tokens = 1024;
+    size_t attach_budget_tokens = 4096;
+    std::vector<std::string> servers;
+    bool use_daemon = false;
+    std::string daemon_socket = termsage::default_daemon_socket_path();
+    bool resume = false;
+    std::string resume_target;
+    std::string pipe_task;
+    std::string pipe_model;
+    size_t pipe_jobs = 4;
+    size_t context_tokens = 0;
+    ollama::json sampling = ollama::json::object();
+    bool use_semantic_cache = false;
+    ollama::semantic_cache_options semantic_options;
+    bool watch_mode = false;
+    termsage::watch_options watch;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "watch" && i == 1) {
+            watch_mode = true;
+        } else if (arg == "--file" && has_value) {
+            watch.path = argv[++i];
+        } else if (arg == "--window" && has_value) {
+            watch.window = std::chrono::seconds(std::stoul(argv[++i]));
+        } else if (arg == "--cooldown" && has_value) {
+            watch.cooldown = std::chrono::seconds(std::stoul(argv[++i]));
+        } else if (arg == "--server" && has_value) {
+            servers.push_back(argv[++i]);
+        } else if (arg == "--daemon") {
+            use_daemon = true;
+            if (has_value && argv[i + 1][0] != '-') daemon_socket = argv[++i];
+        } else if (arg == "--rag") {
+            rag_mode = true;
+            if (has_value && argv[i + 1][0] != '-') rag_store_path = argv[++i];
+        } else if (arg == "--index" && has_value) {
+            index_paths.push_back(argv[++i]);
+        } else if (arg == "--embed-model" && has_value) {
+            embed_model = argv[++i];
+        } else if (arg == "--rag-k" && has_value) {
+            rag_top_k = std::stoul(argv[++i]);
+        } else if (arg == "--rag-budget" && has_value) {
+            rag_budget_tokens = std::stoul(argv[++i]);
+        } else if (arg == "--attach-budget" && has_value) {
+            attach_budget_tokens = std::stoul(argv[++i]);
+        } else if ((arg == "-p" || arg == "--prompt") && has_value) {
+            pipe_task = argv[++i];
+        } else if ((arg == "-m" || arg == "--model") && has_value) {
+            pipe_model = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && has_value) {
+            pipe_jobs = std::stoul(argv[++i]);
+        } else if (arg == "--ctx" && has_value) {
+            context_tokens = std::stoul(argv[++i]);
+        } else if (arg == "--semantic-cache") {
+            // Opt-in: paraphrases of earlier prompts are answered from cache, at one embedding per turn
+            use_semantic_cache = true;
+            if (has_value && argv[i + 1][0] != '-') semantic_options.similarity_threshold = std::stof(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            // Greedy sampling with a pinned seed is reproducible, so repeated runs are answered from the response cache
+            sampling = {{"temperature", 0}, {"seed", std::stoll(argv[++i])}};
+        } else if (arg == "--resume") {
+            resume = true;
+            if (has_value && argv[i + 1][0] != '-') resume_target = argv[++i];
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--server url]... [--daemon [socket]] [--rag [store]] [--index path]... [--embed-model name]"
+                      << " [--rag-k n] [--rag-budget tokens] [--attach-budget tokens] [--seed n] [--semantic-cache [threshold]] [--resume [session]]"
+                      << " [-p task [-m model] [-j jobs] [--ctx tokens]]" << std::endl
+                      << "       " << argv[0] << " watch [--file log] [--window seconds] [--cooldown seconds] [-p focus] [-m model]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (!index_paths.empty()) rag_mode = true;
+
+    if (servers.empty()) servers.push_back("http://localhost:11434");
+
+    // Requests made by this process share one scheduler: REPL turns and their retrieval are
+    // interactive, -p and --watch are batch, and indexing runs in the background class
+    ollama::scheduler_options scheduling;
+    scheduling.server_parallelism = std::max<size_t>(1, pipe_jobs) + 1;
+    ollama::request_scheduler scheduler(scheduling);
+
+    // With several servers, chat requests are balanced across a pool. Single-server work
+    // (pipe and watch modes, embeddings) goes to the first server that answers, and the model
+    // list is merged from every server that answers.
+    std::unique_ptr<ollama::backend_pool> pool;
+    std::vector<std::string> reachable = {servers.front()};
+    if (servers.size() > 1) {
+        pool = std::make_unique<ollama::backend_pool>(servers);
+        reachable = pool->refresh();
+        if (reachable.empty()) reachable = {servers.front()};
+        pool->start_health_checks();
+    }
+    Ollama ollama(reachable.front());
+    std::vector<std::unique_ptr<Ollama>> other_servers;
+    std::vector<Ollama*> model_sources = {&ollama};
+    for (size_t i = 1; i < reachable.size(); i++) {
+        other_servers.push_back(std::make_unique<Ollama>(reachable[i]));
+        model_sources.push_back(other_servers.back().get());
+    }
+
+    // Deterministic requests (--seed) are answered from disk when asked again
+    auto response_cache = std::make_shared<ollama::response_cache>(256, ollama::default_response_cache_path());
+    ollama.set_response_cache(response_cache);
+    if (pool) pool->set_response_cache(response_cache);
+    std::shared_ptr<ollama::semantic_cache> semantic_cache;
+    if (use_semantic_cache) {
+        semantic_options.embedding_model = embed_model;
+        semantic_cache = std::make_shared<ollama::semantic_cache>(semantic_options);
+        ollama.set_semantic_cache(semantic_cache);
+        if (pool) pool->set_semantic_cache(semantic_cache);
     }
     
-    std::cout << "Connected to Ollama server." << std::endl;
+    // Pipe and watch modes run without the chat UI: only answers go to stdout, progress to stderr
+    if (!pipe_task.empty() || watch_mode) {
+        if (!ollama.is_running()) {
+            std::cerr << "Ollama server is not running. Please start it first with 'ollama serve'." << std::endl;
+            return 1;
+        }
+
+        termsage::model_catalog catalog;
+        if (catalog.empty()) {
+            try {
+                catalog.refresh(model_sources);
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error listing models: " << e.what() << std::endl;
+            }
+        }
+        std::string model = pipe_model;
+        if (model.empty() && !catalog.entries().empty()) model = catalog.entries().front().summary.name;
+        if (model.empty()) {
+            std::cerr << "No model available; pass one with --model." << std::endl;
+            return 1;
+        }
+
+        // Chunks take about half the context window at a conservative 3 bytes per token
+        size_t context = context_tokens;
+        if (!context) {
+            auto entry = catalog.find(model);
+            context = std::min<size_t>(entry && entry->details.context_length ? entry->details.context_length : 4096, 8192);
+        }
+        // Redirected output stays the model's Markdown; rendering is only for a terminal
+        bool render = isatty(STDOUT_FILENO);
+        bool color = render && !std::getenv("NO_COLOR");
+        termsage::terminal_writer out;
+
+        // Watch mode: `TermSage watch --file app.log` or `tail -f app.log | TermSage watch` follows
+        // the log and asks the model only about lines with new or bursting patterns
+        if (watch_mode) {
+            static std::atomic<bool> stop{false};
+            std::signal(SIGINT, [](int) {
+                stop = true;
+                std::signal(SIGINT, SIG_DFL); // A second Ctrl-C does not wait for the reply
+            });
+
+            std::string system = "You watch a log for the user. You get log lines whose patterns are new or suddenly "
+                                 "much more frequent, then the most recent lines for context. Say briefly what changed, "
+                                 "whether it looks like a problem, and what to check first. If it looks routine, say so in one line.";
+            if (!pipe_task.empty()) system += "\nThe user is especially interested in: " + pipe_task;
+            ollama::json options = {{"options", sampling}};
+            options["options"]["num_ctx"] = context;
+
+            termsage::markdown_renderer markdown(color);
+            ollama::resilient_ollama triage(ollama, ollama::generation_resilience());
+            termsage::log_watcher watcher(watch, [&](const termsage::triage_batch& batch) {
+                std::string input = "Lines with new or bursting patterns:\n";
+                for (const auto& line : batch.findings) input += line + "\n";
+                input += "\nMost recent lines:\n";
+                for (const auto& line : batch.context) input += line + "\n";
+                if (input.size() > context * 3) input.resize(context * 3);
+
+                char stamp[16];
+                std::time_t now = std::time(nullptr);
+                std::strftime(stamp, sizeof(stamp), "%H:%M:%S", std::localtime(&now));
+                std::string header = std::string("── ") + stamp + " · " + std::to_string(batch.new_patterns) + " new, " +
+                                     std::to_string(batch.bursts) + " bursting, " + std::to_string(batch.lines_seen) + " lines ──";
+                out.write((color ? "\x1b[2m" + header + "\x1b[0m" : header) + "\n");
+
+                ollama::messages request;
+                request.add_system(system);
+                request.add_user(input);
+                std::string rendered;
+                try {
+                    auto slot = scheduler.acquire(ollama::priority_class::batch, scheduler.estimate_cost(options));
+                    triage.chat(model, request, [&](const ollama::response& response) {
+                        rendered.clear();
+                        if (render) markdown.feed(response.as_simple_string(), rendered);
+                        else rendered = response.as_simple_string();
+                        out.write(rendered);
+                        out.tick();
+                        return true;
+                    }, options);
+                } catch (const ollama::exception& e) {
+                    out.write(std::string("Error: ") + e.what() + "\n");
+                }
+                rendered.clear();
+                if (render) markdown.finish(rendered);
+                out.write(rendered + "\n\n");
+                out.flush();
+            });
+
+            std::cerr << "Watching " << (watch.path.empty() ? "stdin" : watch.path) << " with " << model << "." << std::endl;
+            if (!watcher.run(stop)) {
+                std::cerr << "Cannot open " << watch.path << "." << std::endl;
+                return 1;
+            }
+            std::cerr << watcher.lines_read() << " lines, " << watcher.templates_known() << " patterns." << std::endl;
+            return 0;
+        }
+
+        termsage::map_reduce_options config;
+        config.task = pipe_task;
+        config.model = model;
+        config.jobs = pipe_jobs;
+        config.chunk_bytes = context * 3 / 2;
+        config.options = {{"options", sampling}};
+        config.options["options"]["num_ctx"] = context;
+        config.scheduler = &scheduler;
+
+        bool progress_tty = isatty(STDERR_FILENO);
+        bool progress_shown = false;
+        termsage::map_reduce job(ollama, config, [&](const std::string& message) {
+            if (progress_tty) std::cerr << "\r\x1b[K" << message << std::flush;
+            else std::cerr << message << std::endl;
+            progress_shown = true;
+        });
+
+        termsage::markdown_renderer markdown(color);
+        std::string rendered;
+        try {
+            job.run(STDIN_FILENO, [&](const std::string& token) {
+                if (progress_tty && progress_shown) {
+                    std::cerr << "\r\x1b[K" << std::flush;
+                    progress_shown = false;
+                }
+                rendered.clear();
+                if (render) markdown.feed(token, rendered);
+                else rendered = token;
+                out.write(rendered);
+                out.tick();
+            });
+        } catch (const ollama::exception& e) {
+            out.flush();
+            std::cerr << "\nError: " << e.what() << std::endl;
+            return 1;
+        }
+        rendered.clear();
+        if (render) markdown.finish(rendered);
+        out.write(rendered + "\n");
+        out.flush();
+        return 0;
+    }
+
+    // With --daemon, chat and model listing go through termsaged's shared connections and caches
+    std::unique_ptr<termsage::daemon_client> daemon;
+    if (use_daemon) {
+        daemon = std::make_unique<termsage::daemon_client>(daemon_socket);
+        if (!daemon->connect()) {
+            std::cout << "termsaged is not running at " << daemon_socket << ". Start it with 'termsaged'." << std::endl;
+            return 1;
+        }
+        // termsaged schedules across all its clients; a REPL turn outranks -p and indexing work
+        daemon->set_priority(ollama::priority_class::interactive);
+        std::cout << "Connected to termsaged." << std::endl;
+    } else {
+        // Check if Ollama server is running
+        if (!ollama.is_running()) {
+            std::cout << "Ollama server is not running. Please start it first with 'ollama serve'." << std::endl;
+            return 1;
+        }
+
+        if (pool) std::cout << "Connected to " << reachable.size() << " of " << servers.size() << " Ollama servers." << std::endl;
+        else std::cout << "Connected to Ollama server." << std::endl;
+    }
     
-    // List available models
+    // List available models. The cached catalog is shown immediately and refreshed
+    // in the background; the first launch has to wait for the server.
+    termsage::model_catalog catalog;
+    std::vector<std::string> model_names;
+    if (daemon) {
+        model_names = daemon->list_models();
+    } else {
+        if (catalog.empty()) {
+            try {
+                catalog.refresh(model_sources);
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error listing models: " << e.what() << std::endl;
+            }
+        } else {
+            catalog.refresh_in_background(model_sources);
+        }
+        for (const auto& entry : catalog.entries()) model_names.push_back(entry.summary.name);
+    }
+
     std::cout << "\nAvailable models:" << std::endl;
-    auto models = ollama.list_models();
-    if (models.empty()) {
+    if (model_names.empty()) {
         std::cout << "  No models found. Please pull at least one model (e.g., 'ollama pull llama3')." << std::endl;
         return 1;
     }
     
     // Display models with numbers
-    std::vector<std::string> model_names;
-    for (size_t i = 0; i < models.size(); i++) {
-        std::cout << "  " << (i + 1) << ". " << models[i] << std::endl;
-        model_names.push_back(models[i]);
+    for (size_t i = 0; i < model_names.size(); i++) {
+        std::cout << "  " << (i + 1) << ". " << model_names[i];
+        if (auto entry = catalog.find(model_names[i])) {
+            const auto& summary = entry->summary;
+            if (!summary.parameter_size.empty()) std::cout << "  " << summary.parameter_size;
+            if (!summary.quantization_level.empty()) std::cout << " " << summary.quantization_level;
+            if (entry->details.context_length) std::cout << ", " << entry->details.context_length << " ctx";
+        }
+        std::cout << std::endl;
     }
     
-    // Select model
+    // All terminal input goes through the event loop so typing and Ctrl-C work while replies stream
+    termsage::event_loop loop;
+    termsage::terminal_writer out;
+
+    // Replies are rendered as they stream; plain text when stdout is not a terminal or NO_COLOR is set
+    bool color = isatty(STDOUT_FILENO) && !std::getenv("NO_COLOR");
+    termsage::markdown_renderer markdown(color);
+    std::string rendered;
+
+    // Every turn is appended to a session log; --resume reopens the latest one (or the one named)
+    termsage::session_log session;
+    if (resume) {
+        std::string path = resume_target;
+        if (path.empty()) {
+            path = termsage::latest_session_path();
+        } else if (path.find('/') == std::string::npos && access(path.c_str(), F_OK) != 0) {
+            path = termsage::default_session_dir() + "/" + path;
+            if (access(path.c_str(), F_OK) != 0) path += ".log";
+        }
+        if (path.empty() || !session.open(path)) {
+            std::cout << "No session to resume" << (path.empty() ? "" : " at " + path) << "." << std::endl;
+            return 1;
+        }
+    }
+
+    // Select model; a resumed session continues with the model it used
     std::string user_input;
-    std::string model_name;
-    bool valid_selection = false;
+    std::string model_name = session.model();
+    bool valid_selection = !model_name.empty();
     
     while (!valid_selection) {
-        std::cout << "\nSelect model by number (1-" << models.size() << ") or enter model name: ";
-        std::getline(std::cin, user_input);
+        std::cout << "\nSelect model by number (1-" << model_names.size() << ") or enter model name: " << std::flush;
+        if (!loop.wait_for_line(user_input)) return 0;
         
         // Check if input is a number
         try {
             int selection = std::stoi(user_input);
-            if (selection >= 1 && selection <= static_cast<int>(models.size())) {
+            if (selection >= 1 && selection <= static_cast<int>(model_names.size())) {
                 model_name = model_names[selection - 1];
                 valid_selection = true;
             } else {
@@ -60,47 +401,432 @@ int main() {
     // Initialize chat session
     ollama::messages chat_history;
     
-    // Add system message if desired
-    chat_history.add_system("You are a helpful AI assistant.");
-    
-    std::string user_message;
+    if (session.is_open()) {
+        size_t turns = session.replay(chat_history);
+        if (session.model() != model_name) session.append(termsage::session_role::model, model_name);
+        std::cout << "Resumed " << turns << " turns from " << session.path() << std::endl;
+    } else {
+        // Add system message if desired
+        chat_history.add_system("You are a helpful AI assistant.");
+
+        if (session.open(termsage::new_session_path())) {
+            session.append(termsage::session_role::model, model_name);
+            session.append(termsage::session_role::system, "You are a helpful AI assistant.");
+        } else {
+            std::cerr << "Warning: this session will not be saved." << std::endl;
+        }
+    }
+
+    // Branches of this conversation made with /fork; each continues in its own session log.
+    // Histories share their common turns, so keeping every branch around costs almost nothing.
+    struct branch {
+        ollama::messages history;
+        std::string log_path;
+    };
+    std::vector<branch> branches = {{chat_history, session.path()}};
+    size_t current_branch = 0;
+
+    auto switch_branch = [&](size_t target) {
+        branches[current_branch].history = chat_history;
+        current_branch = target;
+        chat_history = branches[target].history;
+        if (!branches[target].log_path.empty()) session.open(branches[target].log_path);
+    };
+
+    // Past sessions are indexed for /search; catching up on new logs happens in the background
+    termsage::session_index search_index;
+    search_index.update_in_background();
+
+    // Shell and prompt history for /history completion; only appended bytes are read after the first run
+    termsage::history_completer prompt_history;
+    prompt_history.start();
+
+    // Executables on $PATH with their man-page summaries; rebuilt in the background when $PATH changes
+    termsage::command_index commands;
+    commands.refresh_in_background();
+
+    // Files attached with /add; the parts that fit the budget best are sent with each question
+    termsage::file_context attachments;
+    size_t attach_budget = attach_budget_tokens;
+    if (auto entry = catalog.find(model_name); entry && entry->details.context_length)
+        attach_budget = std::min<size_t>(attach_budget, entry->details.context_length / 2);
     
-    std::cout << "\nChat started with " << model_name << ". Type 'exit' to quit.\n" << std::endl;
+    // Retrieval uses its own client so it can run alongside request preparation
+    Ollama embedder(reachable.front());
+    ollama::resilient_ollama query_embedder(embedder);   // Hedged, so one slow reply does not stall the turn
+    termsage::embedding_store rag_store(embed_model);
+    if (rag_mode) {
+        rag_store.load(rag_store_path);
+        for (const auto& path : index_paths) {
+            try {
+                std::cout << "Indexed " << rag_store.index_path(embedder, path, &scheduler) << " chunks from " << path << std::endl;
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error indexing " << path << ": " << e.what() << std::endl;
+            }
+        }
+        if (!index_paths.empty()) rag_store.save(rag_store_path);
+        std::cout << "RAG mode: " << rag_store.size() << " chunks in " << rag_store_path
+                  << ". Use '/index <path>' to add documents." << std::endl;
+    }
+
+    std::cout << "\nChat started with " << model_name;
+    if (auto entry = catalog.find(model_name); entry && entry->details.context_length)
+        std::cout << " (" << entry->details.context_length << "-token context window)";
+    std::cout << ". Type 'exit' to quit.\n" << std::endl;
     
+    // A reply streams on a worker thread; its tokens are posted back to the loop for printing.
+    // Ctrl-C while it streams closes the stream and keeps the session.
+    bool generating = false;
+    bool prompt_shown = false;
+    std::atomic<bool> cancel_requested{false};
+    std::string reply;
+    std::string last_prompt;
+    std::thread worker;
+
+    loop.on_interrupt = [&]() {
+        if (generating) {
+            cancel_requested = true;
+        } else {
+            std::cout << "\n(Type 'exit' or press Ctrl-D to quit)\nYou: " << std::flush;
+        }
+    };
+
     while (true) {
-        // Get user input
-        std::cout << "You: ";
-        std::getline(std::cin, user_message);
+        if (!generating && !prompt_shown) {
+            std::cout << "You: " << std::flush;
+            prompt_shown = true;
+        }
+        if (generating || !loop.has_line()) {
+            if (!generating && !loop.input_open()) break;
+            loop.run_once(out.ms_until_frame());
+            out.tick();
+            continue;
+        }
+
+        // Lines typed during the previous reply are taken in order
+        std::string user_message = loop.take_line();
+        prompt_shown = false;
         
         // Check for exit command
         if (user_message == "exit" || user_message == "quit") {
             break;
         }
+        if (user_message.empty()) continue;
+        prompt_history.record(user_message);
+        commands.refresh_if_due();   // Programs installed mid-session show up without a restart
+
+        if (user_message == "/history" || user_message.rfind("/history ", 0) == 0) {
+            std::string prefix = user_message.size() > 9 ? user_message.substr(9) : std::string();
+            auto completions = prompt_history.complete(prefix);
+            if (completions.empty()) std::cout << "No history entries start with \"" << prefix << "\"." << std::endl;
+            for (size_t i = 0; i < completions.size(); i++) std::cout << "  " << (i + 1) << ". " << completions[i] << std::endl;
+            continue;
+        }
         
-        // Add user message to history
-        chat_history.add_user(user_message);
-        
-        try {
-            // Generate response
-            std::cout << "Waiting for response..." << std::endl;
-            auto response = ollama.chat(model_name, chat_history);
-            
-            // Check for errors
-            if (response.has_error()) {
-                std::cerr << "Error: " << response.get_error() << std::endl;
+        // The last answer came from the semantic cache but did not fit the question: forget it
+        if (user_message == "/wrong") {
+            bool dropped = false;
+            try {
+                if (daemon) dropped = daemon->report_false_hit(model_name, last_prompt);
+                else if (semantic_cache) dropped = semantic_cache->report_false_hit(model_name, last_prompt);
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            std::cout << (dropped ? "Dropped the cached answer; ask again for a fresh one."
+                                  : "The last answer was not served from the semantic cache.") << std::endl;
+            continue;
+        }
+
+        if (user_message == "/cache") {
+            ollama::semantic_cache_stats stats;
+            size_t response_hits = response_cache->hit_count();
+            size_t response_misses = response_cache->miss_count();
+            bool semantic_on = semantic_cache != nullptr;
+            try {
+                if (daemon) {
+                    ollama::json reply = daemon->cache_stats(model_name);
+                    stats = reply.get<ollama::semantic_cache_stats>();
+                    response_hits = reply.value("response_hits", size_t(0));
+                    response_misses = reply.value("response_misses", size_t(0));
+                    semantic_on = reply.contains("lookups");
+                } else if (semantic_cache) {
+                    stats = semantic_cache->stats(model_name);
+                }
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            std::cout << "Response cache: " << response_hits << " hits, " << response_misses << " misses" << std::endl;
+            if (!semantic_on) {
+                std::cout << "Semantic cache: off (start with --semantic-cache)" << std::endl;
+            } else {
+                std::cout << "Semantic cache for " << model_name << ": " << stats.hits << " of " << stats.lookups << " lookups hit ("
+                          << static_cast<int>(stats.hit_rate() * 100 + 0.5) << "%), " << stats.rejected << " rejected by guards, "
+                          << stats.false_hits << " reported wrong, " << stats.stale << " expired" << std::endl;
+            }
+            continue;
+        }
+
+        if (rag_mode && user_message.rfind("/index ", 0) == 0) {
+            std::string path = user_message.substr(7);
+            try {
+                std::cout << "Indexed " << rag_store.index_path(embedder, path, &scheduler) << " chunks from " << path << std::endl;
+                rag_store.save(rag_store_path);
+            } catch (const ollama::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            continue;
+        }
+
+        if (user_message.rfind("/fork ", 0) == 0) {
+            size_t turns;
+            try {
+                turns = std::stoul(user_message.substr(6));
+            } catch (const std::exception&) {
+                std::cout << "Usage: /fork <turn>" << std::endl;
                 continue;
             }
-            
-            // Get assistant's response
-            std::string assistant_response = response.as_simple_string();
-            std::cout << "\nAssistant: " << assistant_response << "\n" << std::endl;
-            
-            // Add assistant's response to history
-            chat_history.add_assistant(assistant_response);
-        } 
-        catch (const ollama::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
+
+            // Keep everything before the user message that starts turn turns + 1
+            size_t keep = chat_history.size(), seen = 0;
+            for (size_t i = 0; i < chat_history.size(); i++) {
+                if (chat_history.at(i).value("role", "") == "user" && ++seen > turns) {
+                    keep = i;
+                    break;
+                }
+            }
+            ollama::messages forked = chat_history.prefix(keep);
+
+            size_t parent = current_branch;
+            branches[current_branch].history = chat_history;
+            std::string parent_log = branches[current_branch].log_path;
+            std::string path;
+            if (session.open(termsage::new_session_path())) {
+                // The shared messages stay in the parent's log; the fork only refers to them
+                session.append(termsage::session_role::model, model_name);
+                if (!parent_log.empty()) session.append_parent(parent_log, keep);
+                else session.append_history(forked);
+                path = session.path();
+            }
+            branches.push_back({forked, path});
+            current_branch = branches.size() - 1;
+            chat_history = forked;
+            std::cout << "Branch " << (current_branch + 1) << " forked from branch " << (parent + 1) << " after turn "
+                      << std::min(turns, seen) << " (" << keep << " shared messages). Use /branches to list them." << std::endl;
+            continue;
+        }
+
+        if (user_message == "/branches") {
+            for (size_t i = 0; i < branches.size(); i++) {
+                const ollama::messages& history = i == current_branch ? chat_history : branches[i].history;
+                size_t turns = 0;
+                std::string last;
+                for (size_t m = 0; m < history.size(); m++) {
+                    if (history.at(m).value("role", "") != "user") continue;
+                    turns++;
+                    last = history.at(m).value("content", "");
+                }
+                if (last.size() > 60) last = last.substr(0, 57) + "...";
+                std::cout << (i == current_branch ? "* " : "  ") << (i + 1) << ". " << turns << " turns"
+                          << (last.empty() ? "" : ", last: " + last) << std::endl;
+            }
+            continue;
         }
+
+        if (user_message.rfind("/switch ", 0) == 0) {
+            size_t target = 0;
+            try {
+                target = std::stoul(user_message.substr(8));
+            } catch (const std::exception&) {
+            }
+            if (target == 0 || target > branches.size()) {
+                std::cout << "No branch " << user_message.substr(8) << "; there are " << branches.size() << "." << std::endl;
+            } else {
+                switch_branch(target - 1);
+                std::cout << "Switched to branch " << target << "." << std::endl;
+            }
+            continue;
+        }
+
+        if (user_message.rfind("/search ", 0) == 0) {
+            auto started = std::chrono::steady_clock::now();
+            search_index.wait();
+            search_index.update();
+            auto hits = search_index.search(user_message.substr(8));
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+
+            std::cout << hits.size() << (hits.size() == 1 ? " match" : " matches") << " (" << elapsed << " ms)" << std::endl;
+            for (size_t i = 0; i < hits.size(); i++) {
+                std::string snippet = hits[i].snippet;
+                for (auto span = hits[i].highlights.rbegin(); color && span != hits[i].highlights.rend(); ++span) {
+                    snippet.insert(span->second, "\x1b[0m");
+                    snippet.insert(span->first, "\x1b[1m");
+                }
+                std::cout << "  " << (i + 1) << ". " << hits[i].session
+                          << (hits[i].role == termsage::session_role::user ? " (you): " : " (assistant): ") << snippet << std::endl;
+            }
+            continue;
+        }
+
+        if (user_message.rfind("/cmd ", 0) == 0) {
+            std::string name = user_message.substr(5);
+            commands.refresh_in_background();
+            if (commands.size() == 0) commands.wait();  // First run: nothing cached yet
+            if (auto info = commands.describe(name)) {
+                std::cout << info->name << (info->summary.empty() ? "" : " - " + info->summary) << "\n  " << info->path << std::endl;
+                if (!info->synopsis.empty()) std::cout << "  " << info->synopsis << std::endl;
+                for (size_t i = 0; i < info->flags.size() && i < 20; i++)
+                    std::cout << "    " << info->flags[i].first << (info->flags[i].second.empty() ? "" : "  " + info->flags[i].second) << std::endl;
+                if (info->flags.size() > 20) std::cout << "    ... " << info->flags.size() - 20 << " more" << std::endl;
+            } else {
+                auto names = commands.complete(name, 20);
+                if (names.empty()) std::cout << "No command on $PATH starts with \"" << name << "\"." << std::endl;
+                for (const auto& candidate : names) std::cout << "  " << candidate << std::endl;
+            }
+            continue;
+        }
+
+        if (user_message == "/add" || user_message.rfind("/add ", 0) == 0 ||
+            user_message == "/drop" || user_message.rfind("/drop ", 0) == 0) {
+            bool adding = user_message[1] == 'a';
+            std::vector<std::string> patterns;
+            std::istringstream words(user_message.substr(adding ? 4 : 5));
+            for (std::string word; words >> word;) patterns.push_back(word);
+
+            if (adding && !patterns.empty()) {
+                auto report = attachments.add(patterns);
+                std::cout << "Attached " << report.added << " file" << (report.added == 1 ? "" : "s");
+                if (report.duplicate) std::cout << ", " << report.duplicate << " already attached";
+                if (report.binary) std::cout << ", skipped " << report.binary << " binary";
+                if (report.too_large) std::cout << ", skipped " << report.too_large << " over 1 MB";
+                if (report.ignored) std::cout << ", " << report.ignored << " ignored by .gitignore";
+                if (report.missing) std::cout << ", " << report.missing << " pattern" << (report.missing == 1 ? "" : "s") << " matched nothing";
+                std::cout << "." << std::endl;
+            } else if (!adding) {
+                size_t removed = 0;
+                if (patterns.empty()) {
+                    removed = attachments.size();
+                    attachments.clear();
+                }
+                for (const auto& pattern : patterns) removed += attachments.remove(pattern);
+                std::cout << "Detached " << removed << " file" << (removed == 1 ? "" : "s") << "." << std::endl;
+            }
+            for (const auto& [path, tokens] : attachments.list()) std::cout << "  " << path << " (" << tokens << " tokens)" << std::endl;
+            if (!attachments.empty())
+                std::cout << attachments.tokens() << " tokens attached; up to " << attach_budget << " are sent with each question." << std::endl;
+            continue;
+        }
+
+        // Commands the message mentions get a few reference lines instead of whole man pages
+        std::string command_notes = commands.prompt_notes(user_message);
+
+        // Start retrieval first; it only needs the new message
+        std::future<std::string> retrieval;
+        auto retrieval_start = std::chrono::steady_clock::now();
+        if (rag_mode && !rag_store.empty()) {
+            retrieval = std::async(std::launch::async, [&query_embedder, &scheduler, &rag_store, user_message, rag_top_k, rag_budget_tokens]() {
+                try {
+                    auto slot = scheduler.acquire(ollama::priority_class::interactive, 1);
+                    auto embeddings = query_embedder.generate_embeddings(rag_store.model(), user_message).as_embeddings();
+                    if (embeddings.empty()) return std::string();
+                    return termsage::pack_context(rag_store.search(std::move(embeddings.front()), rag_top_k), rag_budget_tokens);
+                } catch (const std::exception&) {
+                    return std::string();
+                }
+            });
+        }
+
+        // Prepare the request while retrieval runs; retrieved context is sent
+        // with this turn only and is not kept in the history
+        ollama::messages request_messages = chat_history;
+
+        // Add user message to history; it is on disk before the request goes out
+        chat_history.add_user(user_message);
+        session.append(termsage::session_role::user, user_message);
+
+        last_prompt = user_message;
+
+        // Attached files, ranked against the question; lines already in the conversation are left out
+        termsage::packed_context attached;
+        if (!attachments.empty()) attached = attachments.pack(user_message, attach_budget, chat_history);
+
+        if (worker.joinable()) worker.join();
+        generating = true;
+        cancel_requested = false;
+        reply.clear();
+
+        worker = std::thread([&, request_messages, user_message, command_notes, attached = std::move(attached),
+                              retrieval = std::move(retrieval), retrieval_start]() mutable {
+            httplib::CancelScope cancel_scope(cancel_requested);
+            std::string error;
+            try {
+                if (!attached.text.empty()) {
+                    std::string note = "(" + std::to_string(attached.excerpts) + " excerpts from " + std::to_string(attached.files) +
+                                       " files, " + std::to_string(attached.tokens) + " tokens";
+                    if (attached.omitted) note += "; " + std::to_string(attached.omitted) + " left out for the budget";
+                    note += ")\n";
+                    request_messages.add_system(std::move(attached.text));
+                    loop.post([&out, note]() { out.write(note); });
+                }
+                if (retrieval.valid()) {
+                    std::string context = retrieval.get();
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - retrieval_start).count();
+                    if (!context.empty()) {
+                        request_messages.add_system("Use the following context if it is relevant to the question.\n\n" + context);
+                    }
+                    loop.post([&out, elapsed]() { out.write("(retrieval " + std::to_string(elapsed) + " ms)\n"); });
+                }
+                if (!command_notes.empty()) {
+                    request_messages.add_system("Reference for commands mentioned by the user, from the local system:\n" + command_notes);
+                }
+                request_messages.add_user(user_message);
+
+                loop.post([&out]() { out.write("\nAssistant: "); });
+                auto on_token = [&](const ollama::response& response) {
+                    if (cancel_requested) return false;
+                    std::string token = response.as_simple_string();
+                    loop.post([&reply, &out, &markdown, &rendered, token]() {
+                        reply += token;
+                        rendered.clear();
+                        markdown.feed(token, rendered);
+                        out.write(rendered);
+                    });
+                    return true;
+                };
+                ollama::json options = sampling.empty() ? ollama::json(nullptr) : ollama::json{{"options", sampling}};
+                if (daemon) {
+                    daemon->chat(model_name, request_messages, on_token, options);
+                } else {
+                    auto slot = scheduler.acquire(ollama::priority_class::interactive, scheduler.estimate_cost(options));
+                    if (pool) pool->chat(model_name, request_messages, on_token, options);
+                    else ollama.chat(model_name, request_messages, on_token, options);
+                }
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+
+            // Runs after every token posted above
+            loop.post([&, error]() {
+                generating = false;
+                rendered.clear();
+                markdown.finish(rendered);
+                out.write(rendered);
+                out.flush();
+                if (!error.empty()) std::cerr << "\nError: " << error << std::endl;
+                std::cout << (cancel_requested ? " [canceled]" : "") << "\n" << std::endl;
+
+                // Keep what was shown, even if cut short, so the history matches the screen
+                if (!reply.empty()) {
+                    chat_history.add_assistant(reply);
+                    session.append(termsage::session_role::assistant, reply);
+                }
+            });
+        });
+    }
+
+    if (worker.joinable()) {
+        cancel_requested = true;
+        worker.join();
     }
     
     std::cout << "Chat ended." << std::endl;
@@ -0,0 +1,215 @@
+// Backend pool and merged model catalog against fake Ollama servers on local ports
+#include "NetworkSystem/backend_pool.hpp"
+#include "ModelSystem/model_catalog.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <chrono>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what) {
+        if (condition) return;
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+
+    // Answers just enough of the Ollama API: "/", /api/tags, /api/ps, /api/show and non-streaming /api/chat
+    class fake_server {
+    public:
+        fake_server(std::vector<std::string> models, std::vector<std::string> loaded, bool chat_fails = false)
+            : models(std::move(models)), loaded(std::move(loaded)), chat_fails(chat_fails) {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            socklen_t length = sizeof(addr);
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+            port = ntohs(addr.sin_port);
+            listen(fd, 16);
+            thread = std::thread([this]() { serve(); });
+        }
+
+        ~fake_server() {
+            stopping = true;
+            shutdown(fd, SHUT_RDWR);
+            close(fd);
+            thread.join();
+        }
+
+        std::string url() const { return "http://127.0.0.1:" + std::to_string(port); }
+
+        std::atomic<int> chats{0};
+
+    private:
+        void serve() {
+            while (!stopping) {
+                int client = accept(fd, nullptr, nullptr);
+                if (client < 0) return;
+                std::string request;
+                char buffer[4096];
+                size_t body_start = std::string::npos;
+                size_t content_length = 0;
+                while (true) {
+                    ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+                    if (n <= 0) break;
+                    request.append(buffer, static_cast<size_t>(n));
+                    if (body_start == std::string::npos && (body_start = request.find("\r\n\r\n")) != std::string::npos) {
+                        body_start += 4;
+                        size_t header = request.find("Content-Length: ");
+                        if (header != std::string::npos && header < body_start) content_length = std::stoul(request.substr(header + 16));
+                    }
+                    if (body_start != std::string::npos && request.size() >= body_start + content_length) break;
+                }
+                respond(client, request);
+                close(client);
+            }
+        }
+
+        void respond(int client, const std::string& request) {
+            std::string path = request.substr(request.find(' ') + 1);
+            path = path.substr(0, path.find(' '));
+            int status = 200;
+            std::string body;
+            if (path == "/") {
+                body = "Ollama is running";
+            } else if (path == "/api/tags" || path == "/api/ps") {
+                nlohmann::json list = nlohmann::json::array();
+                for (const auto& name : path == "/api/tags" ? models : loaded)
+                    list.push_back({{"name", name}, {"model", name}, {"digest", "sha-" + name}, {"size", 1}});
+                body = nlohmann::json({{"models", list}}).dump();
+            } else if (path == "/api/show") {
+                body = R"({"details":{"family":"llama"},"model_info":{"llama.context_length":4096}})";
+            } else if (path == "/api/chat") {
+                chats++;
+                if (chat_fails) {
+                    status = 500;
+                    body = R"({"error":"boom"})";
+                } else {
+                    body = nlohmann::json({{"model", "m"}, {"message", {{"role", "assistant"}, {"content", url()}}}, {"done", true}}).dump();
+                }
+            } else {
+                status = 404;
+            }
+            std::string response = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error") +
+                                   "\r\nContent-Type: application/json\r\nConnection: close\r\nContent-Length: " +
+                                   std::to_string(body.size()) + "\r\n\r\n" + body;
+            send(client, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+
+        std::vector<std::string> models;
+        std::vector<std::string> loaded;
+        bool chat_fails;
+        int fd = -1;
+        int port = 0;
+        std::atomic<bool> stopping{false};
+        std::thread thread;
+    };
+
+    // A port nothing listens on
+    std::string dead_url() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t length = sizeof(addr);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+        close(fd);
+        return "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    }
+}
+
+int main() {
+    fake_server warm({"llama3:latest", "mistral:latest"}, {"llama3:latest"});
+    fake_server cold({"mistral:latest", "phi3:latest"}, {});
+    std::string down = dead_url();
+
+    ollama::backend_pool_options options;
+    options.probe_timeout_seconds = 1;
+    ollama::backend_pool pool({down, warm.url(), cold.url()}, options);
+
+    // A dead first server does not hide the healthy ones
+    auto alive = pool.refresh();
+    check(alive == std::vector<std::string>({warm.url(), cold.url()}), "refresh reports the reachable servers in order");
+
+    {
+        // Model affinity: llama3 is loaded on the warm server
+        ollama::backend_pool routing({warm.url(), cold.url()}, options);
+        routing.refresh();
+        auto first = routing.acquire("llama3");
+        check(first && first.url() == warm.url(), "a warm backend is preferred");
+
+        // Nobody has phi3 loaded, so the backend with fewer outstanding requests wins
+        auto second = routing.acquire("phi3");
+        check(second && second.url() == cold.url(), "least outstanding requests breaks ties");
+    }
+
+    auto response = pool.chat("llama3", ollama::messages());
+    check(response.as_simple_string() == warm.url(), "chat is routed to the warm backend");
+
+    // Repeated failures eject a backend and requests fail over to the other
+    fake_server broken({"llama3:latest"}, {"llama3:latest"}, true);
+    ollama::backend_pool failing({broken.url(), cold.url()}, options);
+    failing.refresh();
+    for (int i = 0; i < 3; i++) {
+        auto reply = failing.chat("llama3", ollama::messages());
+        check(reply.as_simple_string() == cold.url(), "a failed chat is retried on the next backend");
+    }
+    int broken_chats = broken.chats;
+    failing.chat("llama3", ollama::messages());
+    check(broken.chats == broken_chats, "an ejected backend gets no requests");
+    bool ejected = false;
+    for (const auto& status : failing.status()) ejected |= status.url == broken.url() && !status.healthy;
+    check(ejected, "status() reports the ejected backend");
+
+    // Health checks see "/" answer but must not cut the ejection short
+    {
+        ollama::backend_pool_options quick = options;
+        quick.health_interval = std::chrono::milliseconds(20);
+        quick.ejection_time = std::chrono::milliseconds(600);
+        ollama::backend_pool checked({broken.url(), cold.url()}, quick);
+        checked.refresh();
+        for (int i = 0; i < 3; i++) checked.chat("llama3", ollama::messages());
+        checked.start_health_checks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int before = broken.chats;
+        checked.chat("llama3", ollama::messages());
+        check(broken.chats == before, "health checks keep an ejected backend out until its time is up");
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(700));
+        checked.chat("llama3", ollama::messages());
+        check(broken.chats == before + 1, "after the ejection window the backend is tried again");
+        checked.stop_health_checks();
+    }
+
+    // The catalog lists the union of every reachable server's models
+    std::string catalog_path = "/tmp/termsage_pool_test_" + std::to_string(getpid()) + ".bin";
+    {
+        Ollama first(warm.url());
+        Ollama second(cold.url());
+        termsage::model_catalog catalog(catalog_path);
+        catalog.refresh(std::vector<Ollama*>{&first, &second});
+        std::vector<std::string> names;
+        for (const auto& entry : catalog.entries()) names.push_back(entry.summary.name);
+        check(names == std::vector<std::string>({"llama3:latest", "mistral:latest", "phi3:latest"}), "model lists are merged");
+        check(catalog.find("phi3") && catalog.find("phi3")->details.context_length == 4096, "details come from the listing server");
+    }
+    std::remove(catalog_path.c_str());
+
+    if (failures == 0) std::cout << "backend_pool_test: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Pipe-mode map/reduce with the model stubbed out: chunking, note order and multi-level merging
+#include "PipeSystem/map_reduce.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what) {
+        if (condition) return;
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+
+    // Every request the job made, by kind
+    struct transcript {
+        std::mutex mutex;
+        std::map<size_t, std::string> chunks;     // Map input by part number (1-based)
+        std::vector<std::string> reduces;         // Reduce inputs
+        std::string final_input;
+        std::string direct_input;
+        std::string answer;
+    };
+
+    size_t part_of(const std::string& system) {
+        size_t at = system.find("From part ");
+        return at == std::string::npos ? 0 : std::stoul(system.substr(at + 10));
+    }
+
+    // Note numbers in the order they appear, e.g. "note-3;" gives 3
+    std::vector<size_t> note_order(const std::string& text) {
+        std::vector<size_t> order;
+        for (size_t at = text.find("note-"); at != std::string::npos; at = text.find("note-", at + 5)) {
+            order.push_back(std::stoul(text.substr(at + 5)));
+        }
+        return order;
+    }
+
+    size_t note_count(const std::string& input) {
+        size_t count = 1;
+        for (size_t at = input.find("\n\n---\n\n"); at != std::string::npos; at = input.find("\n\n---\n\n", at + 1)) count++;
+        return count;
+    }
+
+    // Runs a job over input written to a pipe; note(part) is the map reply, delay(part) how long it takes
+    void run_job(termsage::map_reduce_options config, const std::string& input, transcript& seen,
+                 const std::function<std::string(size_t)>& note,
+                 const std::function<std::chrono::milliseconds(size_t)>& delay) {
+        config.chat = [&](const std::string& system, const std::string& user) {
+            if (size_t part = part_of(system)) {
+                std::this_thread::sleep_for(delay(part));
+                std::lock_guard<std::mutex> lock(seen.mutex);
+                seen.chunks[part] = user;
+                return note(part);
+            }
+            std::lock_guard<std::mutex> lock(seen.mutex);
+            if (system.find("Merge them") != std::string::npos) {
+                seen.reduces.push_back(user);
+                std::string merged = "(";
+                for (size_t number : note_order(user)) merged += "note-" + std::to_string(number) + "; ";
+                return merged + ")";
+            }
+            if (system.find("Use them") != std::string::npos) seen.final_input = user;
+            else seen.direct_input = user;
+            return std::string("answer");
+        };
+
+        int fds[2];
+        if (pipe(fds) != 0) {
+            check(false, "pipe");
+            return;
+        }
+        std::thread writer([&]() {
+            for (size_t at = 0; at < input.size();) {
+                ssize_t n = write(fds[1], input.data() + at, input.size() - at);
+                if (n <= 0) break;
+                at += static_cast<size_t>(n);
+            }
+            close(fds[1]);
+        });
+
+        Ollama server("http://127.0.0.1:9");
+        termsage::map_reduce job(server, config);
+        try {
+            job.run(fds[0], [&](const std::string& token) { seen.answer += token; });
+        } catch (const std::exception& e) {
+            check(false, std::string("run threw: ") + e.what());
+        }
+        writer.join();
+        close(fds[0]);
+    }
+
+    // Chunks cover the input exactly, stay within chunk_bytes and never split a UTF-8 character
+    void check_chunks(const transcript& seen, const std::string& input, size_t chunk_bytes, bool at_lines, const std::string& what) {
+        std::string joined;
+        size_t expected = 1;
+        for (const auto& [part, chunk] : seen.chunks) {
+            check(part == expected++, what + ": part " + std::to_string(part) + " missing or out of place");
+            check(chunk.size() <= chunk_bytes, what + ": chunk " + std::to_string(part) + " is over chunk_bytes");
+            check(!chunk.empty() && (static_cast<unsigned char>(chunk.front()) & 0xC0) != 0x80,
+                  what + ": chunk " + std::to_string(part) + " starts inside a character");
+            if (at_lines && part < seen.chunks.size()) {
+                check(chunk.back() == '\n', what + ": chunk " + std::to_string(part) + " does not end at a line break");
+            }
+            joined += chunk;
+        }
+        check(joined == input, what + ": chunks do not add up to the input");
+    }
+
+    std::vector<size_t> range(size_t first, size_t last, size_t step = 1) {
+        std::vector<size_t> numbers;
+        for (size_t i = first; i <= last; i += step) numbers.push_back(i);
+        return numbers;
+    }
+}
+
+int main() {
+    // Many small notes finishing out of order, merged two at a time over several levels
+    {
+        std::string input;
+        for (int i = 0; i < 60; i++) input += "line " + std::to_string(i) + " " + std::string(90, 'a' + i % 26) + "\n";
+        termsage::map_reduce_options config;
+        config.task = "test";
+        config.chunk_bytes = 256;
+        config.jobs = 4;
+        config.fanout = 2;
+        transcript seen;
+        run_job(config, input, seen,
+                [](size_t part) { return "note-" + std::to_string(part) + ";"; },
+                [](size_t part) { return std::chrono::milliseconds((4 - part % 4) * 5); });
+
+        size_t parts = seen.chunks.size();
+        check(parts > 8, "small notes: input was split into many chunks");
+        check_chunks(seen, input, 256, true, "line chunks");
+        check(note_order(seen.final_input) == range(1, parts), "small notes: the final prompt has every note in input order");
+        check(seen.answer == "answer", "small notes: the answer is streamed");
+
+        bool nested = false;
+        for (const auto& reduce : seen.reduces) {
+            check(note_count(reduce) >= 2, "small notes: every reduce merges at least two notes");
+            std::vector<size_t> order = note_order(reduce);
+            check(std::is_sorted(order.begin(), order.end()), "small notes: a reduce sees its notes in input order");
+            if (reduce.find('(') != std::string::npos) nested = true;
+        }
+        check(nested, "small notes: merged notes are merged again one level up");
+    }
+
+    // Notes too big to share a request move up alone; "nothing relevant" notes are dropped
+    {
+        std::string input;
+        for (int i = 0; i < 30; i++) input += std::string(100, 'x') + "\n";
+        termsage::map_reduce_options config;
+        config.task = "test";
+        config.chunk_bytes = 256;
+        config.jobs = 3;
+        config.fanout = 8;
+        transcript seen;
+        run_job(config, input, seen,
+                [](size_t part) {
+                    if (part % 2 == 0) return std::string("Nothing relevant.");
+                    return "note-" + std::to_string(part) + ";" + std::string(200, '.');
+                },
+                [](size_t part) { return std::chrono::milliseconds(part % 3 == 0 ? 15 : 0); });
+
+        size_t parts = seen.chunks.size();
+        check(note_order(seen.final_input) == range(1, parts, 2), "large notes: the final prompt keeps the relevant notes in order");
+        for (const auto& reduce : seen.reduces) {
+            check(note_count(reduce) >= 2, "large notes: a lone note is promoted, not sent to be merged");
+            check(reduce.find("Nothing relevant") == std::string::npos, "large notes: empty notes are never merged");
+        }
+    }
+
+    // Without line breaks chunks are cut between UTF-8 characters
+    {
+        std::string input = "a";
+        for (int i = 0; i < 1000; i++) input += "\xc3\xa9";
+        termsage::map_reduce_options config;
+        config.task = "test";
+        config.chunk_bytes = 256;
+        transcript seen;
+        run_job(config, input, seen,
+                [](size_t part) { return "note-" + std::to_string(part) + ";"; },
+                [](size_t) { return std::chrono::milliseconds(0); });
+        check(seen.chunks.size() >= 8, "utf-8: input was split");
+        check_chunks(seen, input, 256, false, "utf-8 chunks");
+    }
+
+    // Input that fits one chunk is answered directly
+    {
+        termsage::map_reduce_options config;
+        config.task = "test";
+        transcript seen;
+        run_job(config, "short input\n", seen,
+                [](size_t) { return std::string(); },
+                [](size_t) { return std::chrono::milliseconds(0); });
+        check(seen.chunks.empty() && seen.reduces.empty(), "direct: no map or reduce requests");
+        check(seen.direct_input == "short input\n" && seen.answer == "answer", "direct: the input is answered in one request");
+    }
+
+    if (failures == 0) std::cout << "map_reduce_test: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
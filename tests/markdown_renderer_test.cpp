@@ -0,0 +1,56 @@
+// Streaming Markdown renderer: fences, code spans and token-split input, rendered without color
+#include "TerminalSystem/markdown_renderer.hpp"
+#include <iostream>
+#include <string>
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what) {
+        if (condition) return;
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+
+    std::string render(const std::string& text, size_t token_size) {
+        termsage::markdown_renderer markdown(false);
+        std::string out;
+        for (size_t i = 0; i < text.size(); i += token_size) markdown.feed(std::string_view(text).substr(i, token_size), out);
+        markdown.finish(out);
+        return out;
+    }
+
+    // Output must not depend on how the reply was split into tokens
+    void expect(const std::string& text, const std::string& expected, const std::string& what) {
+        for (size_t token_size : {text.size(), size_t(1), size_t(3)}) {
+            std::string got = render(text, token_size);
+            check(got == expected, what + " (tokens of " + std::to_string(token_size) + "): got \"" + got + "\"");
+        }
+    }
+}
+
+int main() {
+    expect("```py\nx = 1\n```\nafter\n", "┌─ py\nx = 1\n└─\nafter\n", "a plain fence opens and closes");
+
+    expect("````md\n```\ninner\n```\n````\nafter\n", "┌─ md\n```\ninner\n```\n└─\nafter\n",
+           "a shorter run inside a four-backtick fence is code");
+
+    expect("```\ncode\n`````\ntext\n", "┌─ code\ncode\n└─\ntext\n", "a longer run closes the fence");
+
+    expect("```\ncode\n```  \ntext\n", "┌─ code\ncode\n└─\ntext\n", "spaces may follow the closing run");
+
+    expect("```\ncode\n``` x\n", "┌─ code\ncode\n``` x\n", "a run followed by text does not close");
+
+    expect("~~~\na\n~~~\n", "┌─ code\na\n└─\n", "tilde fences");
+
+    expect("use ``` to start a fence\n", "use ``` to start a fence\n", "a bare inline triple backtick stays visible");
+
+    expect("run `ls -l` now\n", "run ls -l now\n", "single backtick code span");
+
+    expect("``a ` b`` c\n", "a ` b c\n", "a double backtick span may contain a single backtick");
+
+    expect("- item with **bold**\n", "• item with bold\n", "lists and emphasis");
+
+    if (failures == 0) std::cout << "markdown_renderer_test: all checks passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}